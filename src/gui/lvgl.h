@@ -61,6 +61,8 @@ void disp_flush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p)
 {
     // if (!lv_disp_is_invalidation_enabled(disp_ctrl))
     //{
+    // Wait for map frame DMA transfer
+    tft.waitDMA();
     tft.startWrite();
 
     // Map Tile, refresh partial screen to avoid flickering when scroll tile view
@@ -116,8 +118,8 @@ void init_LVGL()
     lv_port_spiffs_fs_init();
     // lv_port_sd_fs_init();
 
-    static lv_color_t *buf1 = (lv_color_t *)ps_malloc((TFT_WIDTH * TFT_HEIGHT) * 2);
-    lv_disp_draw_buf_init(&draw_buf, buf1, NULL, (TFT_WIDTH * TFT_HEIGHT) * 2);
+    static lv_color_t *buf1 = (lv_color_t *)arena_alloc(ARENA_LVGL, ARENA_LVGL_SIZE);
+    lv_disp_draw_buf_init(&draw_buf, buf1, NULL, ARENA_LVGL_SIZE / sizeof(lv_color_t));
 
     lv_disp_drv_init(&def_drv);
     def_drv.hor_res = screenWidth;
@@ -6,7 +6,7 @@
  * @date 2023-06-14
  */
 
-static void delete_map_scr_sprites();
+static void release_map_scr();
 static void create_map_scr_sprites();
 
 /**
@@ -33,6 +33,13 @@ bool is_scrolled = true;
  */
 bool is_ready = false;
 
+/**
+ * @brief GPS fix shown in compass tile and its epoch sequence (read when a new epoch is published)
+ *
+ */
+GpsFix main_fix = {};
+uint32_t main_fix_seq = 0;
+
 /**
  * @brief Old Map tile coordinates and zoom
  *
@@ -89,8 +96,7 @@ static void get_act_tile(lv_event_t *event)
     if (is_ready)
     {
         is_scrolled = true;
-        log_d("Free PSRAM: %d", ESP.getFreePsram());
-        log_d("Used PSRAM: %d", ESP.getPsramSize() - ESP.getFreePsram());
+        log_arena_stats();
         if (act_tile == MAP)
         {
             create_map_scr_sprites();
@@ -116,8 +122,8 @@ static void scroll_tile(lv_event_t *event)
     is_scrolled = false;
     is_ready = false;
 
-    delete_map_scr_sprites();
-    delete_sat_info_sprites();
+    release_map_scr();
+    sky_plot.full_push = true;
 }
 
 /**
@@ -126,6 +132,15 @@ static void scroll_tile(lv_event_t *event)
  */
 static void update_main_screen(lv_timer_t *t)
 {
+    check_arena_pressure();
+    bool new_fix = is_gps_fix_new(main_fix_seq);
+    if (new_fix)
+        main_fix_seq = read_gps_fix(main_fix);
+    update_gps_rate(main_fix.quality > 0 ? main_fix.speed : -1.0f, is_main_screen && act_tile == SATTRACK, batt_level);
+    if (new_fix)
+        update_warm_start(main_fix, zoom);
+    check_gps_start(main_fix.quality > 0, is_main_screen);
+
     if (is_scrolled && is_main_screen)
     {
         switch (act_tile)
@@ -136,23 +151,18 @@ static void update_main_screen(lv_timer_t *t)
             lv_event_send(compass_heading, LV_EVENT_VALUE_CHANGED, NULL);
 #endif
 
-            if (GPS.location.isUpdated())
+            if (new_fix)
             {
                 lv_event_send(latitude, LV_EVENT_VALUE_CHANGED, NULL);
                 lv_event_send(longitude, LV_EVENT_VALUE_CHANGED, NULL);
-            }
-            if (GPS.altitude.isUpdated())
-            {
                 lv_event_send(altitude, LV_EVENT_VALUE_CHANGED, NULL);
-            }
-
-            if (GPS.speed.isUpdated())
                 lv_event_send(speed_label, LV_EVENT_VALUE_CHANGED, NULL);
+            }
 
             break;
 
         case MAP:
-            // if (GPS.location.isUpdated())
+            // if (new_fix)
             lv_event_send(map_tile, LV_EVENT_REFRESH, NULL);
             break;
 
@@ -19,19 +19,154 @@ MapTile RoundMapTile;
  */
 ScreenCoord NavArrow_position;
 
+/**
+ * @brief Toroidal map sprite: tile (X,Y) is always stored in slot (X % 3, Y % 3)
+ *        so a tile crossing only loads the newly exposed row/column
+ *
+ */
+#define MAP_SLOTS 3
+struct MapSlot
+{
+  uint32_t tilex;
+  uint32_t tiley;
+  uint8_t zoom;
+  bool found;
+  bool loaded;
+};
+MapSlot map_slot[MAP_SLOTS][MAP_SLOTS] = {};
+
+/**
+ * @brief Map view state drawn in last frame (rotate and push are skipped if nothing visible changed)
+ *
+ */
+#ifndef MAP_HEADING_THRESHOLD
+#define MAP_HEADING_THRESHOLD 3 // Min heading change (degrees) to rotate map
+#endif
+#define MAP_STATS_PERIOD 10000
+struct MapView
+{
+  uint16_t pivot_x;
+  uint16_t pivot_y;
+  int16_t heading;
+  uint8_t zoom;
+  uint16_t speed;
+  bool stale;
+};
+MapView map_view = {};
+bool map_view_dirty = true;
+
+/**
+ * @brief Map frame counters
+ *
+ */
+uint32_t map_frames_rendered = 0;
+uint32_t map_frames_skipped = 0;
+uint32_t map_stats_time = 0;
+uint32_t map_rotate_us = 0;
+uint32_t map_hud_us = 0;
+
+/**
+ * @brief Map frame buffers (ping-pong): frame N is DMA pushed to the panel while frame N+1 is rendered.
+ *        Overlap needs the panel transaction kept open between frames, so it is only done on boards whose
+ *        panel bus isn't shared with other devices (-D TFT_BUS_EXCLUSIVE=1), otherwise each frame ends its
+ *        transaction once pushed. Build with -D MAP_SYNC_PUSH=1 to push a single frame buffer synchronously
+ *
+ */
+#define MAP_FRAMES 2
+uint16_t *map_frame[MAP_FRAMES] = {};
+uint8_t map_frame_back = 0;
+bool map_dma_write = false;
+
+/**
+ * @brief Map render counters (CPU time in map update and time waiting for panel transfer)
+ *
+ */
+uint32_t map_busy_us = 0;
+uint32_t map_push_us = 0;
+uint32_t map_stats_frames = 0;
+
+/**
+ * @brief Free pan mode: viewport center (world pixels) moved by touch drag with inertia, decoupled from GPS.
+ *        Long press on map toggles pan mode (leaving it recenters map on GPS position)
+ *
+ */
+#ifndef MAP_FRAME_BUDGET
+#define MAP_FRAME_BUDGET 15000 // Tile decode time budget per frame in pan mode (us)
+#endif
+#define PAN_FRICTION 0.85      // Inertia speed decay per frame
+#define PAN_MIN_SPEED 0.5      // Inertia stop speed (pixels per frame)
+struct MapPan
+{
+  bool active;
+  bool dragging;
+  bool moved;
+  double x;
+  double y;
+  float speed_x;
+  float speed_y;
+  int16_t arrow_x;
+  int16_t arrow_y;
+};
+MapPan map_pan = {};
+
+/**
+ * @brief Pan mode counters
+ *
+ */
+uint32_t map_pan_frames = 0;
+uint32_t map_pan_late = 0;
+uint32_t map_pan_pending = 0;
+
 static const char *map_scale[] = {"5000 Km","2500 Km","1500 Km","700 Km","350 Km",
                                    "150 Km","100 Km","40 Km","20 Km","10 Km","5 Km",
                                    "2,5 Km","1,5 Km","700 m","350 m","150 m","80 m",
                                    "40 m","20 m","10 m"};
 
+/**
+ * @brief GPS fix followed by map (read when a new epoch is published) and position predicted
+ *        by GPS filter at map update time (see gps_filter.h)
+ *
+ */
+GpsFix map_fix = {};
+uint32_t map_fix_seq = 0;
+bool map_filtered = false;
+double map_lat = 0.0;
+double map_lon = 0.0;
+
+/**
+ * @brief Cached position (last fix of previous session, see warm start in preferences.h) shown as stale
+ *        until first fix
+ *
+ */
+bool map_cached = false;
+double map_cache_lat = 0.0;
+double map_cache_lon = 0.0;
+
+/**
+ * @brief Set cached position shown until first fix
+ *
+ * @param lat -> latitude
+ * @param lon -> longitude
+ */
+void set_map_cache(double lat, double lon)
+{
+  map_cache_lat = lat;
+  map_cache_lon = lon;
+  map_cached = true;
+}
+
 /**
  * @brief return latitude from GPS or sys env pre-built variable
  * @return latitude or 0.0 if not defined
  */
 static double getLat()
 {
-  if (GPS.location.isValid())
-    return GPS.location.lat();
+  if (map_filtered)
+    return map_lat;
+  else if (map_fix.valid & NMEA_LOCATION)
+    return map_fix.lat;
+  else if (map_cached)
+    return map_cache_lat;
   else
   {
 #ifdef DEFAULT_LAT
@@ -48,8 +183,12 @@ static double getLat()
  */
 static double getLon()
 {
-  if (GPS.location.isValid())
-    return GPS.location.lng();
+  if (map_filtered)
+    return map_lon;
+  else if (map_fix.valid & NMEA_LOCATION)
+    return map_fix.lon;
+  else if (map_cached)
+    return map_cache_lon;
   else
   {
 #ifdef DEFAULT_LON
@@ -67,9 +206,8 @@ static double getLon()
  */
 static void get_zoom_value(lv_event_t *event)
 {
-  lv_obj_t *screen = lv_event_get_current_target(event);
   lv_dir_t dir = lv_indev_get_gesture_dir(lv_indev_get_act());
-  if (act_tile == MAP && is_main_screen)
+  if (act_tile == MAP && is_main_screen && !map_pan.active)
   {
     switch (dir)
     {
@@ -96,42 +234,414 @@ static void get_zoom_value(lv_event_t *event)
 }
 
 /**
- * @brief Delete map screen sprites and release PSRAM
+ * @brief Finish map frame transfer before leaving map screen (sprites stay attached to PSRAM arena)
  *
  */
-static void delete_map_scr_sprites()
+static void release_map_scr()
 {
-  sprArrow.deleteSprite();
-  map_rot.deleteSprite();
-  zoom_spr.deleteSprite();
+  if (map_dma_write)
+  {
+    tft.waitDMA();
+    tft.endWrite();
+    map_dma_write = false;
+  }
 }
 
 /**
- * @brief Create a map screen sprites
+ * @brief Create a map screen sprites (attached to PSRAM arena on first call, later calls only reset them)
  *
  */
 static void create_map_scr_sprites()
 {
   // Map Sprite
-  map_rot.createSprite(320, 374);
+  static bool map_frames_attached = false;
+  if (!map_frames_attached)
+  {
+#ifdef MAP_SYNC_PUSH
+    map_frame[0] = (uint16_t *)arena_alloc(ARENA_MAP_SCR, MAP_FRAME_BYTES);
+#else
+    for (int i = 0; i < MAP_FRAMES; i++)
+      map_frame[i] = (uint16_t *)arena_alloc(ARENA_MAP_SCR, MAP_FRAME_BYTES);
+#endif
+    if (map_frame[0] == NULL)
+      map_frame[1] = NULL;
+    map_frames_attached = true;
+  }
+  map_frame_back = 0;
+  if (map_frame[0] != NULL)
+    map_rot.setBuffer(map_frame[0], MAP_FRAME_WIDTH, MAP_FRAME_HEIGHT);
+  else
+    arena_sprite(map_rot, ARENA_MAP_SCR, MAP_FRAME_WIDTH, MAP_FRAME_HEIGHT);
   map_rot.pushSprite(0, 27);
   // Arrow Sprite
-  sprArrow.createSprite(16, 16);
-  sprArrow.setColorDepth(16);
+  arena_sprite(sprArrow, ARENA_MAP_SCR, 16, 16);
   sprArrow.pushImage(0, 0, 16, 16, (uint16_t *)navigation);
   // Zoom Sprite
-  zoom_spr.createSprite(48, 28);
-  zoom_spr.setColorDepth(16);
+  arena_sprite(zoom_spr, ARENA_MAP_SCR, 48, 28);
   zoom_spr.pushImage(0, 0, 24, 24, (uint16_t *)zoom_ico);
+  // HUD layers
+  create_map_hud();
+
+  map_view_dirty = true;
 }
 
 /**
- * @brief Update map event
+ * @brief Get heading difference in range -180..180
+ *
+ * @param a -> heading (degrees)
+ * @param b -> heading (degrees)
+ * @return int16_t -> difference (degrees)
+ */
+static int16_t heading_diff(int16_t a, int16_t b)
+{
+  int16_t diff = (a - b) % 360;
+  if (diff < -180)
+    diff += 360;
+  if (diff > 180)
+    diff -= 360;
+  return diff;
+}
+
+/**
+ * @brief Check if visible map state changed since last drawn frame
+ *
+ * @param view -> new map view state
+ * @return true if map must be redrawn
+ */
+static bool is_map_view_changed(const MapView &view)
+{
+  return map_view_dirty || view.pivot_x != map_view.pivot_x || view.pivot_y != map_view.pivot_y ||
+         view.heading != map_view.heading || view.zoom != map_view.zoom || view.speed != map_view.speed ||
+         view.stale != map_view.stale;
+}
+
+/**
+ * @brief Log rendered and skipped map frames
+ *
+ */
+static void log_map_frame_stats()
+{
+  if (millis() - map_stats_time < MAP_STATS_PERIOD)
+    return;
+  uint32_t elapsed = millis() - map_stats_time;
+  map_stats_time = millis();
+  uint32_t frames = map_frames_rendered - map_stats_frames;
+  log_v("Map render: %d.%d fps, CPU %d%%, push wait %d us/frame (%s)", (frames * 10000 / elapsed) / 10,
+        (frames * 10000 / elapsed) % 10, map_busy_us / (elapsed * 10), frames ? map_push_us / frames : 0,
+        map_frame[1] != NULL ? PSTR("DMA ping-pong") : PSTR("sync"));
+  map_stats_frames = map_frames_rendered;
+  map_busy_us = 0;
+  map_push_us = 0;
+  uint32_t total = map_frames_rendered + map_frames_skipped;
+  log_v("Map frames: %d rendered, %d skipped (%d%% skipped)", map_frames_rendered, map_frames_skipped,
+        total ? (map_frames_skipped * 100) / total : 0);
+  if (map_frames_rendered > 0)
+    log_v("Map rotate: %d us/frame, HUD: %d us/frame (%d redraws)", map_rotate_us / map_frames_rendered,
+          map_hud_us / map_frames_rendered, hud_redraws);
+  if (map_pan_frames > 0)
+    log_v("Map pan: %d frames, %d over %d ms, %d tiles deferred", map_pan_frames, map_pan_late,
+          UPDATE_MAINSCR_PERIOD, map_pan_pending);
+}
+
+/**
+ * @brief Copy decoded tile into map sprite
+ *
+ * @param tile -> decoded tile buffer (256x256)
+ * @param x -> X position in map sprite
+ * @param y -> Y position in map sprite
+ */
+static void copy_tile_to_map(const uint16_t *tile, uint16_t x, uint16_t y)
+{
+  uint16_t *dst = (uint16_t *)map_spr.getBuffer() + (y * map_spr.width()) + x;
+  for (int row = 0; row < tileSize; row++)
+    memcpy(dst + (row * map_spr.width()), tile + (row * tileSize), tileSize * sizeof(uint16_t));
+}
+
+/**
+ * @brief Load tile into its toroidal map sprite slot (if not already loaded)
+ *
+ * @param tile -> Map Tile structure
+ * @return true if tile is found
+ */
+static bool load_map_slot(const MapTile &tile)
+{
+  uint8_t slot_x = tile.tilex % MAP_SLOTS;
+  uint8_t slot_y = tile.tiley % MAP_SLOTS;
+  MapSlot &slot = map_slot[slot_x][slot_y];
+
+  if (slot.loaded && slot.zoom == tile.zoom && slot.tilex == tile.tilex && slot.tiley == tile.tiley)
+    return slot.found;
+
+  slot.zoom = tile.zoom;
+  slot.tilex = tile.tilex;
+  slot.tiley = tile.tiley;
+  slot.loaded = true;
+
+  if (tile_cache_slots > 0 && tile_stage_buf != NULL)
+  {
+    uint16_t *tile_buf = get_cached_tile(tile);
+    slot.found = (tile_buf != NULL);
+    if (slot.found)
+      copy_tile_to_map(tile_buf, slot_x * tileSize, slot_y * tileSize);
+  }
+  else
+    slot.found = decode_tile(tile, map_spr, slot_x * tileSize, slot_y * tileSize) ||
+                 synthesize_tile(tile, get_sprite_ptr(map_spr, slot_x * tileSize, slot_y * tileSize), map_spr.width());
+
+  if (!slot.found)
+    map_spr.fillRect(slot_x * tileSize, slot_y * tileSize, tileSize, tileSize, LVGL_BKG);
+
+  return slot.found;
+}
+
+/**
+ * @brief Rotate map sprite around its pivot into destination sprite center
+ *
+ * @param dst -> destination sprite
+ * @param angle -> rotation angle (degrees)
+ */
+static void rotate_map(TFT_eSprite *dst, int16_t angle)
+{
+  uint32_t start = micros();
+  rotate_wrap((uint16_t *)map_spr.getBuffer(), map_spr.width(), map_spr.getPivotX(), map_spr.getPivotY(),
+              (uint16_t *)dst->getBuffer(), dst->width(), dst->height(), angle);
+  map_rotate_us += micros() - start;
+}
+
+/**
+ * @brief Push rendered map frame to panel. With two frame buffers the frame is sent by DMA and rendering
+ *        continues in the other buffer: with TFT_BUS_EXCLUSIVE panel transaction is kept open while map is
+ *        shown, otherwise it ends (waiting for DMA) so bus is released between frames
+ *
+ */
+static void push_map_frame()
+{
+  uint32_t start = micros();
+  if (map_frame[1] == NULL)
+    map_rot.pushSprite(0, 27);
+  else
+  {
+#ifdef TFT_BUS_EXCLUSIVE
+    if (!map_dma_write)
+    {
+      tft.startWrite();
+      map_dma_write = true;
+    }
+    tft.waitDMA();
+    tft.pushImageDMA(0, 27, map_rot.width(), map_rot.height(), (uint16_t *)map_rot.getBuffer());
+#else
+    tft.startWrite();
+    tft.pushImageDMA(0, 27, map_rot.width(), map_rot.height(), (uint16_t *)map_rot.getBuffer());
+    tft.waitDMA();
+    tft.endWrite();
+#endif
+    map_frame_back ^= 1;
+    map_rot.setBuffer(map_frame[map_frame_back], map_rot.width(), map_rot.height());
+  }
+  map_push_us += micros() - start;
+}
+
+/**
+ * @brief Load map slots around viewport within frame time budget. Cached tiles are always copied,
+ *        missing tiles are decoded while budget lasts (the rest show background until next frames)
+ *
+ * @param lon -> viewport center longitude
+ * @param lat -> viewport center latitude
+ * @param start -> frame start time (us)
+ * @return uint8_t -> tiles still pending
+ */
+static uint8_t load_map_slots(double lon, double lat, uint32_t start)
+{
+  // Center tile first
+  static const int8_t slot_order[MAP_SLOTS * MAP_SLOTS][2] = {{0, 0}, {-1, 0}, {1, 0}, {0, -1}, {0, 1},
+                                                              {-1, -1}, {1, -1}, {-1, 1}, {1, 1}};
+  uint8_t pending = 0;
+  for (int i = 0; i < MAP_SLOTS * MAP_SLOTS; i++)
+  {
+    MapTile tile = get_map_tile(lon, lat, zoom, slot_order[i][0], slot_order[i][1]);
+    MapSlot &slot = map_slot[tile.tilex % MAP_SLOTS][tile.tiley % MAP_SLOTS];
+    bool same = slot.zoom == tile.zoom && slot.tilex == tile.tilex && slot.tiley == tile.tiley;
+    if (same && slot.loaded)
+      continue;
+
+    bool cached = tile_cache_slots > 0 && find_cached_tile(tile) != NULL;
+    if (cached || micros() - start < MAP_FRAME_BUDGET)
+    {
+      load_map_slot(tile);
+      map_view_dirty = true;
+    }
+    else
+    {
+      if (!same)
+      {
+        slot.zoom = tile.zoom;
+        slot.tilex = tile.tilex;
+        slot.tiley = tile.tiley;
+        slot.found = false;
+        slot.loaded = false;
+        map_spr.fillRect((tile.tilex % MAP_SLOTS) * tileSize, (tile.tiley % MAP_SLOTS) * tileSize, tileSize, tileSize, LVGL_BKG);
+        map_view_dirty = true;
+      }
+      pending++;
+    }
+  }
+  return pending;
+}
+
+/**
+ * @brief Enter or leave free pan mode
+ *
+ * @param active -> true to start pan mode, false to recenter map on GPS position
+ */
+static void set_map_pan(bool active)
+{
+  map_pan.active = active;
+  map_pan.dragging = false;
+  map_pan.speed_x = 0;
+  map_pan.speed_y = 0;
+  if (active)
+  {
+    map_pan.x = lon2worldx(getLon(), zoom);
+    map_pan.y = lat2worldy(getLat(), zoom);
+    lv_obj_clear_flag(tiles, LV_OBJ_FLAG_SCROLLABLE);
+  }
+  else
+  {
+    lv_obj_add_flag(tiles, LV_OBJ_FLAG_SCROLLABLE);
+    is_map_draw = false;
+  }
+  map_view_dirty = true;
+}
+
+/**
+ * @brief Map touch events (pan mode toggle and drag)
  *
  * @param event
  */
-static void update_map(lv_event_t *event)
+static void map_pan_event(lv_event_t *event)
 {
+  lv_event_code_t code = lv_event_get_code(event);
+  lv_point_t vect;
+
+  switch (code)
+  {
+  case LV_EVENT_PRESSED:
+    map_pan.moved = false;
+    break;
+  case LV_EVENT_LONG_PRESSED:
+    if (!map_pan.moved)
+      set_map_pan(!map_pan.active);
+    break;
+  case LV_EVENT_PRESSING:
+    if (!map_pan.active)
+      break;
+    lv_indev_get_vect(lv_indev_get_act(), &vect);
+    if (vect.x != 0 || vect.y != 0)
+    {
+      map_pan.moved = true;
+      map_pan.dragging = true;
+      map_pan.x -= vect.x;
+      map_pan.y -= vect.y;
+      map_pan.speed_x = -vect.x;
+      map_pan.speed_y = -vect.y;
+    }
+    break;
+  case LV_EVENT_RELEASED:
+    map_pan.dragging = false;
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief Update map in free pan mode (north up, viewport from touch instead of GPS)
+ *
+ */
+static void update_map_pan()
+{
+  uint32_t start = micros();
+  receive_prefetch_tiles();
+
+  // Inertial scrolling
+  if (!map_pan.dragging)
+  {
+    if (fabs(map_pan.speed_x) > PAN_MIN_SPEED || fabs(map_pan.speed_y) > PAN_MIN_SPEED)
+    {
+      map_pan.x += map_pan.speed_x;
+      map_pan.y += map_pan.speed_y;
+      map_pan.speed_x *= PAN_FRICTION;
+      map_pan.speed_y *= PAN_FRICTION;
+    }
+    else
+    {
+      map_pan.speed_x = 0;
+      map_pan.speed_y = 0;
+    }
+  }
+  double world = (double)tileSize * (1 << zoom);
+  map_pan.x = constrain(map_pan.x, 0, world - 1);
+  map_pan.y = constrain(map_pan.y, 0, world - 1);
+
+  double lon = worldx2lon(map_pan.x, zoom);
+  double lat = worldy2lat(map_pan.y, zoom);
+  send_prefetch_hint(lon, lat, 0, 0, zoom, false, false);
+  uint8_t pending = load_map_slots(lon, lat, start);
+
+  // GPS position arrow on screen (unrotated map)
+  int16_t arrow_x = (map_rot.width() >> 1) + (int16_t)constrain(lon2worldx(getLon(), zoom) - map_pan.x, -1000, 1000);
+  int16_t arrow_y = (map_rot.height() >> 1) + (int16_t)constrain(lat2worldy(getLat(), zoom) - map_pan.y, -1000, 1000);
+  if (arrow_x != map_pan.arrow_x || arrow_y != map_pan.arrow_y)
+  {
+    map_pan.arrow_x = arrow_x;
+    map_pan.arrow_y = arrow_y;
+    map_view_dirty = true;
+  }
+
+  MapView view;
+  uint32_t tilex = (uint32_t)map_pan.x / tileSize;
+  uint32_t tiley = (uint32_t)map_pan.y / tileSize;
+  view.pivot_x = ((tilex % MAP_SLOTS) * tileSize) + ((uint32_t)map_pan.x % tileSize);
+  view.pivot_y = ((tiley % MAP_SLOTS) * tileSize) + ((uint32_t)map_pan.y % tileSize);
+  view.heading = 0;
+  view.zoom = zoom;
+  view.speed = (uint16_t)map_fix.speed;
+  view.stale = map_fix.quality == 0;
+
+  log_map_frame_stats();
+  if (!is_map_view_changed(view))
+  {
+    map_frames_skipped++;
+    return;
+  }
+  map_view = view;
+  map_view_dirty = false;
+  map_frames_rendered++;
+  map_pan_frames++;
+  map_pan_pending += pending;
+
+  map_spr.setPivot(view.pivot_x, view.pivot_y);
+  rotate_map(&map_rot, 0);
+  uint32_t hud_start = micros();
+  draw_map_hud(map_rot, zoom, view.speed, view.stale, map_scale[zoom], 0);
+  map_hud_us += micros() - hud_start;
+  sprArrow.pushRotateZoom(&map_rot, arrow_x, arrow_y, 0, 1, 1, TFT_BLACK);
+  push_map_frame();
+
+  if (micros() - start > UPDATE_MAINSCR_PERIOD * 1000)
+    map_pan_late++;
+}
+
+/**
+ * @brief Update map following GPS position
+ *
+ */
+static void update_map_follow()
+{
+  receive_prefetch_tiles();
+  send_prefetch_hint(getLon(), getLat(), map_fix.course, map_fix.speed, zoom,
+                     zoom < MAX_ZOOM, zoom > MIN_ZOOM);
+
   CurrentMapTile = get_map_tile(getLon(), getLat(), zoom, 0, 0);
 
   if (strcmp(CurrentMapTile.file, OldMapTile.file) != 0 || CurrentMapTile.zoom != OldMapTile.zoom ||
@@ -154,67 +664,93 @@ static void update_map(lv_event_t *event)
     log_v("ZOOM: %d", zoom);
 
     // Center Tile
-    map_found = map_spr.drawPngFile(SD, CurrentMapTile.file, 256, 256);
-
-    uint8_t centerX = 0;
-    uint8_t centerY = 0;
-    int8_t startX = centerX - 1;
-    int8_t startY = centerY - 1;
-    bool tileFound = false;
+    map_found = load_map_slot(CurrentMapTile);
 
     if (map_found)
     {
-      for (int y = startY; y <= startY + 2; y++)
+      for (int y = -1; y <= 1; y++)
       {
-        for (int x = startX; x <= startX + 2; x++)
+        for (int x = -1; x <= 1; x++)
         {
-          if (x == centerX && y == centerY)
+          if (x == 0 && y == 0)
           {
             // Skip Center Tile
             continue;
           }
           RoundMapTile = get_map_tile(getLon(), getLat(), zoom, x, y);
-          tileFound = map_spr.drawPngFile(SD, RoundMapTile.file, (x - startX) * tileSize, (y - startY) * tileSize);
-          if (!tileFound)
-            map_spr.fillRect((x - startX) * tileSize, (y - startY) * tileSize, tileSize, tileSize, LVGL_BKG);
+          load_map_slot(RoundMapTile);
         }
       }
     }
 
+    log_tile_cache_stats();
+    log_prefetch_stats();
     is_map_draw = true;
+    map_view_dirty = true;
   }
 
   if (map_found)
   {
     NavArrow_position = coord_to_scr_pos(getLon(), getLat(), zoom);
-    map_spr.setPivot(tileSize + NavArrow_position.posx, tileSize + NavArrow_position.posy);
-    map_rot.pushSprite(0, 27);
 
+    MapView view;
+    view.pivot_x = ((CurrentMapTile.tilex % MAP_SLOTS) * tileSize) + NavArrow_position.posx;
+    view.pivot_y = ((CurrentMapTile.tiley % MAP_SLOTS) * tileSize) + NavArrow_position.posy;
+    view.heading = 0;
 #ifdef ENABLE_COMPASS
     heading = get_heading();
-    map_spr.pushRotated(&map_rot, 360 - heading, TFT_TRANSPARENT);
-    map_rot.fillRectAlpha(TFT_WIDTH - 48, 0, 48, 48, 95, TFT_BLACK);
-    map_rot.pushImageRotateZoom(TFT_WIDTH - 24, 24, 24, 24, 360 - heading, 1, 1, 48, 48, (uint16_t *)mini_compass, TFT_BLACK);
-#else
-    map_spr.pushRotated(&map_rot, 0, TFT_TRANSPARENT);
+    view.heading = map_view.heading;
+    if (map_view_dirty || abs(heading_diff(heading, map_view.heading)) >= MAP_HEADING_THRESHOLD)
+      view.heading = heading;
 #endif
-    map_rot.setTextColor(TFT_WHITE, TFT_WHITE);
+    view.zoom = zoom;
+    view.speed = (uint16_t)map_fix.speed;
+    view.stale = map_fix.quality == 0;
 
-    map_rot.fillRectAlpha(0, 0, 50, 32, 95, TFT_BLACK);
-    map_rot.pushImage(0, 4, 24, 24, (uint16_t *)zoom_ico, TFT_BLACK);
-    map_rot.drawNumber(zoom, 26, 8, &fonts::FreeSansBold9pt7b);
+    log_map_frame_stats();
+    if (!is_map_view_changed(view))
+    {
+      map_frames_skipped++;
+      return;
+    }
+    map_view = view;
+    map_view_dirty = false;
+    map_frames_rendered++;
 
-    map_rot.fillRectAlpha(0, 342, 70, 32, 95, TFT_BLACK);
-    map_rot.pushImage(0, 346, 24, 24, (uint16_t *)speed_ico, TFT_BLACK);
-    map_rot.drawNumber((uint16_t)GPS.speed.kmph(), 26, 350, &fonts::FreeSansBold9pt7b);
+    map_spr.setPivot(view.pivot_x, view.pivot_y);
+    rotate_map(&map_rot, 360 - view.heading);
 
-    map_rot.fillRectAlpha(250, 342, 70, TFT_WIDTH - 245, 95, TFT_BLACK);
-    map_rot.setTextSize(1);
-    map_rot.drawFastHLine(255,360,60);
-    map_rot.drawFastVLine(255,355,10);
-    map_rot.drawFastVLine(315,355,10);
-    map_rot.drawCenterString(map_scale[zoom], 285, 350);
+    uint32_t hud_start = micros();
+    draw_map_hud(map_rot, zoom, view.speed, view.stale, map_scale[zoom], view.heading);
+    map_hud_us += micros() - hud_start;
 
     sprArrow.pushRotated(&map_rot, 0, TFT_BLACK);
+    push_map_frame();
+  }
+}
+
+/**
+ * @brief Update map event
+ *
+ * @param event
+ */
+static void update_map(lv_event_t *event)
+{
+  uint32_t start = micros();
+#ifdef ENABLE_COMPASS
+  int16_t compass = heading;
+#else
+  int16_t compass = -1;
+#endif
+  if (is_gps_fix_new(map_fix_seq))
+  {
+    map_fix_seq = read_gps_fix(map_fix);
+    update_gps_filter(map_fix, compass);
   }
+  map_filtered = get_gps_filter_position(millis(), compass, map_lat, map_lon);
+  if (map_pan.active)
+    update_map_pan();
+  else
+    update_map_follow();
+  map_busy_us += micros() - start;
 }
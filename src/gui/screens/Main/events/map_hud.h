@@ -0,0 +1,160 @@
+/**
+ * @file map_hud.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Map screen HUD overlay layers
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+/**
+ * @brief HUD layer: small overlay sprite redrawn only when its value changes.
+ *        HUD_SHADE pixels darken the map below (translucent box), other pixels are copied
+ *
+ */
+#define HUD_SHADE TFT_BLACK
+#define HUD_STALE 0x10000 // speed layer value without fix (out of speed range)
+struct HudLayer
+{
+  TFT_eSprite *spr;
+  int16_t x;
+  int16_t y;
+  int32_t value;
+};
+
+TFT_eSprite hud_zoom_spr = TFT_eSprite(&tft);
+TFT_eSprite hud_speed_spr = TFT_eSprite(&tft);
+TFT_eSprite hud_scale_spr = TFT_eSprite(&tft);
+HudLayer hud_zoom = {&hud_zoom_spr, 0, 0, -1};
+HudLayer hud_speed = {&hud_speed_spr, 0, 342, -1};
+HudLayer hud_scale = {&hud_scale_spr, 250, 342, -1};
+#ifdef ENABLE_COMPASS
+TFT_eSprite hud_compass_spr = TFT_eSprite(&tft);
+HudLayer hud_compass = {&hud_compass_spr, TFT_WIDTH - 48, 0, -1};
+#endif
+
+/**
+ * @brief HUD layer redraws counter
+ *
+ */
+uint32_t hud_redraws = 0;
+
+/**
+ * @brief Create HUD layer sprites in PSRAM arena (layers are redrawn on next update)
+ *
+ */
+void create_map_hud()
+{
+  arena_sprite(hud_zoom_spr, ARENA_MAP_SCR, 50, 32);
+  hud_zoom.value = -1;
+  arena_sprite(hud_speed_spr, ARENA_MAP_SCR, 70, 32);
+  hud_speed.value = -1;
+  arena_sprite(hud_scale_spr, ARENA_MAP_SCR, 70, 32);
+  hud_scale.value = -1;
+#ifdef ENABLE_COMPASS
+  arena_sprite(hud_compass_spr, ARENA_MAP_SCR, 48, 48);
+  hud_compass.value = -1;
+#endif
+}
+
+/**
+ * @brief Check HUD layer value and clear layer if it has to be redrawn
+ *
+ * @param layer -> HUD layer
+ * @param value -> new value
+ * @return true if layer has to be redrawn
+ */
+static bool hud_layer_changed(HudLayer &layer, int32_t value)
+{
+  if (layer.value == value)
+    return false;
+  layer.value = value;
+  layer.spr->fillSprite(HUD_SHADE);
+  layer.spr->setTextColor(TFT_WHITE, TFT_WHITE);
+  hud_redraws++;
+  return true;
+}
+
+/**
+ * @brief Darken RGB565 pixel to 5/8 (sprite memory layout, byte swapped)
+ *
+ * @param pixel -> pixel
+ * @return uint16_t -> darkened pixel
+ */
+static inline uint16_t hud_darken(uint16_t pixel)
+{
+  uint16_t color = (pixel >> 8) | (pixel << 8);
+  color = ((color >> 1) & 0x7BEF) + ((color >> 3) & 0x18E3);
+  return (color >> 8) | (color << 8);
+}
+
+/**
+ * @brief Blend HUD layer onto destination sprite
+ *
+ * @param layer -> HUD layer
+ * @param dst -> destination sprite
+ */
+static void blit_hud_layer(const HudLayer &layer, TFT_eSprite &dst)
+{
+  const int16_t src_w = layer.spr->width();
+  const int16_t w = min(src_w, (int16_t)(dst.width() - layer.x));
+  const int16_t h = min((int16_t)layer.spr->height(), (int16_t)(dst.height() - layer.y));
+  const uint16_t *src = (uint16_t *)layer.spr->getBuffer();
+  uint16_t *out = (uint16_t *)dst.getBuffer() + (layer.y * dst.width()) + layer.x;
+
+  for (int16_t y = 0; y < h; y++)
+  {
+    for (int16_t x = 0; x < w; x++)
+    {
+      uint16_t color = src[x];
+      out[x] = (color == HUD_SHADE) ? hud_darken(out[x]) : color;
+    }
+    src += src_w;
+    out += dst.width();
+  }
+}
+
+/**
+ * @brief Redraw changed HUD layers and blend them onto map
+ *
+ * @param dst -> destination sprite
+ * @param zoom_level -> zoom level
+ * @param speed -> speed (km/h)
+ * @param stale -> no fix yet (position is cached or default), speed shown as "--"
+ * @param scale -> map scale text
+ * @param heading -> map heading (degrees)
+ */
+void draw_map_hud(TFT_eSprite &dst, uint8_t zoom_level, uint16_t speed, bool stale, const char *scale, int16_t heading)
+{
+  if (hud_layer_changed(hud_zoom, zoom_level))
+  {
+    hud_zoom_spr.pushImage(0, 4, 24, 24, (uint16_t *)zoom_ico, TFT_BLACK);
+    hud_zoom_spr.drawNumber(zoom_level, 26, 8, &fonts::FreeSansBold9pt7b);
+  }
+  blit_hud_layer(hud_zoom, dst);
+
+  if (hud_layer_changed(hud_speed, stale ? HUD_STALE : speed))
+  {
+    hud_speed_spr.pushImage(0, 4, 24, 24, (uint16_t *)speed_ico, TFT_BLACK);
+    if (stale)
+      hud_speed_spr.drawString("--", 26, 8, &fonts::FreeSansBold9pt7b);
+    else
+      hud_speed_spr.drawNumber(speed, 26, 8, &fonts::FreeSansBold9pt7b);
+  }
+  blit_hud_layer(hud_speed, dst);
+
+  if (hud_layer_changed(hud_scale, zoom_level))
+  {
+    hud_scale_spr.setTextSize(1);
+    hud_scale_spr.drawFastHLine(5, 18, 60, TFT_WHITE);
+    hud_scale_spr.drawFastVLine(5, 13, 10, TFT_WHITE);
+    hud_scale_spr.drawFastVLine(65, 13, 10, TFT_WHITE);
+    hud_scale_spr.drawCenterString(scale, 35, 8);
+  }
+  blit_hud_layer(hud_scale, dst);
+
+#ifdef ENABLE_COMPASS
+  if (hud_layer_changed(hud_compass, heading))
+    hud_compass_spr.pushImageRotateZoom(24, 24, 24, 24, 360 - heading, 1, 1, 48, 48, (uint16_t *)mini_compass, TFT_BLACK);
+  blit_hud_layer(hud_compass, dst);
+#endif
+}
@@ -7,26 +7,24 @@
  */
 
 /**
- * @brief GNSS Selection Checkbox event
+ * @brief GNSS Selection Checkbox event (show or hide satellites of a system)
  *
  * @param event
  */
 static void active_gnss_event(lv_event_t *event)
 {
-    uint32_t *active_id = (uint32_t *)lv_event_get_user_data(event);
+    static const uint8_t gnss_system[] = {NMEA_GPS, NMEA_GLONASS, NMEA_BEIDOU};
     lv_obj_t *cont = lv_event_get_current_target(event);
     lv_obj_t *act_cb = lv_event_get_target(event);
-    lv_obj_t *old_cb = lv_obj_get_child(cont, *active_id);
 
     if (act_cb == cont)
         return;
 
-    lv_obj_clear_state(old_cb, LV_STATE_CHECKED);
-    lv_obj_add_state(act_cb, LV_STATE_CHECKED);
-
-    clear_sat_in_view();
-
-    *active_id = lv_obj_get_index(act_cb);
+    uint8_t mask = 1 << gnss_system[lv_obj_get_index(act_cb)];
+    if (lv_obj_has_state(act_cb, LV_STATE_CHECKED))
+        set_sat_system_mask(sat_system_mask | mask);
+    else
+        set_sat_system_mask(sat_system_mask & ~mask);
 }
 
 /**
@@ -36,34 +34,21 @@ static void active_gnss_event(lv_event_t *event)
  */
 static void update_sattrack(lv_event_t *event)
 {
-    if (pdop.isUpdated() || hdop.isUpdated() || vdop.isUpdated())
+    static uint32_t fix_seq = 0;
+    if (is_gps_fix_new(fix_seq))
     {
-        lv_label_set_text_fmt(pdop_label, "PDOP:\n%s", pdop.value());
-        lv_label_set_text_fmt(hdop_label, "HDOP:\n%s", hdop.value());
-        lv_label_set_text_fmt(vdop_label, "VDOP:\n%s", vdop.value());
+        GpsFix fix;
+        fix_seq = read_gps_fix(fix);
+        lv_label_set_text_fmt(pdop_label, "PDOP:\n%d.%02d", fix.pdop / 100, fix.pdop % 100);
+        lv_label_set_text_fmt(hdop_label, "HDOP:\n%d.%02d", fix.hdop / 100, fix.hdop % 100);
+        lv_label_set_text_fmt(vdop_label, "VDOP:\n%d.%02d", fix.vdop / 100, fix.vdop % 100);
+        lv_label_set_text_fmt(alt_label, "ALT:\n%4dm.", (int)fix.altitude);
     }
 
-    if (GPS.altitude.isUpdated())
-        lv_label_set_text_fmt(alt_label, "ALT:\n%4dm.", (int)GPS.altitude.meters());
-
-    create_sat_spr(spr_Sat);
-    create_const_spr(constel_spr);
-    create_const_spr(constel_spr_bkg);
+    if (!sky_plot.ready)
+        reset_sky_plot();
+    if (sky_plot.full_push)
+        push_sky_plot();
 
-#ifdef MULTI_GNSS
-    switch ((int)active_gnss)
-    {
-    case 0:
-        fill_sat_in_view(GPS_GSV, TFT_GREEN);
-        break;
-    case 1:
-        fill_sat_in_view(GL_GSV, TFT_BLUE);
-        break;
-    case 2:
-        fill_sat_in_view(BD_GSV, TFT_RED);
-        break;
-    }
-#else
-    fill_sat_in_view(GPS_GSV, TFT_GREEN);
-#endif
+    update_sat_in_view();
 }
\ No newline at end of file
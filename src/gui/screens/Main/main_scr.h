@@ -33,9 +33,6 @@ static lv_obj_t *pdop_label;
 static lv_obj_t *hdop_label;
 static lv_obj_t *vdop_label;
 static lv_obj_t *alt_label;
-static lv_style_t style_radio;
-static lv_style_t style_radio_chk;
-static uint32_t active_gnss = 0;
 
 /**
  * @brief Main screen events include
@@ -43,6 +40,7 @@ static uint32_t active_gnss = 0;
  */
 #include "gui/screens/Main/events/main_scr.h"
 #include "gui/screens/Main/events/compass.h"
+#include "gui/screens/Main/events/map_hud.h"
 #include "gui/screens/Main/events/map.h"
 #include "gui/screens/Main/events/sattrack.h"
 
@@ -52,6 +50,7 @@ static uint32_t active_gnss = 0;
  */
 void create_main_scr()
 {
+    main_fix_seq = read_gps_fix(main_fix);
     mainScreen = lv_obj_create(NULL);
 
     // Main Screen Tiles
@@ -108,13 +107,13 @@ void create_main_scr()
     latitude = lv_label_create(compass_tile);
     lv_obj_set_size(latitude, 200, 20);
     lv_obj_set_style_text_font(latitude, &lv_font_montserrat_16, 0);
-    lv_label_set_text_static(latitude, Latitude_formatString(GPS.location.lat()));
+    lv_label_set_text_static(latitude, Latitude_formatString(main_fix.lat));
     lv_obj_set_pos(latitude, 55, 12);
 
     longitude = lv_label_create(compass_tile);
     lv_obj_set_size(longitude, 200, 20);
     lv_obj_set_style_text_font(longitude, &lv_font_montserrat_16, 0);
-    lv_label_set_text_static(longitude, Longitude_formatString(GPS.location.lng()));
+    lv_label_set_text_static(longitude, Longitude_formatString(main_fix.lon));
     lv_obj_set_pos(longitude, 55, 28);
 
     altitude = lv_label_create(compass_tile);
@@ -133,30 +132,34 @@ void create_main_scr()
     // Map Tile Events
     lv_obj_add_event_cb(map_tile, update_map, LV_EVENT_REFRESH, NULL);
     lv_obj_add_event_cb(mainScreen, get_zoom_value, LV_EVENT_GESTURE, NULL);
+    lv_obj_add_event_cb(map_tile, map_pan_event, LV_EVENT_PRESSED, NULL);
+    lv_obj_add_event_cb(map_tile, map_pan_event, LV_EVENT_PRESSING, NULL);
+    lv_obj_add_event_cb(map_tile, map_pan_event, LV_EVENT_RELEASED, NULL);
+    lv_obj_add_event_cb(map_tile, map_pan_event, LV_EVENT_LONG_PRESSED, NULL);
 
     // Satellite Tracking Tile
     pdop_label = lv_label_create(sat_track_tile);
     lv_obj_set_size(pdop_label, 55, 40);
     lv_obj_set_style_text_font(pdop_label, &lv_font_montserrat_14, 0);
-    lv_label_set_text_fmt(pdop_label, "PDOP:\n%s", pdop.value());
+    lv_label_set_text_fmt(pdop_label, "PDOP:\n%d.%02d", main_fix.pdop / 100, main_fix.pdop % 100);
     lv_obj_set_pos(pdop_label, 5, 15);
 
     hdop_label = lv_label_create(sat_track_tile);
     lv_obj_set_size(hdop_label, 55, 40);
     lv_obj_set_style_text_font(hdop_label, &lv_font_montserrat_14, 0);
-    lv_label_set_text_fmt(hdop_label, "HDOP:\n%s", hdop.value());
+    lv_label_set_text_fmt(hdop_label, "HDOP:\n%d.%02d", main_fix.hdop / 100, main_fix.hdop % 100);
     lv_obj_set_pos(hdop_label, 5, 50);
 
     vdop_label = lv_label_create(sat_track_tile);
     lv_obj_set_size(vdop_label, 55, 40);
     lv_obj_set_style_text_font(vdop_label, &lv_font_montserrat_14, 0);
-    lv_label_set_text_fmt(vdop_label, "VDOP:\n%s", vdop.value());
+    lv_label_set_text_fmt(vdop_label, "VDOP:\n%d.%02d", main_fix.vdop / 100, main_fix.vdop % 100);
     lv_obj_set_pos(vdop_label, 5, 85);
 
     alt_label = lv_label_create(sat_track_tile);
     lv_obj_set_size(alt_label, 55, 80);
     lv_obj_set_style_text_font(alt_label, &lv_font_montserrat_14, 0);
-    lv_label_set_text_fmt(alt_label, "ALT:\n%4dm.", (int)GPS.altitude.meters());
+    lv_label_set_text_fmt(alt_label, "ALT:\n%4dm.", (int)main_fix.altitude);
     lv_obj_set_pos(alt_label, 5, 120);
 
     satbar_1 = lv_chart_create(sat_track_tile);
@@ -178,12 +181,6 @@ void create_main_scr()
     lv_obj_set_pos(satbar_2, 0, 260);
 
 #ifdef MULTI_GNSS
-    lv_style_init(&style_radio);
-    lv_style_set_radius(&style_radio, LV_RADIUS_CIRCLE);
-
-    lv_style_init(&style_radio_chk);
-    lv_style_set_bg_img_src(&style_radio_chk, NULL);
-
     lv_obj_t *gnss_sel = lv_obj_create(sat_track_tile);
     lv_obj_set_flex_flow(gnss_sel, LV_FLEX_FLOW_ROW);
     lv_obj_set_size(gnss_sel, TFT_WIDTH, 50);
@@ -197,25 +194,20 @@ void create_main_scr()
     lv_obj_t *gps = lv_checkbox_create(gnss_sel);
     lv_checkbox_set_text_static(gps, "GPS     ");
     lv_obj_add_flag(gps, LV_OBJ_FLAG_EVENT_BUBBLE);
-    lv_obj_add_style(gps, &style_radio, LV_PART_INDICATOR);
-    lv_obj_add_style(gps, &style_radio_chk, LV_PART_INDICATOR | LV_STATE_CHECKED);
+    lv_obj_add_state(gps, LV_STATE_CHECKED);
 
     lv_obj_t *glonass = lv_checkbox_create(gnss_sel);
     lv_checkbox_set_text_static(glonass, "GLONASS  ");
     lv_obj_add_flag(glonass, LV_OBJ_FLAG_EVENT_BUBBLE);
-    lv_obj_add_style(glonass, &style_radio, LV_PART_INDICATOR);
-    lv_obj_add_style(glonass, &style_radio_chk, LV_PART_INDICATOR | LV_STATE_CHECKED);
+    lv_obj_add_state(glonass, LV_STATE_CHECKED);
 
     lv_obj_t *beidou = lv_checkbox_create(gnss_sel);
     lv_checkbox_set_text_static(beidou, "BEIDOU");
     lv_obj_add_flag(beidou, LV_OBJ_FLAG_EVENT_BUBBLE);
-    lv_obj_add_style(beidou, &style_radio, LV_PART_INDICATOR);
-    lv_obj_add_style(beidou, &style_radio_chk, LV_PART_INDICATOR | LV_STATE_CHECKED);
-
-    lv_obj_add_state(lv_obj_get_child(gnss_sel, 0), LV_STATE_CHECKED);
+    lv_obj_add_state(beidou, LV_STATE_CHECKED);
 
     // GNSS Selection Event
-    lv_obj_add_event_cb(gnss_sel, active_gnss_event, LV_EVENT_CLICKED, &active_gnss);
+    lv_obj_add_event_cb(gnss_sel, active_gnss_event, LV_EVENT_VALUE_CHANGED, NULL);
 #endif
 
     // Satellite Tracking Event
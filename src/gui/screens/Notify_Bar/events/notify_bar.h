@@ -12,6 +12,12 @@
  */
 #define UPDATE_NOTIFY_PERIOD 1000
 
+/**
+ * @brief GPS fix shown in notify bar (read once per update)
+ *
+ */
+GpsFix notify_fix = {};
+
 /**
  * @brief Battery update event
  *
@@ -39,9 +45,9 @@ static void update_batt(lv_event_t *event)
 static void update_fix_mode(lv_event_t *event)
 {
     lv_obj_t *mode = lv_event_get_target(event);
-    if (fix_mode.isValid() && fix_old != atoi(fix_mode.value()))
+    if (notify_fix.fix_mode != 0 && fix_old != notify_fix.fix_mode)
     {
-        switch (atoi(fix_mode.value()))
+        switch (notify_fix.fix_mode)
         {
         case 1:
             lv_label_set_text_static(mode, "--");
@@ -56,7 +62,7 @@ static void update_fix_mode(lv_event_t *event)
             lv_label_set_text_static(mode, "--");
             break;
         }
-        fix_old = atoi(fix_mode.value());
+        fix_old = notify_fix.fix_mode;
     }
 }
 
@@ -81,8 +87,8 @@ static void update_time(lv_event_t *event)
 static void update_gps_count(lv_event_t *event)
 {
     lv_obj_t *gps_num = lv_event_get_target(event);
-    if (GPS.satellites.isValid())
-        lv_label_set_text_fmt(gps_num, LV_SYMBOL_GPS "%2d", GPS.satellites.value());
+    if (notify_fix.valid & NMEA_SATELLITES)
+        lv_label_set_text_fmt(gps_num, LV_SYMBOL_GPS "%2d", notify_fix.satellites);
     else
         lv_label_set_text_fmt(gps_num, LV_SYMBOL_GPS "%2d", 0);
 }
@@ -93,11 +99,12 @@ static void update_gps_count(lv_event_t *event)
  */
 void update_notify_bar(lv_timer_t *t)
 {
+    read_gps_fix(notify_fix);
     lv_event_send(gps_time, LV_EVENT_VALUE_CHANGED, NULL);
     lv_event_send(gps_count, LV_EVENT_VALUE_CHANGED, NULL);
     lv_event_send(gps_fix_mode, LV_EVENT_VALUE_CHANGED, NULL);
 
-    switch (atoi(fix.value()))
+    switch (notify_fix.quality)
     {
     case 0:
         lv_led_off(gps_fix);
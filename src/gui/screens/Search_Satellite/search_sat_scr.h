@@ -40,24 +40,24 @@ void create_search_sat_scr()
 }
 
 /**
- * @brief Search valid GPS signal
+ * @brief Search valid GPS signal (timer runs until first fix, main screen is loaded if search screen is shown)
  *
  */
 void search_gps(lv_timer_t *t)
 {
-    if (GPS.location.isValid())
+    GpsFix fix;
+    read_gps_fix(fix);
+    if (fix.valid & NMEA_LOCATION)
     {
         is_gps_fixed = true;
-        setTime(GPS.time.hour(), GPS.time.minute(), GPS.time.second(), GPS.date.day(), GPS.date.month(), GPS.date.year());
+        setTime(fix.hour, fix.minute, fix.second, fix.day, fix.month, fix.year);
         // UTC Time
         utc = now();
         // Local Time
         local = CE.toLocal(utc);
 
-        millis_actual = millis();
-        while (millis() < millis_actual + 2000)
-            ;
         lv_timer_del(t);
-        load_main_screen();
+        if (lv_scr_act() == searchSat)
+            load_main_screen();
     }
 }
@@ -0,0 +1,381 @@
+/**
+ * @file casic.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  CASIC binary protocol (AT6558D): streaming frame parser, frame builder and navigation
+ *         and satellite messages decoding into NMEA data structs (see nmea.h)
+ * @version 0.1.6
+ * @date 2023-06-14
+ *
+ * Frame: 0xBA 0xCE, payload length (U2), class (U1), ID (U1), payload (multiple of 4 bytes),
+ *        checksum (U4) = (ID << 24) + (class << 16) + length + sum of payload U4 words. Little endian
+ */
+
+#define CASIC_SYNC1 0xBA
+#define CASIC_SYNC2 0xCE
+#define CASIC_HEADER 6
+#define CASIC_OVERHEAD 10
+#define CASIC_MAX_PAYLOAD 512
+
+/**
+ * @brief Message classes and IDs
+ *
+ */
+#define CASIC_NAV 0x01
+#define CASIC_ACK 0x05
+#define CASIC_CFG 0x06
+#define CASIC_AID 0x0B
+#define CASIC_NAV_DOP 0x01
+#define CASIC_NAV_PV 0x03
+#define CASIC_NAV_TIMEUTC 0x10
+#define CASIC_NAV_GPSINFO 0x20
+#define CASIC_NAV_BDSINFO 0x21
+#define CASIC_NAV_GLNINFO 0x22
+#define CASIC_ACK_NAK 0x00
+#define CASIC_ACK_ACK 0x01
+#define CASIC_CFG_PRT 0x00
+#define CASIC_CFG_MSG 0x01
+#define CASIC_CFG_RATE 0x04
+#define CASIC_AID_INI 0x01
+
+/**
+ * @brief CFG-PRT protocol mask and UART mode (8N1)
+ *
+ */
+#define CASIC_PROTO_BIN_IN 0x01
+#define CASIC_PROTO_TXT_IN 0x02
+#define CASIC_PROTO_BIN_OUT 0x10
+#define CASIC_PROTO_TXT_OUT 0x20
+#define CASIC_PRT_8N1 0x08C0
+#define CASIC_PRT_CURRENT 0xFF
+
+/**
+ * @brief AID-INI (aiding position and time) payload size, field offsets and flags. Time fields (tow, wn, tAcc)
+ *        are used only with CASIC_AID_TIME_VALID
+ *
+ */
+#define CASIC_AID_INI_SIZE 56
+#define CASIC_AID_INI_LAT 0
+#define CASIC_AID_INI_LON 8
+#define CASIC_AID_INI_ALT 16
+#define CASIC_AID_INI_TOW 24
+#define CASIC_AID_INI_PACC 36
+#define CASIC_AID_INI_TACC 40
+#define CASIC_AID_INI_WN 52
+#define CASIC_AID_INI_FLAGS 55
+#define CASIC_AID_POS_VALID 0x01
+#define CASIC_AID_TIME_VALID 0x02
+#define CASIC_AID_LLA 0x20
+
+/**
+ * @brief NAV-PV position / velocity valid (fix type) and satellite info flags
+ *
+ */
+#define CASIC_FIX_2D 6
+#define CASIC_FIX_3D 7
+#define CASIC_SV_USED 0x01
+#define CASIC_SV_SIZE 12
+
+/**
+ * @brief Parser state
+ *
+ */
+enum CasicState
+{
+  CASIC_WAIT_SYNC1,
+  CASIC_WAIT_SYNC2,
+  CASIC_HEADER_BYTES,
+  CASIC_PAYLOAD,
+  CASIC_CHECKSUM,
+};
+
+struct CasicParser
+{
+  uint8_t state;
+  uint8_t header[4];
+  uint16_t len;
+  uint16_t pos;
+  uint8_t checksum[4];
+  uint32_t payload[CASIC_MAX_PAYLOAD / 4];
+};
+CasicParser casic = {};
+
+/**
+ * @brief Parser counters and last acknowledged message (class << 8 | ID)
+ *
+ */
+uint32_t casic_frames = 0;
+uint32_t casic_checksum_errors = 0;
+uint32_t casic_unknown = 0;
+uint16_t casic_last_ack = 0;
+uint16_t casic_last_nak = 0;
+
+/**
+ * @brief Little endian payload fields
+ *
+ */
+static inline uint16_t casic_u16(const uint8_t *p) { uint16_t v; memcpy(&v, p, 2); return v; }
+static inline uint32_t casic_u32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline float casic_float(const uint8_t *p) { float v; memcpy(&v, p, 4); return v; }
+static inline double casic_double(const uint8_t *p) { double v; memcpy(&v, p, 8); return v; }
+
+/**
+ * @brief Frame checksum
+ *
+ * @param cls -> message class
+ * @param id -> message ID
+ * @param payload -> payload
+ * @param len -> payload length (multiple of 4)
+ * @return uint32_t -> checksum
+ */
+uint32_t casic_checksum(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len)
+{
+  uint32_t checksum = ((uint32_t)id << 24) + ((uint32_t)cls << 16) + len;
+  for (int i = 0; i + 4 <= len; i += 4)
+    checksum += casic_u32(payload + i);
+  return checksum;
+}
+
+/**
+ * @brief Build frame
+ *
+ * @param frame -> frame buffer (len + CASIC_OVERHEAD bytes)
+ * @param cls -> message class
+ * @param id -> message ID
+ * @param payload -> payload
+ * @param len -> payload length (multiple of 4)
+ * @return uint16_t -> frame length
+ */
+uint16_t build_casic_frame(uint8_t *frame, uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len)
+{
+  uint32_t checksum = casic_checksum(cls, id, payload, len);
+  frame[0] = CASIC_SYNC1;
+  frame[1] = CASIC_SYNC2;
+  memcpy(frame + 2, &len, 2);
+  frame[4] = cls;
+  frame[5] = id;
+  memcpy(frame + CASIC_HEADER, payload, len);
+  memcpy(frame + CASIC_HEADER + len, &checksum, 4);
+  return len + CASIC_OVERHEAD;
+}
+
+/**
+ * @brief Decode NAV-PV (position, velocity, fix type, PDOP)
+ *
+ *        runTime U4 (0), posValid U1 (4), velValid U1 (5), system U1 (6), numSV U1 (7),
+ *        numSVGPS/BDS/GLN U1 (8..10), reserved (11), pDop R4 (12), lon R8 (16), lat R8 (24),
+ *        height R4 (32), sepGeoid R4 (36), hAcc, vAcc, velN, velE, velU, speed3D R4 (40..60),
+ *        speed2D R4 (64), heading R4 (68), sAcc, cAcc R4 (72, 76)
+ */
+static uint16_t decode_casic_pv(const uint8_t *p, uint16_t len)
+{
+  if (len < 80)
+    return 0;
+  uint8_t pos_valid = p[4];
+  uint8_t vel_valid = p[5];
+  uint16_t updated = NMEA_SATELLITES | NMEA_FIX | NMEA_DOP;
+
+  nmea_fix.satellites = p[7];
+  nmea_fix.quality = pos_valid >= CASIC_FIX_2D ? 1 : 0;
+  nmea_gsa.fix_mode = pos_valid >= CASIC_FIX_3D ? 3 : (pos_valid == CASIC_FIX_2D ? 2 : 1);
+  nmea_gsa.pdop = casic_float(p + 12) * 100;
+  if (pos_valid >= CASIC_FIX_2D)
+  {
+    nmea_fix.lon = casic_double(p + 16);
+    nmea_fix.lat = casic_double(p + 24);
+    nmea_fix.altitude = casic_float(p + 32) - casic_float(p + 36);
+    updated |= NMEA_LOCATION | NMEA_ALTITUDE;
+  }
+  if (vel_valid >= CASIC_FIX_2D)
+  {
+    nmea_fix.speed = casic_float(p + 64) * 3.6;
+    nmea_fix.course = casic_float(p + 68);
+    updated |= NMEA_SPEED | NMEA_COURSE;
+  }
+  return updated;
+}
+
+/**
+ * @brief Decode NAV-DOP
+ *
+ */
+static uint16_t decode_casic_dop(const uint8_t *p, uint16_t len)
+{
+  if (len < 28)
+    return 0;
+  nmea_gsa.pdop = casic_float(p + 4) * 100;
+  nmea_gsa.hdop = casic_float(p + 8) * 100;
+  nmea_gsa.vdop = casic_float(p + 12) * 100;
+  nmea_fix.hdop = nmea_gsa.hdop;
+  return NMEA_DOP;
+}
+
+/**
+ * @brief Decode NAV-TIMEUTC
+ *
+ */
+static uint16_t decode_casic_time(const uint8_t *p, uint16_t len)
+{
+  if (len < 24)
+    return 0;
+  uint16_t updated = 0;
+  if (p[21] != 0)
+  {
+    nmea_fix.hour = p[18];
+    nmea_fix.minute = p[19];
+    nmea_fix.second = p[20];
+    nmea_fix.centisecond = casic_u16(p + 12) / 10;
+    updated |= NMEA_TIME;
+  }
+  if (p[23] != 0)
+  {
+    nmea_fix.year = casic_u16(p + 14);
+    nmea_fix.month = p[16];
+    nmea_fix.day = p[17];
+    updated |= NMEA_DATE;
+  }
+  return updated;
+}
+
+/**
+ * @brief Decode NAV-GPSINFO / BDSINFO / GLNINFO (satellites in view and used in fix of a system)
+ *
+ */
+static uint16_t decode_casic_sats(uint8_t system, const uint8_t *p, uint16_t len)
+{
+  if (len < 8)
+    return 0;
+  NmeaGsv &gsv = nmea_gsv[system];
+  uint8_t used = 0;
+  gsv.count = 0;
+  for (int i = 8; i + CASIC_SV_SIZE <= len && gsv.count < NMEA_GSV_SATS; i += CASIC_SV_SIZE)
+  {
+    const uint8_t *sv = p + i;
+    NmeaSat &sat = gsv.sats[gsv.count++];
+    sat.prn = (system == NMEA_GLONASS && sv[1] <= 32) ? sv[1] + 64 : sv[1];
+    sat.snr = sv[4];
+    sat.elev = max((int8_t)sv[5], (int8_t)0);
+    sat.azim = casic_u16(sv + 6);
+    if ((sv[2] & CASIC_SV_USED) && used < NMEA_GSA_SATS)
+      nmea_gsa.used[system][used++] = sat.prn;
+  }
+  nmea_gsa.used_count[system] = used;
+  gsv.in_view = p[4];
+  gsv.updated = true;
+  return 0;
+}
+
+/**
+ * @brief Decode received frame
+ *
+ */
+static void decode_casic_frame()
+{
+  uint8_t cls = casic.header[2];
+  uint8_t id = casic.header[3];
+  const uint8_t *p = (const uint8_t *)casic.payload;
+  uint16_t updated = 0;
+
+  if (cls == CASIC_NAV)
+  {
+    switch (id)
+    {
+    case CASIC_NAV_PV:
+      updated = decode_casic_pv(p, casic.len);
+      break;
+    case CASIC_NAV_DOP:
+      updated = decode_casic_dop(p, casic.len);
+      break;
+    case CASIC_NAV_TIMEUTC:
+      updated = decode_casic_time(p, casic.len);
+      break;
+    case CASIC_NAV_GPSINFO:
+      updated = decode_casic_sats(NMEA_GPS, p, casic.len);
+      break;
+    case CASIC_NAV_BDSINFO:
+      updated = decode_casic_sats(NMEA_BEIDOU, p, casic.len);
+      break;
+    case CASIC_NAV_GLNINFO:
+      updated = decode_casic_sats(NMEA_GLONASS, p, casic.len);
+      break;
+    default:
+      casic_unknown++;
+      break;
+    }
+  }
+  else if (cls == CASIC_ACK && casic.len >= 2)
+  {
+    uint16_t msg = (p[0] << 8) | p[1];
+    if (id == CASIC_ACK_ACK)
+      casic_last_ack = msg;
+    else
+      casic_last_nak = msg;
+  }
+  else
+    casic_unknown++;
+
+  nmea_fix.valid |= updated;
+  nmea_updated |= updated;
+
+  // NAV-PV ends epoch (DOP, time and satellites of an epoch may follow it, they are published with next one)
+  if (cls == CASIC_NAV && id == CASIC_NAV_PV && on_nmea_epoch != NULL)
+    on_nmea_epoch();
+}
+
+/**
+ * @brief Process received byte
+ *
+ * @param c -> byte
+ * @return true if a frame was decoded
+ */
+bool encode_casic(uint8_t c)
+{
+  switch (casic.state)
+  {
+  case CASIC_WAIT_SYNC1:
+    if (c == CASIC_SYNC1)
+      casic.state = CASIC_WAIT_SYNC2;
+    return false;
+
+  case CASIC_WAIT_SYNC2:
+    casic.state = c == CASIC_SYNC2 ? CASIC_HEADER_BYTES : (c == CASIC_SYNC1 ? CASIC_WAIT_SYNC2 : CASIC_WAIT_SYNC1);
+    casic.pos = 0;
+    return false;
+
+  case CASIC_HEADER_BYTES:
+    casic.header[casic.pos++] = c;
+    if (casic.pos == 4)
+    {
+      casic.len = casic_u16(casic.header);
+      casic.pos = 0;
+      if (casic.len > CASIC_MAX_PAYLOAD || (casic.len & 3) != 0)
+        casic.state = CASIC_WAIT_SYNC1;
+      else
+        casic.state = casic.len > 0 ? CASIC_PAYLOAD : CASIC_CHECKSUM;
+    }
+    return false;
+
+  case CASIC_PAYLOAD:
+    ((uint8_t *)casic.payload)[casic.pos++] = c;
+    if (casic.pos == casic.len)
+    {
+      casic.pos = 0;
+      casic.state = CASIC_CHECKSUM;
+    }
+    return false;
+
+  case CASIC_CHECKSUM:
+    casic.checksum[casic.pos++] = c;
+    if (casic.pos < 4)
+      return false;
+    casic.state = CASIC_WAIT_SYNC1;
+    if (casic_u32(casic.checksum) != casic_checksum(casic.header[2], casic.header[3], (const uint8_t *)casic.payload, casic.len))
+    {
+      casic_checksum_errors++;
+      return false;
+    }
+    casic_frames++;
+    decode_casic_frame();
+    return true;
+  }
+  return false;
+}
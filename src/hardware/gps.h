@@ -7,90 +7,202 @@
  */
 
 #include <TimeLib.h>
-#include <TinyGPS++.h>
 
-#define MAX_SATELLITES 120
+#define MAX_SATELLITES 64    // Satellite table slots (all systems)
+#define SAT_MAX_AGE 5000     // Satellite not seen in GSV for this time (ms) is removed
 #define MAX_SATELLLITES_IN_VIEW 32
 HardwareSerial *gps = &Serial2;
-TinyGPSPlus GPS;
 bool is_gps_fixed = false;
 uint8_t fix_old = 0;
 
 /**
- * @brief Common Structure for satellites in view NMEA sentence
+ * @brief Satellite seen in GSV sentences, keyed by system and PRN
  *
  */
-struct GSV
+struct SatInfo
 {
-  TinyGPSCustom totalMsg;
-  TinyGPSCustom msgNum;
-  TinyGPSCustom satsInView;
-  TinyGPSCustom satNum[4];
-  TinyGPSCustom elev[4];
-  TinyGPSCustom azim[4];
-  TinyGPSCustom snr[4];
+  uint8_t system;  // NmeaSystem
+  uint8_t prn;     // 0 -> free slot
+  uint8_t elev;
+  uint16_t azim;
+  uint8_t snr;
+  bool used;       // used in fix (GSA)
+  uint32_t seen;   // last GSV epoch with satellite (millis)
+  uint16_t pos_x;  // sky plot position (set by UI)
+  uint16_t pos_y;
 };
 
 /**
- * @brief Custom NMEA sentences
+ * @brief Satellite table of all systems. Slots are stable while satellite is seen (free slots have prn 0),
+ *        count is last used slot + 1, so table is iterated up to count. Version changes on every update
  *
  */
-#ifdef MULTI_GNSS
-
-// DOP and fix mode
-TinyGPSCustom pdop(GPS, PSTR("GNGSA"), 15); // $GNGSA sentence, 15th element
-TinyGPSCustom hdop(GPS, PSTR("GNGSA"), 16); // $GNGSA sentence, 16th element
-TinyGPSCustom vdop(GPS, PSTR("GNGSA"), 17); // $GNGSA sentence, 17th element
-TinyGPSCustom fix(GPS, PSTR("GNGGA"), 6);
-TinyGPSCustom fix_mode(GPS, PSTR("GNGSA"), 2);
-
-// GPS Satellites in view
-GSV GPS_GSV;
+struct SatTable
+{
+  uint8_t count;
+  uint32_t version;
+  SatInfo sat[MAX_SATELLITES];
+};
+SatTable sat_table = {};
 
-// GLONASS Satellites in view
-GSV GL_GSV;
+/**
+ * @brief GPS protocol: CASIC binary (AT6558D, build time only, -D GPS_CASIC=1) or NMEA.
+ *        CASIC mode runs at GPS_CASIC_BAUDRATE and GPS_RATE Hz, falls back to NMEA if receiver doesn't answer
+ *
+ */
+#ifndef GPS_CASIC_BAUDRATE
+#define GPS_CASIC_BAUDRATE 115200
+#endif
+#ifndef GPS_RATE
+#define GPS_RATE 1
+#endif
+#define GPS_PROBE_TIME 1100 // ms, receiver sends at least one epoch
+#ifdef GPS_CASIC
+bool gps_casic = true;
+#else
+bool gps_casic = false;
+#endif
 
-// BEIDOU Satellites in view
-GSV BD_GSV;
+/**
+ * @brief Send CASIC message to GPS
+ *
+ * @param cls -> message class
+ * @param id -> message ID
+ * @param payload -> payload
+ * @param len -> payload length (multiple of 4)
+ */
+static void send_casic(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len)
+{
+  uint8_t frame[CASIC_AID_INI_SIZE + CASIC_OVERHEAD];
+  gps->write(frame, build_casic_frame(frame, cls, id, payload, len));
+  gps->flush();
+}
 
-#else
+/**
+ * @brief Send PCAS command (checksum and line end added)
+ *
+ * @param body -> command without '$' and checksum
+ */
+static void send_pcas(const char *body)
+{
+  uint8_t checksum = 0;
+  for (const char *p = body; *p; p++)
+    checksum ^= *p;
+  gps->printf("$%s*%02X\r\n", body, checksum);
+}
 
-// DOP and fix mode
-TinyGPSCustom pdop(GPS, PSTR("GPGSA"), 15); // $GPGSA sentence, 15th element
-TinyGPSCustom hdop(GPS, PSTR("GPGSA"), 16); // $GPGSA sentence, 16th element
-TinyGPSCustom vdop(GPS, PSTR("GPGSA"), 17); // $GPGSA sentence, 17th element
-TinyGPSCustom fix(GPS, PSTR("GPGGA"), 6);
-TinyGPSCustom fix_mode(GPS, PSTR("GPGSA"), 2);
+/**
+ * @brief Send CFG-PRT (protocols and baud rate of current port)
+ *
+ * @param protocols -> CASIC_PROTO_xxx mask
+ * @param baudrate -> baud rate
+ */
+static void send_casic_prt(uint8_t protocols, uint32_t baudrate)
+{
+  uint8_t payload[8] = {CASIC_PRT_CURRENT, protocols, CASIC_PRT_8N1 & 0xFF, CASIC_PRT_8N1 >> 8};
+  memcpy(payload + 4, &baudrate, 4);
+  send_casic(CASIC_CFG, CASIC_CFG_PRT, payload, sizeof(payload));
+}
 
-// GPS Satellites in view
-GSV GPS_GSV;
+/**
+ * @brief Send CFG-MSG (message output every rate epochs, 0 disables)
+ *
+ */
+static void send_casic_msg(uint8_t cls, uint8_t id, uint16_t rate)
+{
+  uint8_t payload[4] = {cls, id, (uint8_t)(rate & 0xFF), (uint8_t)(rate >> 8)};
+  send_casic(CASIC_CFG, CASIC_CFG_MSG, payload, sizeof(payload));
+}
 
-#endif
+/**
+ * @brief Read GPS until a CASIC frame is received (before GPS task starts)
+ *
+ * @param timeout -> ms
+ * @param ack -> acknowledged message (class << 8 | ID) to wait for, 0 any frame
+ * @return true if received
+ */
+static bool wait_casic(uint32_t timeout, uint16_t ack)
+{
+  uint32_t frames = casic_frames;
+  casic_last_ack = 0;
+  uint32_t start = millis();
+  while (millis() - start < timeout)
+  {
+    while (gps->available() > 0)
+    {
+      if (encode_casic(gps->read()) && (ack == 0 ? casic_frames != frames : casic_last_ack == ack))
+        return true;
+    }
+    delay(5);
+  }
+  return false;
+}
 
 /**
- * @brief Structure for satellite position (number, elev, azimut,...)
+ * @brief Switch AT6558D to CASIC binary output at GPS_CASIC_BAUDRATE and GPS_RATE Hz
+ *        (receiver may be already switched if it kept power while ESP32 restarted)
  *
+ * @return true if receiver answers in CASIC
  */
-struct
+static bool init_casic()
 {
-  bool active;
-  uint8_t sat_num;
-  uint8_t elev;
-  uint16_t azim;
-  uint8_t snr;
-  uint16_t pos_x;
-  uint16_t pos_y;
-} sat_tracker[MAX_SATELLITES];
+  gps->begin(GPS_CASIC_BAUDRATE, SERIAL_8N1, GPS_RX, GPS_TX);
+  if (!wait_casic(GPS_PROBE_TIME, 0))
+  {
+    gps->updateBaudRate(GPS_BAUDRATE);
+    send_casic_prt(CASIC_PROTO_BIN_IN | CASIC_PROTO_TXT_IN | CASIC_PROTO_BIN_OUT, GPS_CASIC_BAUDRATE);
+    delay(20);
+    gps->updateBaudRate(GPS_CASIC_BAUDRATE);
+  }
+
+  uint8_t rate[4] = {(uint8_t)((1000 / GPS_RATE) & 0xFF), (uint8_t)((1000 / GPS_RATE) >> 8), 0, 0};
+  send_casic(CASIC_CFG, CASIC_CFG_RATE, rate, sizeof(rate));
+  if (!wait_casic(GPS_PROBE_TIME, (CASIC_CFG << 8) | CASIC_CFG_RATE))
+  {
+    log_e("GPS: no CASIC answer at %d baud, using NMEA", GPS_CASIC_BAUDRATE);
+    send_casic_prt(CASIC_PROTO_BIN_IN | CASIC_PROTO_TXT_IN | CASIC_PROTO_TXT_OUT, GPS_BAUDRATE);
+    delay(20);
+    gps->updateBaudRate(GPS_BAUDRATE);
+    return false;
+  }
+
+  send_casic_msg(CASIC_NAV, CASIC_NAV_PV, 1);
+  send_casic_msg(CASIC_NAV, CASIC_NAV_DOP, 1);
+  send_casic_msg(CASIC_NAV, CASIC_NAV_TIMEUTC, 1);
+  send_casic_msg(CASIC_NAV, CASIC_NAV_GPSINFO, GPS_RATE);
+  send_casic_msg(CASIC_NAV, CASIC_NAV_BDSINFO, GPS_RATE);
+  send_casic_msg(CASIC_NAV, CASIC_NAV_GLNINFO, GPS_RATE);
+  log_v("GPS: CASIC at %d baud, %d Hz", GPS_CASIC_BAUDRATE, GPS_RATE);
+  return true;
+}
 
 /**
- * @brief Init GPS and custon NMEA parsing
+ * @brief Init GPS (NMEA sentences are parsed by encode_nmea, see nmea.h, CASIC frames by encode_casic, see casic.h)
  *
  */
 void init_gps()
 {
+#ifdef AT6558D_GPS
+  if (gps_casic)
+    gps_casic = init_casic();
+  if (gps_casic)
+    return;
+#endif
+
   gps->begin(GPS_BAUDRATE, SERIAL_8N1, GPS_RX, GPS_TX);
 
 #ifdef AT6558D_GPS
+  // Back to GPS_BAUDRATE if receiver kept power and the baud rate set by rate controller (see gps_rate.h)
+  static const uint32_t rate_baudrates[] = {38400, 115200};
+  for (uint32_t baudrate : rate_baudrates)
+  {
+    gps->updateBaudRate(baudrate);
+    gps->print("$PCAS01,1*1D\r\n");
+    gps->flush();
+    delay(20);
+  }
+  gps->updateBaudRate(GPS_BAUDRATE);
+
   // GPS
   // gps->println("$PCAS04,1*18\r\n");
   // GPS+GLONASS
@@ -112,44 +224,262 @@ void init_gps()
   gps->flush();
   delay(100);
 #endif
+}
 
-  // Initialize satellites in view custom NMEA structure
+/**
+ * @brief GPS start modes (PCAS10 restart). -D GPS_START=n restarts receiver at boot in that mode to measure
+ *        time to first fix, otherwise receiver keeps its state (hot start if it kept backup power)
+ *
+ */
+#define GPS_HOT_START 0
+#define GPS_WARM_START 1
+#define GPS_COLD_START 2
+#define GPS_KEEP_START 0xFF
+#define GPS_AID_ACCURACY 10000.0f // m, aiding position accuracy (device may have moved while off)
+#define GPS_RESTART_WAIT 2000     // ms, max wait for receiver output after restart
 
-  GPS_GSV.totalMsg.begin(GPS, PSTR("GPGSV"), 1);
-  GPS_GSV.msgNum.begin(GPS, PSTR("GPGSV"), 2);
-  GPS_GSV.satsInView.begin(GPS, PSTR("GPGSV") ,3);
+/**
+ * @brief Start mode, position aiding and boot times (ms) of first main screen with position and first fix
+ *
+ */
+struct GpsStart
+{
+  uint8_t mode;
+  bool aided;
+  uint32_t first_map;
+  uint32_t first_fix;
+};
+GpsStart gps_start = {GPS_KEEP_START, false, 0, 0};
 
-#ifdef MULTI_GNSS
+/**
+ * @brief Restart receiver (PCAS10, accepted in NMEA and CASIC modes)
+ *
+ * @param mode -> GPS_HOT_START, GPS_WARM_START or GPS_COLD_START
+ */
+void restart_gps(uint8_t mode)
+{
+  char cmd[12];
+  sprintf(cmd, "PCAS10,%d", mode);
+  send_pcas(cmd);
+  gps->flush();
+  while (gps->available() > 0)
+    gps->read();
+}
 
-  GL_GSV.totalMsg.begin(GPS, PSTR("GLGSV"), 1);
-  GL_GSV.msgNum.begin(GPS, PSTR("GLGSV"), 2);
-  GL_GSV.satsInView.begin(GPS, PSTR("GLGSV") ,3);
+/**
+ * @brief Wait for receiver output after restart (first CASIC frame or start of NMEA sentence)
+ *
+ * @param timeout -> max wait (ms)
+ * @return true if receiver is sending
+ */
+static bool wait_gps_output(uint32_t timeout)
+{
+  if (gps_casic)
+    return wait_casic(timeout, 0);
+  uint32_t start = millis();
+  while (millis() - start < timeout)
+  {
+    while (gps->available() > 0)
+    {
+      if (gps->read() == '$')
+        return true;
+    }
+    delay(5);
+  }
+  return false;
+}
 
-  BD_GSV.totalMsg.begin(GPS, PSTR("BDGSV"), 1);
-  BD_GSV.msgNum.begin(GPS, PSTR("BDGSV"), 2);
-  BD_GSV.satsInView.begin(GPS, PSTR("BDGSV") ,3);
+/**
+ * @brief Send aiding position (AID-INI, latitude / longitude / altitude). Board has no RTC, cached fix time is
+ *        stale after power off, so time is flagged as not valid and receiver takes it from satellites
+ *
+ * @param lat -> latitude
+ * @param lon -> longitude
+ * @param altitude -> meters
+ */
+void aid_gps(double lat, double lon, float altitude)
+{
+  uint8_t payload[CASIC_AID_INI_SIZE] = {};
+  double alt = altitude;
+  float accuracy = GPS_AID_ACCURACY;
+  memcpy(payload + CASIC_AID_INI_LAT, &lat, 8);
+  memcpy(payload + CASIC_AID_INI_LON, &lon, 8);
+  memcpy(payload + CASIC_AID_INI_ALT, &alt, 8);
+  memcpy(payload + CASIC_AID_INI_PACC, &accuracy, 4);
+  // No CASIC_AID_TIME_VALID: tow, wn and tAcc are ignored
+  payload[CASIC_AID_INI_FLAGS] = CASIC_AID_POS_VALID | CASIC_AID_LLA;
+  send_casic(CASIC_AID, CASIC_AID_INI, payload, sizeof(payload));
+}
 
+/**
+ * @brief Start receiver after init_gps: restart in GPS_START mode if set (waiting for receiver output)
+ *        and aid with cached position
+ *
+ * @param cached -> cached position is valid
+ * @param lat -> cached latitude
+ * @param lon -> cached longitude
+ * @param altitude -> cached altitude
+ */
+void start_gps(bool cached, double lat, double lon, float altitude)
+{
+#ifdef AT6558D_GPS
+#ifdef GPS_START
+  gps_start.mode = GPS_START;
+  restart_gps(GPS_START);
+  // Aiding sent while receiver restarts is lost
+  if (!wait_gps_output(GPS_RESTART_WAIT))
+    log_e("GPS: no output %d ms after restart", GPS_RESTART_WAIT);
+#endif
+  if (cached && gps_start.mode != GPS_COLD_START)
+  {
+    aid_gps(lat, lon, altitude);
+    gps_start.aided = true;
+  }
 #endif
+}
+
+/**
+ * @brief Record time to first main screen with position and time to first fix (UI), logged once both are known
+ *
+ * @param fixed -> fix available
+ * @param map -> main screen shown with a position (cached or fix)
+ */
+void check_gps_start(bool fixed, bool map)
+{
+  static const char *modes[] = {"hot", "warm", "cold"};
+  if (gps_start.first_fix != 0)
+    return;
+  uint32_t now = millis();
+  if (map && gps_start.first_map == 0)
+    gps_start.first_map = now;
+  if (!fixed)
+    return;
+  gps_start.first_fix = now;
+  log_v("GPS start: %s%s, first map %d ms, first fix %d ms", gps_start.mode < 3 ? modes[gps_start.mode] : "receiver state",
+        gps_start.aided ? " + position aiding" : "", gps_start.first_map, gps_start.first_fix);
+}
+
+/**
+ * @brief Process byte received from GPS
+ *
+ * @param c -> byte
+ */
+static inline void encode_gps(uint8_t c)
+{
+  if (gps_casic)
+    encode_casic(c);
+  else
+    encode_nmea(c);
+}
 
-  for (int i = 0; i < 4; ++i)
+/**
+ * @brief Find satellite in table
+ *
+ * @param system -> satellite system
+ * @param prn -> satellite PRN
+ * @return int -> slot or -1 if not found
+ */
+static int find_sat(uint8_t system, uint8_t prn)
+{
+  for (int i = 0; i < sat_table.count; i++)
   {
-    GPS_GSV.satNum[i].begin(GPS, PSTR("GPGSV"), 4 + (4 * i)); // offsets 4, 8, 12, 16
-    GPS_GSV.elev[i].begin(GPS, PSTR("GPGSV"), 5 + (4 * i));   // offsets 5, 9, 13, 17
-    GPS_GSV.azim[i].begin(GPS, PSTR("GPGSV"), 6 + (4 * i));   // offsets 6, 10, 14, 18
-    GPS_GSV.snr[i].begin(GPS, PSTR("GPGSV"), 7 + (4 * i));    // offsets 7, 11, 15, 19
+    if (sat_table.sat[i].prn == prn && sat_table.sat[i].system == system)
+      return i;
+  }
+  return -1;
+}
 
-#ifdef MULTI_GNSS
+/**
+ * @brief Get slot for a new satellite (first free slot or oldest satellite if table is full)
+ *
+ * @return int -> slot
+ */
+static int new_sat_slot()
+{
+  int oldest = 0;
+  for (int i = 0; i < sat_table.count; i++)
+  {
+    if (sat_table.sat[i].prn == 0)
+      return i;
+    if ((int32_t)(sat_table.sat[i].seen - sat_table.sat[oldest].seen) < 0)
+      oldest = i;
+  }
+  if (sat_table.count < MAX_SATELLITES)
+    return sat_table.count++;
+  return oldest;
+}
 
-    GL_GSV.satNum[i].begin(GPS, PSTR("GLGSV"), 4 + (4 * i)); // offsets 4, 8, 12, 16
-    GL_GSV.elev[i].begin(GPS, PSTR("GLGSV"), 5 + (4 * i));   // offsets 5, 9, 13, 17
-    GL_GSV.azim[i].begin(GPS, PSTR("GLGSV"), 6 + (4 * i));   // offsets 6, 10, 14, 18
-    GL_GSV.snr[i].begin(GPS, PSTR("GLGSV"), 7 + (4 * i));    // offsets 7, 11, 15, 19
+/**
+ * @brief Check if satellite is in GSA used list of its system
+ *
+ * @param sat -> satellite
+ * @return true if used in fix
+ */
+static bool is_sat_used(const SatInfo &sat)
+{
+  for (int i = 0; i < nmea_gsa.used_count[sat.system]; i++)
+  {
+    if (nmea_gsa.used[sat.system][i] == sat.prn)
+      return true;
+  }
+  return false;
+}
 
-    BD_GSV.satNum[i].begin(GPS, PSTR("BDGSV"), 4 + (4 * i)); // offsets 4, 8, 12, 16
-    BD_GSV.elev[i].begin(GPS, PSTR("BDGSV"), 5 + (4 * i));   // offsets 5, 9, 13, 17
-    BD_GSV.azim[i].begin(GPS, PSTR("BDGSV"), 6 + (4 * i));   // offsets 6, 10, 14, 18
-    BD_GSV.snr[i].begin(GPS, PSTR("BDGSV"), 7 + (4 * i));    // offsets 7, 11, 15, 19
+/**
+ * @brief Update satellite table with new GSV epochs of all systems, used in fix status
+ *        and remove satellites not seen for SAT_MAX_AGE (GPS task, with gps_mutex taken)
+ *
+ */
+void update_sat_table()
+{
+  uint32_t now = millis();
+  bool changed = false;
 
-#endif
+  for (int system = 0; system < NMEA_SYSTEMS; system++)
+  {
+    NmeaGsv &gsv = nmea_gsv[system];
+    if (!gsv.updated)
+      continue;
+    gsv.updated = false;
+    changed = true;
+    for (int i = 0; i < gsv.count; i++)
+    {
+      if (gsv.sats[i].prn == 0)
+        continue;
+      int slot = find_sat(system, gsv.sats[i].prn);
+      if (slot < 0)
+        slot = new_sat_slot();
+      SatInfo &sat = sat_table.sat[slot];
+      sat.system = system;
+      sat.prn = gsv.sats[i].prn;
+      sat.elev = gsv.sats[i].elev;
+      sat.azim = gsv.sats[i].azim;
+      sat.snr = gsv.sats[i].snr;
+      sat.seen = now;
+    }
   }
+
+  for (int i = 0; i < sat_table.count; i++)
+  {
+    SatInfo &sat = sat_table.sat[i];
+    if (sat.prn == 0)
+      continue;
+    if (now - sat.seen > SAT_MAX_AGE)
+    {
+      sat.prn = 0;
+      changed = true;
+      continue;
+    }
+    bool used = is_sat_used(sat);
+    if (used != sat.used)
+    {
+      sat.used = used;
+      changed = true;
+    }
+  }
+  while (sat_table.count > 0 && sat_table.sat[sat_table.count - 1].prn == 0)
+    sat_table.count--;
+
+  if (changed)
+    sat_table.version++;
 }
@@ -0,0 +1,118 @@
+/**
+ * @file gps_fix.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  GPS fix snapshot: values of a complete epoch published by GPS task with a sequence counter (seqlock),
+ *         so readers on any core get coherent data without locks
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+#include <atomic>
+
+/**
+ * @brief Fix of an epoch
+ *
+ */
+struct GpsFix
+{
+  uint32_t time;     // millis when epoch was published
+  double lat;
+  double lon;
+  float altitude;    // meters
+  float speed;       // Km/h
+  float course;      // degrees
+  uint16_t pdop;     // x100
+  uint16_t hdop;     // x100
+  uint16_t vdop;     // x100
+  uint8_t quality;   // GGA fix quality (0 no fix)
+  uint8_t fix_mode;  // 1 no fix, 2 2D, 3 3D
+  uint8_t satellites;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+  uint8_t day;
+  uint8_t month;
+  uint16_t year;
+  uint16_t valid;    // NMEA_xxx flags of values received at least once
+};
+
+/**
+ * @brief Published snapshot. Sequence is odd while writer is copying, and advances by 2 on every epoch
+ *
+ */
+static GpsFix gps_fix_data = {};
+std::atomic<uint32_t> gps_fix_seq(0);
+
+/**
+ * @brief Publish parsed values as new epoch (GPS task, set as parser epoch handler by init_gps_fix)
+ *
+ */
+void publish_gps_fix()
+{
+  uint32_t seq = gps_fix_seq.load(std::memory_order_relaxed);
+  gps_fix_seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  gps_fix_data.time = millis();
+  gps_fix_data.lat = nmea_fix.lat;
+  gps_fix_data.lon = nmea_fix.lon;
+  gps_fix_data.altitude = nmea_fix.altitude;
+  gps_fix_data.speed = nmea_fix.speed;
+  gps_fix_data.course = nmea_fix.course;
+  gps_fix_data.pdop = nmea_gsa.pdop;
+  gps_fix_data.hdop = nmea_gsa.hdop != 0 ? nmea_gsa.hdop : nmea_fix.hdop;
+  gps_fix_data.vdop = nmea_gsa.vdop;
+  gps_fix_data.quality = nmea_fix.quality;
+  gps_fix_data.fix_mode = nmea_gsa.fix_mode;
+  gps_fix_data.satellites = nmea_fix.satellites;
+  gps_fix_data.hour = nmea_fix.hour;
+  gps_fix_data.minute = nmea_fix.minute;
+  gps_fix_data.second = nmea_fix.second;
+  gps_fix_data.day = nmea_fix.day;
+  gps_fix_data.month = nmea_fix.month;
+  gps_fix_data.year = nmea_fix.year;
+  gps_fix_data.valid = nmea_fix.valid;
+
+  gps_fix_seq.store(seq + 2, std::memory_order_release);
+}
+
+/**
+ * @brief Read last published epoch (retries while writer is publishing)
+ *
+ * @param fix -> fix copy
+ * @return uint32_t -> sequence of epoch read
+ */
+uint32_t read_gps_fix(GpsFix &fix)
+{
+  uint32_t seq;
+  for (;;)
+  {
+    seq = gps_fix_seq.load(std::memory_order_acquire);
+    if (seq & 1)
+      continue;
+    memcpy(&fix, &gps_fix_data, sizeof(GpsFix));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (gps_fix_seq.load(std::memory_order_relaxed) == seq)
+      return seq;
+  }
+}
+
+/**
+ * @brief Check if a new epoch was published since sequence
+ *
+ * @param seq -> sequence returned by read_gps_fix (0 before first read)
+ * @return true if new epoch
+ */
+static inline bool is_gps_fix_new(uint32_t seq)
+{
+  return gps_fix_seq.load(std::memory_order_acquire) != seq;
+}
+
+/**
+ * @brief Publish snapshot at the end of every parsed epoch (NMEA and CASIC)
+ *
+ */
+void init_gps_fix()
+{
+  on_nmea_epoch = publish_gps_fix;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file gps_rate.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  GPS output rate controller: update rate, sentence set and baud rate selected by speed,
+ *         active screen (satellites in view only needed on satellite tile) and battery level
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+/**
+ * @brief Update rates (Hz) and speed (km/h) to switch to next rate. Rate goes down when speed has stayed below
+ *        GPS_RATE_HYSTERESIS of previous threshold for GPS_RATE_HOLD ms
+ *
+ */
+static const uint8_t gps_rates[] = {1, 2, 5, 10};
+static const float gps_rate_speed[] = {3.0f, 20.0f, 60.0f};
+#define GPS_RATES (sizeof(gps_rates) / sizeof(gps_rates[0]))
+#define GPS_RATE_HYSTERESIS 0.7f
+#define GPS_RATE_HOLD 10000
+#define GPS_RATE_PERIOD 1000 // ms between evaluations
+
+/**
+ * @brief Battery level (%) limiting rate (GPS_RATE_LOW_BATT -> 2 Hz, GPS_RATE_CRIT_BATT -> 1 Hz).
+ *        0 (not read) and over 100 (charging) don't limit
+ *
+ */
+#define GPS_RATE_LOW_BATT 25
+#define GPS_RATE_CRIT_BATT 10
+
+/**
+ * @brief Estimated NMEA 4.1 bytes (GPS+BDS+GLONASS): GGA+RMC every epoch, GSA and GSV once per second.
+ *        Baud rate is the lowest with UART load under GPS_RATE_UART_LOAD %
+ *
+ */
+#define GPS_EPOCH_BYTES 150
+#define GPS_GSA_BYTES 200
+#define GPS_GSV_BYTES 650
+#define GPS_RATE_UART_LOAD 70
+static const uint32_t gps_baudrates[] = {9600, 38400, 115200};
+static const uint8_t gps_pcas_baud[] = {1, 3, 5}; // PCAS01 baud rate index
+
+/**
+ * @brief Output configuration selected by UI (rate 0 -> receiver configured by init_gps), time speed went
+ *        below the threshold to go down from current tier, and receiver baud rate (GPS task only)
+ *
+ */
+struct GpsRate
+{
+  uint8_t rate;
+  bool gsv;
+  uint32_t baudrate;
+  uint8_t tier;
+  bool below;
+  uint32_t below_time;
+  uint32_t eval_time;
+};
+GpsRate gps_rate = {0, true, GPS_BAUDRATE, 0, false, 0, 0};
+
+/**
+ * @brief Output change requested by UI (GPS_RATE_REQUEST | GPS_RATE_GSV | rate, 0 none), applied by GPS task
+ *        so commands and baud rate changes don't race with UART receive
+ *
+ */
+#define GPS_RATE_REQUEST 0x8000
+#define GPS_RATE_GSV 0x0100
+std::atomic<uint16_t> gps_rate_request(0);
+
+/**
+ * @brief Get UART baud rate for output configuration
+ *
+ * @param rate -> update rate (Hz)
+ * @param gsv -> satellites in view enabled
+ * @return int -> gps_baudrates index
+ */
+static int get_gps_baud_index(uint8_t rate, bool gsv)
+{
+  uint32_t bytes = rate * GPS_EPOCH_BYTES + GPS_GSA_BYTES + (gsv ? GPS_GSV_BYTES : 0);
+  int i = 0;
+  while (i < (int)(sizeof(gps_baudrates) / sizeof(gps_baudrates[0])) - 1 &&
+         bytes * 10 * 100 > gps_baudrates[i] * GPS_RATE_UART_LOAD)
+    i++;
+  return i;
+}
+
+/**
+ * @brief Change receiver baud rate (PCAS01 sent at current rate, then UART follows). Bytes received during
+ *        the switch are dropped from receive ring (GPS task)
+ *
+ * @param index -> gps_baudrates index
+ */
+static void set_gps_baudrate(int index)
+{
+  char cmd[16];
+  sprintf(cmd, "PCAS01,%d", gps_pcas_baud[index]);
+  send_pcas(cmd);
+  gps->flush();
+  gps->updateBaudRate(gps_baudrates[index]);
+  reset_gps_rx();
+  gps_rate.baudrate = gps_baudrates[index];
+}
+
+/**
+ * @brief Set NMEA update rate (PCAS02) and sentence set (PCAS03: GGA and RMC every epoch, GSA and GSV every
+ *        second, GLL, VTG, ZDA and the rest disabled). Baud rate is raised before and lowered after
+ *        the new output, so UART never overflows
+ *
+ * @param rate -> update rate (Hz)
+ * @param gsv -> satellites in view enabled
+ */
+static void set_gps_nmea_output(uint8_t rate, bool gsv)
+{
+  char cmd[48];
+  int baud = get_gps_baud_index(rate, gsv);
+  bool raise = gps_baudrates[baud] > gps_rate.baudrate;
+
+  if (raise)
+    set_gps_baudrate(baud);
+  sprintf(cmd, "PCAS03,1,0,%d,%d,1,0,0,0,0,0,,,0,0", rate, gsv ? rate : 0);
+  send_pcas(cmd);
+  sprintf(cmd, "PCAS02,%d", 1000 / rate);
+  send_pcas(cmd);
+  if (!raise && gps_baudrates[baud] != gps_rate.baudrate)
+    set_gps_baudrate(baud);
+}
+
+/**
+ * @brief Set CASIC update rate (CFG-RATE) and satellite info messages (every second or disabled)
+ *
+ * @param rate -> update rate (Hz)
+ * @param gsv -> satellites in view enabled
+ */
+static void set_gps_casic_output(uint8_t rate, bool gsv)
+{
+  uint8_t payload[4] = {(uint8_t)((1000 / rate) & 0xFF), (uint8_t)((1000 / rate) >> 8), 0, 0};
+  send_casic(CASIC_CFG, CASIC_CFG_RATE, payload, sizeof(payload));
+  send_casic_msg(CASIC_NAV, CASIC_NAV_GPSINFO, gsv ? rate : 0);
+  send_casic_msg(CASIC_NAV, CASIC_NAV_BDSINFO, gsv ? rate : 0);
+  send_casic_msg(CASIC_NAV, CASIC_NAV_GLNINFO, gsv ? rate : 0);
+  gps_rate.baudrate = GPS_CASIC_BAUDRATE;
+}
+
+/**
+ * @brief Select speed tier. Goes up at once, goes down one tier once speed has stayed below the
+ *        hysteresis threshold for GPS_RATE_HOLD ms (the hold restarts for each tier)
+ *
+ * @param speed -> km/h (negative if no fix)
+ * @param now -> millis
+ * @return uint8_t -> gps_rates index
+ */
+static uint8_t get_gps_rate_tier(float speed, uint32_t now)
+{
+  uint8_t tier = gps_rate.tier;
+  while (tier < GPS_RATES - 1 && speed > gps_rate_speed[tier])
+    tier++;
+
+  if (tier == 0 || tier != gps_rate.tier || speed >= gps_rate_speed[tier - 1] * GPS_RATE_HYSTERESIS)
+  {
+    gps_rate.below = false;
+    return tier;
+  }
+  if (!gps_rate.below)
+  {
+    gps_rate.below = true;
+    gps_rate.below_time = now;
+  }
+  else if (now - gps_rate.below_time >= GPS_RATE_HOLD)
+  {
+    gps_rate.below = false;
+    tier--;
+  }
+  return tier;
+}
+
+/**
+ * @brief Select GPS output for current speed, screen and battery (UI, every GPS_RATE_PERIOD ms) and request it
+ *        from GPS task. Receiver is left untouched in NMEA replay or when it isn't an AT6558D
+ *
+ * @param speed -> km/h (negative if no fix)
+ * @param sat_view -> satellite tile is shown
+ * @param battery -> battery level (%)
+ */
+void update_gps_rate(float speed, bool sat_view, uint8_t battery)
+{
+#ifdef AT6558D_GPS
+  uint32_t now = millis();
+  if (now - gps_rate.eval_time < GPS_RATE_PERIOD || nmea_replay.source != REPLAY_OFF)
+    return;
+  gps_rate.eval_time = now;
+
+  uint8_t tier = get_gps_rate_tier(speed, now);
+  uint8_t rate = gps_rates[tier];
+  if (battery > 0 && battery <= 100)
+  {
+    if (battery < GPS_RATE_CRIT_BATT)
+      rate = 1;
+    else if (battery < GPS_RATE_LOW_BATT)
+      rate = min(rate, (uint8_t)2);
+  }
+
+  gps_rate.tier = tier;
+  if (rate == gps_rate.rate && sat_view == gps_rate.gsv)
+    return;
+
+  gps_rate.rate = rate;
+  gps_rate.gsv = sat_view;
+  gps_rate_request.store(GPS_RATE_REQUEST | (sat_view ? GPS_RATE_GSV : 0) | rate, std::memory_order_release);
+  if (gps_task != NULL)
+    xTaskNotifyGive(gps_task);
+  log_v("GPS: %d Hz, satellites in view %s (%.1f km/h, battery %d%%)", rate, sat_view ? "on" : "off", speed,
+        battery);
+#endif
+}
+
+/**
+ * @brief Apply output change requested by update_gps_rate (GPS task, after received bytes are parsed)
+ *
+ */
+void apply_gps_rate()
+{
+  uint16_t request = gps_rate_request.exchange(0, std::memory_order_acquire);
+  if (request == 0)
+    return;
+  uint8_t rate = request & 0xFF;
+  bool gsv = (request & GPS_RATE_GSV) != 0;
+  if (gps_casic)
+    set_gps_casic_output(rate, gsv);
+  else
+    set_gps_nmea_output(rate, gsv);
+  log_v("GPS: output %d Hz at %d baud", rate, gps_rate.baudrate);
+}
@@ -0,0 +1,216 @@
+/**
+ * @file gps_rx.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  GPS UART ingestion: received bytes are copied on UART events into a lock-free
+ *         single producer / single consumer ring of timestamped chunks, parsed by the GPS task
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+#include <atomic>
+
+/**
+ * @brief GPS receive ring size (chunks, power of 2) and chunk size
+ *
+ */
+#ifndef GPS_RX_CHUNKS
+#define GPS_RX_CHUNKS 32
+#endif
+#define GPS_RX_CHUNK 128
+#define GPS_RX_BUFFER 1024 // UART driver RX buffer
+#define GPS_RX_STATS_PERIOD 10000
+
+/**
+ * @brief Received bytes chunk and its receive time (micros)
+ *
+ */
+struct GpsRxChunk
+{
+  uint32_t time;
+  uint16_t len;
+  uint8_t data[GPS_RX_CHUNK];
+};
+
+/**
+ * @brief SPSC ring: UART event task writes head, GPS task writes tail
+ *
+ */
+GpsRxChunk gps_rx_ring[GPS_RX_CHUNKS];
+std::atomic<uint32_t> gps_rx_head(0);
+std::atomic<uint32_t> gps_rx_tail(0);
+TaskHandle_t gps_task = NULL;
+
+/**
+ * @brief Satellite table mutex: held by GPS task while updating and by UI while reading satellite table
+ *        (fix is read lock free, see gps_fix.h)
+ *
+ */
+SemaphoreHandle_t gps_mutex = NULL;
+
+/**
+ * @brief GPS receive counters
+ *
+ */
+volatile uint32_t gps_rx_bytes = 0;
+volatile uint32_t gps_rx_overflow = 0;
+volatile uint32_t gps_rx_errors = 0;
+volatile uint8_t gps_rx_high_water = 0;
+uint32_t gps_rx_max_latency = 0;
+uint32_t gps_rx_stats_time = 0;
+uint32_t gps_rx_stats_bytes = 0;
+uint32_t gps_parse_time = 0; // us spent parsing since last stats log
+
+/**
+ * @brief UART receive event (runs in UART event task): copy available bytes into ring and wake GPS task.
+ *        While ring is full UART isn't read, bytes wait in driver buffer until GPS task frees a chunk
+ *        (driver reports an overflow if its buffer fills up meanwhile)
+ *
+ */
+static void gps_rx_event()
+{
+  uint32_t head = gps_rx_head.load(std::memory_order_relaxed);
+  int available;
+  while ((available = gps->available()) > 0)
+  {
+    uint32_t used = head - gps_rx_tail.load(std::memory_order_acquire);
+    if (used == GPS_RX_CHUNKS)
+    {
+      if (gps_task != NULL)
+        xTaskNotifyGive(gps_task);
+      vTaskDelay(1);
+      continue;
+    }
+    if (used + 1 > gps_rx_high_water)
+      gps_rx_high_water = used + 1;
+
+    GpsRxChunk &chunk = gps_rx_ring[head % GPS_RX_CHUNKS];
+    chunk.time = micros();
+    chunk.len = gps->read(chunk.data, min(available, GPS_RX_CHUNK));
+    gps_rx_bytes += chunk.len;
+    head++;
+    gps_rx_head.store(head, std::memory_order_release);
+  }
+  if (gps_task != NULL)
+    xTaskNotifyGive(gps_task);
+}
+
+/**
+ * @brief Push bytes from another source (NMEA replay) into ring and wake GPS task
+ *
+ * @param data -> received bytes
+ * @param len -> bytes (up to GPS_RX_CHUNK)
+ * @return false if ring is full (nothing pushed)
+ */
+bool push_gps_rx(const uint8_t *data, uint16_t len)
+{
+  uint32_t head = gps_rx_head.load(std::memory_order_relaxed);
+  uint32_t used = head - gps_rx_tail.load(std::memory_order_acquire);
+  if (used == GPS_RX_CHUNKS)
+    return false;
+  if (used + 1 > gps_rx_high_water)
+    gps_rx_high_water = used + 1;
+
+  GpsRxChunk &chunk = gps_rx_ring[head % GPS_RX_CHUNKS];
+  chunk.time = micros();
+  chunk.len = min(len, (uint16_t)GPS_RX_CHUNK);
+  memcpy(chunk.data, data, chunk.len);
+  gps_rx_bytes += chunk.len;
+  gps_rx_head.store(head + 1, std::memory_order_release);
+  if (gps_task != NULL)
+    xTaskNotifyGive(gps_task);
+  return true;
+}
+
+/**
+ * @brief UART receive error event: FIFO or driver buffer overflow (bytes lost) or line errors (framing,
+ *        parity, break)
+ *
+ * @param error -> UART error
+ */
+static void gps_rx_error(hardwareSerial_error_t error)
+{
+  if (error == UART_BUFFER_FULL_ERROR || error == UART_FIFO_OVF_ERROR)
+    gps_rx_overflow++;
+  else
+    gps_rx_errors++;
+}
+
+/**
+ * @brief Configure GPS UART receive events (call before gps->begin)
+ *
+ */
+void init_gps_rx()
+{
+  gps_mutex = xSemaphoreCreateMutex();
+  gps->setRxBufferSize(GPS_RX_BUFFER);
+}
+
+/**
+ * @brief Start feeding ring from UART events (call after gps->begin)
+ *
+ * @param task -> task notified when bytes are received
+ */
+void start_gps_rx(TaskHandle_t task)
+{
+  gps_task = task;
+  gps->onReceiveError(gps_rx_error);
+  gps->onReceive(gps_rx_event, false);
+  gps->setRxTimeout(2);
+}
+
+/**
+ * @brief Get next received chunk (GPS task)
+ *
+ * @return GpsRxChunk* -> chunk or NULL if ring is empty
+ */
+GpsRxChunk *peek_gps_rx()
+{
+  uint32_t tail = gps_rx_tail.load(std::memory_order_relaxed);
+  if (tail == gps_rx_head.load(std::memory_order_acquire))
+    return NULL;
+  GpsRxChunk *chunk = &gps_rx_ring[tail % GPS_RX_CHUNKS];
+  uint32_t latency = micros() - chunk->time;
+  if (latency > gps_rx_max_latency)
+    gps_rx_max_latency = latency;
+  return chunk;
+}
+
+/**
+ * @brief Release chunk returned by peek_gps_rx (GPS task)
+ *
+ */
+void pop_gps_rx()
+{
+  gps_rx_tail.store(gps_rx_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Drop all received chunks (GPS task, e.g. bytes received while UART baud rate changed)
+ *
+ */
+void reset_gps_rx()
+{
+  gps_rx_tail.store(gps_rx_head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+/**
+ * @brief Log GPS receive counters (every GPS_RX_STATS_PERIOD ms)
+ *
+ */
+void log_gps_rx_stats()
+{
+  uint32_t now = millis();
+  uint32_t elapsed = now - gps_rx_stats_time;
+  if (elapsed < GPS_RX_STATS_PERIOD)
+    return;
+  uint32_t bytes = gps_rx_bytes;
+  log_v("GPS RX: %d B/s, %d UART overflows, %d UART errors, max latency %d us, ring high-water %d/%d chunks",
+        (bytes - gps_rx_stats_bytes) * 1000 / elapsed, gps_rx_overflow, gps_rx_errors, gps_rx_max_latency,
+        gps_rx_high_water, GPS_RX_CHUNKS);
+  log_v("GPS parser: %d us/s (%d.%02d%% CPU)", (uint32_t)((uint64_t)gps_parse_time * 1000 / elapsed),
+        gps_parse_time / (elapsed * 10), gps_parse_time / (elapsed / 10) % 100);
+  gps_rx_stats_time = now;
+  gps_rx_stats_bytes = bytes;
+  gps_rx_max_latency = 0;
+  gps_parse_time = 0;
+}
@@ -0,0 +1,817 @@
+/**
+ * @file nmea.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Single pass NMEA 0183 parser: talker and sentence are identified once, terms are decoded
+ *         char by char (no term copies) into typed structs and committed when checksum is valid.
+ *         Decoded sentences: GGA, RMC, VTG, GSA, GSV
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+/**
+ * @brief GNSS systems (talker IDs GP, GL, GA, GB/BD, GQ; GN is multi-system)
+ *
+ */
+enum NmeaSystem
+{
+  NMEA_GPS,
+  NMEA_GLONASS,
+  NMEA_GALILEO,
+  NMEA_BEIDOU,
+  NMEA_QZSS,
+  NMEA_SYSTEMS,
+};
+#define NMEA_MULTI NMEA_SYSTEMS
+
+/**
+ * @brief Update flags (set when a sentence with the value is committed, see is_nmea_updated)
+ *
+ */
+#define NMEA_LOCATION 0x0001
+#define NMEA_ALTITUDE 0x0002
+#define NMEA_SPEED 0x0004
+#define NMEA_COURSE 0x0008
+#define NMEA_TIME 0x0010
+#define NMEA_DATE 0x0020
+#define NMEA_SATELLITES 0x0040
+#define NMEA_FIX 0x0080
+#define NMEA_DOP 0x0100
+
+/**
+ * @brief Position, velocity and time (GGA, RMC, VTG)
+ *
+ */
+struct NmeaFix
+{
+  double lat;
+  double lon;
+  float altitude;    // meters
+  float speed;       // Km/h
+  float course;      // degrees
+  uint16_t hdop;     // x100
+  uint8_t quality;   // GGA fix quality (0 no fix, 1 GPS, 2 DGPS, ...)
+  uint8_t satellites;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+  uint8_t centisecond;
+  uint8_t day;
+  uint8_t month;
+  uint16_t year;
+  uint16_t valid;    // NMEA_xxx flags of values received at least once
+};
+
+/**
+ * @brief Fix mode, DOP and satellites used in fix (GSA, one sentence per system with GN talker)
+ *
+ */
+#define NMEA_GSA_SATS 12
+struct NmeaGsa
+{
+  uint8_t fix_mode; // 1 no fix, 2 2D, 3 3D
+  uint16_t pdop;    // x100
+  uint16_t hdop;    // x100
+  uint16_t vdop;    // x100
+  uint8_t used[NMEA_SYSTEMS][NMEA_GSA_SATS];
+  uint8_t used_count[NMEA_SYSTEMS];
+};
+
+/**
+ * @brief Satellites in view of a system (GSV), published when the last GSV message of an epoch arrives
+ *
+ */
+#define NMEA_GSV_SATS 36
+struct NmeaSat
+{
+  uint8_t prn;
+  uint8_t elev;
+  uint16_t azim;
+  uint8_t snr;
+};
+struct NmeaGsv
+{
+  uint8_t in_view;
+  uint8_t count;
+  NmeaSat sats[NMEA_GSV_SATS];
+  bool updated;
+  uint8_t next_msg;
+  uint8_t work_count;
+  NmeaSat work[NMEA_GSV_SATS];
+};
+
+NmeaFix nmea_fix = {};
+NmeaGsa nmea_gsa = {};
+NmeaGsv nmea_gsv[NMEA_SYSTEMS] = {};
+volatile uint16_t nmea_updated = 0;
+
+/**
+ * @brief Epoch end handler (called by parser when all position sentences of an epoch are committed,
+ *        before values of next epoch are committed)
+ *
+ */
+void (*on_nmea_epoch)() = NULL;
+
+/**
+ * @brief Parser counters
+ *
+ */
+uint32_t nmea_sentences = 0;
+uint32_t nmea_checksum_errors = 0;
+uint32_t nmea_ignored = 0;
+
+/**
+ * @brief Term decoders
+ *
+ */
+enum NmeaTerm
+{
+  NT_SKIP,
+  NT_TIME,
+  NT_DATE,
+  NT_STATUS,
+  NT_LAT,
+  NT_NS,
+  NT_LON,
+  NT_EW,
+  NT_QUALITY,
+  NT_SATS,
+  NT_HDOP,
+  NT_ALT,
+  NT_SPEED_KN,
+  NT_SPEED_KMH,
+  NT_COURSE,
+  NT_FIX_MODE,
+  NT_PRN,
+  NT_PDOP,
+  NT_VDOP,
+  NT_SYSTEM_ID,
+  NT_GSV_TOTAL,
+  NT_GSV_NUM,
+  NT_GSV_VIEW,
+  NT_SAT_PRN,
+  NT_SAT_ELEV,
+  NT_SAT_AZIM,
+  NT_SAT_SNR,
+};
+
+/**
+ * @brief Sentence table: sentence ID and decoder of each term (term 0 is address field).
+ *        Terms from repeat_from are decoded cyclically with the last repeat_len decoders
+ *
+ */
+enum NmeaType
+{
+  NMEA_GGA,
+  NMEA_RMC,
+  NMEA_VTG,
+  NMEA_GSA,
+  NMEA_GSV,
+  NMEA_TYPES,
+  NMEA_UNKNOWN = NMEA_TYPES,
+};
+
+static const uint8_t nmea_gga_terms[] = {NT_SKIP, NT_TIME, NT_LAT, NT_NS, NT_LON, NT_EW, NT_QUALITY, NT_SATS, NT_HDOP, NT_ALT};
+static const uint8_t nmea_rmc_terms[] = {NT_SKIP, NT_TIME, NT_STATUS, NT_LAT, NT_NS, NT_LON, NT_EW, NT_SPEED_KN, NT_COURSE, NT_DATE};
+static const uint8_t nmea_vtg_terms[] = {NT_SKIP, NT_COURSE, NT_SKIP, NT_SKIP, NT_SKIP, NT_SKIP, NT_SKIP, NT_SPEED_KMH};
+static const uint8_t nmea_gsa_terms[] = {NT_SKIP, NT_SKIP, NT_FIX_MODE, NT_PRN, NT_PRN, NT_PRN, NT_PRN, NT_PRN, NT_PRN, NT_PRN, NT_PRN,
+                                         NT_PRN, NT_PRN, NT_PRN, NT_PRN, NT_PDOP, NT_HDOP, NT_VDOP, NT_SYSTEM_ID};
+static const uint8_t nmea_gsv_terms[] = {NT_SKIP, NT_GSV_TOTAL, NT_GSV_NUM, NT_GSV_VIEW, NT_SAT_PRN, NT_SAT_ELEV, NT_SAT_AZIM, NT_SAT_SNR};
+
+struct NmeaSentenceDef
+{
+  char id[4];
+  const uint8_t *terms;
+  uint8_t count;
+  uint8_t repeat_from;
+  uint8_t repeat_len;
+};
+
+static const NmeaSentenceDef nmea_sentence[NMEA_TYPES] = {
+    {"GGA", nmea_gga_terms, sizeof(nmea_gga_terms), 0, 0},
+    {"RMC", nmea_rmc_terms, sizeof(nmea_rmc_terms), 0, 0},
+    {"VTG", nmea_vtg_terms, sizeof(nmea_vtg_terms), 0, 0},
+    {"GSA", nmea_gsa_terms, sizeof(nmea_gsa_terms), 0, 0},
+    {"GSV", nmea_gsv_terms, sizeof(nmea_gsv_terms), 4, 4},
+};
+
+static const struct
+{
+  char id[3];
+  uint8_t system;
+} nmea_talker[] = {
+    {"GP", NMEA_GPS}, {"GL", NMEA_GLONASS}, {"GA", NMEA_GALILEO}, {"GB", NMEA_BEIDOU}, {"BD", NMEA_BEIDOU}, {"GQ", NMEA_QZSS}, {"GN", NMEA_MULTI},
+};
+
+/**
+ * @brief Values decoded from current sentence, committed on valid checksum
+ *
+ */
+struct NmeaStage
+{
+  NmeaFix fix;
+  uint16_t fields; // NMEA_xxx flags of non empty values in sentence
+  char status;
+  uint8_t fix_mode;
+  uint16_t pdop;
+  uint16_t hdop;
+  uint16_t vdop;
+  uint8_t system_id;
+  uint8_t prn[NMEA_GSA_SATS];
+  uint8_t prn_count;
+  uint8_t gsv_total;
+  uint8_t gsv_num;
+  uint8_t gsv_view;
+  uint8_t gsv_terms;
+  NmeaSat sats[4];
+};
+
+/**
+ * @brief Parser state
+ *
+ */
+struct NmeaParser
+{
+  bool active;
+  bool in_checksum;
+  uint8_t checksum;
+  uint8_t received_checksum;
+  uint8_t checksum_digits;
+  uint8_t term;
+  uint8_t type;
+  uint8_t system;
+  uint8_t decoder;
+  char id[5];
+  uint8_t id_len;
+  // Term value
+  bool empty;
+  bool negative;
+  bool decimals;
+  char first;
+  uint32_t integer;
+  uint32_t fraction;
+  uint8_t fraction_digits;
+  NmeaStage stage;
+  // Epoch (GGA and RMC with same time)
+  uint32_t epoch_time;
+  uint8_t epoch_seen;
+};
+NmeaParser nmea = {};
+
+static const uint32_t nmea_pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+/**
+ * @brief Check and clear update flag
+ *
+ * @param flag -> NMEA_xxx update flag
+ * @return true if value was updated since last call
+ */
+bool is_nmea_updated(uint16_t flag)
+{
+  if ((nmea_updated & flag) == 0)
+    return false;
+  nmea_updated &= ~flag;
+  return true;
+}
+
+/**
+ * @brief Check if value has been received at least once
+ *
+ * @param flag -> NMEA_xxx flag
+ * @return true if value is valid
+ */
+bool is_nmea_valid(uint16_t flag)
+{
+  return (nmea_fix.valid & flag) != 0;
+}
+
+/**
+ * @brief Term value as real number
+ *
+ */
+static double nmea_real()
+{
+  double value = nmea.integer + (double)nmea.fraction / nmea_pow10[nmea.fraction_digits];
+  return nmea.negative ? -value : value;
+}
+
+/**
+ * @brief Term value in hundredths
+ *
+ */
+static uint16_t nmea_hundredths()
+{
+  uint32_t fraction = nmea.fraction;
+  if (nmea.fraction_digits > 2)
+    fraction /= nmea_pow10[nmea.fraction_digits - 2];
+  else if (nmea.fraction_digits < 2)
+    fraction *= nmea_pow10[2 - nmea.fraction_digits];
+  return nmea.integer * 100 + fraction;
+}
+
+/**
+ * @brief Term value (ddmm.mmmm) as degrees
+ *
+ */
+static double nmea_degrees()
+{
+  return (nmea.integer / 100) + ((nmea.integer % 100) + (double)nmea.fraction / nmea_pow10[nmea.fraction_digits]) / 60.0;
+}
+
+/**
+ * @brief Identify talker and sentence from address field
+ *
+ */
+static void nmea_address()
+{
+  nmea.type = NMEA_UNKNOWN;
+  for (int i = 0; i < (int)(sizeof(nmea_talker) / sizeof(nmea_talker[0])); i++)
+  {
+    if (nmea.id[0] == nmea_talker[i].id[0] && nmea.id[1] == nmea_talker[i].id[1])
+    {
+      nmea.system = nmea_talker[i].system;
+      for (int t = 0; t < NMEA_TYPES; t++)
+      {
+        if (memcmp(nmea.id + 2, nmea_sentence[t].id, 3) == 0)
+          nmea.type = t;
+      }
+      break;
+    }
+  }
+  if (nmea.type == NMEA_UNKNOWN)
+  {
+    nmea_ignored++;
+    nmea.active = false;
+  }
+}
+
+/**
+ * @brief Select decoder for new term
+ *
+ */
+static void nmea_begin_term()
+{
+  const NmeaSentenceDef &def = nmea_sentence[nmea.type];
+  if (nmea.term < def.count)
+    nmea.decoder = def.terms[nmea.term];
+  else if (def.repeat_len > 0)
+    nmea.decoder = def.terms[def.count - def.repeat_len + (nmea.term - def.repeat_from) % def.repeat_len];
+  else
+    nmea.decoder = NT_SKIP;
+
+  nmea.empty = true;
+  nmea.negative = false;
+  nmea.decimals = false;
+  nmea.first = 0;
+  nmea.integer = 0;
+  nmea.fraction = 0;
+  nmea.fraction_digits = 0;
+}
+
+/**
+ * @brief Decode finished term into stage
+ *
+ */
+static void nmea_end_term()
+{
+  NmeaStage &stage = nmea.stage;
+  NmeaFix &fix = stage.fix;
+
+  if (nmea.term == 0)
+  {
+    nmea_address();
+    return;
+  }
+  if (nmea.empty)
+  {
+    if (nmea.decoder == NT_SAT_PRN || nmea.decoder == NT_SAT_ELEV || nmea.decoder == NT_SAT_AZIM || nmea.decoder == NT_SAT_SNR)
+      stage.gsv_terms = nmea.term - 3;
+    return;
+  }
+
+  uint8_t sat = (nmea.term - 4) / 4;
+  switch (nmea.decoder)
+  {
+  case NT_TIME:
+    fix.hour = nmea.integer / 10000;
+    fix.minute = (nmea.integer / 100) % 100;
+    fix.second = nmea.integer % 100;
+    fix.centisecond = nmea_hundredths() % 100;
+    stage.fields |= NMEA_TIME;
+    break;
+  case NT_DATE:
+    fix.day = nmea.integer / 10000;
+    fix.month = (nmea.integer / 100) % 100;
+    fix.year = 2000 + nmea.integer % 100;
+    stage.fields |= NMEA_DATE;
+    break;
+  case NT_STATUS:
+    stage.status = nmea.first;
+    break;
+  case NT_LAT:
+    fix.lat = nmea_degrees();
+    stage.fields |= NMEA_LOCATION;
+    break;
+  case NT_NS:
+    if (nmea.first == 'S')
+      fix.lat = -fix.lat;
+    break;
+  case NT_LON:
+    fix.lon = nmea_degrees();
+    break;
+  case NT_EW:
+    if (nmea.first == 'W')
+      fix.lon = -fix.lon;
+    break;
+  case NT_QUALITY:
+    fix.quality = nmea.integer;
+    stage.fields |= NMEA_FIX;
+    break;
+  case NT_SATS:
+    fix.satellites = nmea.integer;
+    stage.fields |= NMEA_SATELLITES;
+    break;
+  case NT_HDOP:
+    stage.hdop = nmea_hundredths();
+    stage.fields |= NMEA_DOP;
+    break;
+  case NT_ALT:
+    fix.altitude = nmea_real();
+    stage.fields |= NMEA_ALTITUDE;
+    break;
+  case NT_SPEED_KN:
+    fix.speed = nmea_real() * 1.852;
+    stage.fields |= NMEA_SPEED;
+    break;
+  case NT_SPEED_KMH:
+    fix.speed = nmea_real();
+    stage.fields |= NMEA_SPEED;
+    break;
+  case NT_COURSE:
+    fix.course = nmea_real();
+    stage.fields |= NMEA_COURSE;
+    break;
+  case NT_FIX_MODE:
+    stage.fix_mode = nmea.integer;
+    stage.fields |= NMEA_FIX;
+    break;
+  case NT_PRN:
+    if (stage.prn_count < NMEA_GSA_SATS)
+      stage.prn[stage.prn_count++] = nmea.integer;
+    break;
+  case NT_PDOP:
+    stage.pdop = nmea_hundredths();
+    stage.fields |= NMEA_DOP;
+    break;
+  case NT_VDOP:
+    stage.vdop = nmea_hundredths();
+    break;
+  case NT_SYSTEM_ID:
+    stage.system_id = nmea.integer;
+    break;
+  case NT_GSV_TOTAL:
+    stage.gsv_total = nmea.integer;
+    break;
+  case NT_GSV_NUM:
+    stage.gsv_num = nmea.integer;
+    break;
+  case NT_GSV_VIEW:
+    stage.gsv_view = nmea.integer;
+    break;
+  case NT_SAT_PRN:
+    if (sat < 4)
+      stage.sats[sat].prn = nmea.integer;
+    stage.gsv_terms = nmea.term - 3;
+    break;
+  case NT_SAT_ELEV:
+    if (sat < 4)
+      stage.sats[sat].elev = nmea.integer;
+    stage.gsv_terms = nmea.term - 3;
+    break;
+  case NT_SAT_AZIM:
+    if (sat < 4)
+      stage.sats[sat].azim = nmea.integer;
+    stage.gsv_terms = nmea.term - 3;
+    break;
+  case NT_SAT_SNR:
+    if (sat < 4)
+      stage.sats[sat].snr = nmea.integer;
+    stage.gsv_terms = nmea.term - 3;
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief Get system of GSA sentence (NMEA 4.1 system ID, talker or PRN range with GN talker)
+ *
+ */
+static uint8_t nmea_gsa_system()
+{
+  static const uint8_t system_ids[] = {NMEA_MULTI, NMEA_GPS, NMEA_GLONASS, NMEA_GALILEO, NMEA_BEIDOU, NMEA_QZSS};
+  if (nmea.stage.system_id > 0 && nmea.stage.system_id < sizeof(system_ids))
+    return system_ids[nmea.stage.system_id];
+  if (nmea.system != NMEA_MULTI)
+    return nmea.system;
+  if (nmea.stage.prn_count > 0 && nmea.stage.prn[0] >= 65 && nmea.stage.prn[0] <= 96)
+    return NMEA_GLONASS;
+  return NMEA_GPS;
+}
+
+/**
+ * @brief Epoch tracking: an epoch ends when GGA and RMC of the same time are committed, or when
+ *        a GGA or RMC of a new time arrives (receivers not sending both). Without time field (no fix yet on
+ *        some receivers) every GGA and RMC pair ends an epoch, or a GGA or RMC already seen in current epoch
+ *
+ */
+#define NMEA_EPOCH_GGA 0x01
+#define NMEA_EPOCH_RMC 0x02
+#define NMEA_EPOCH_DONE 0x80
+
+/**
+ * @brief End current epoch (call epoch handler)
+ *
+ */
+static void nmea_end_epoch()
+{
+  nmea.epoch_seen = nmea.epoch_time != 0 ? NMEA_EPOCH_DONE : 0;
+  if (on_nmea_epoch != NULL)
+    on_nmea_epoch();
+}
+
+/**
+ * @brief Check time of GGA / RMC before commit, ending previous epoch if time changed
+ *
+ */
+static void nmea_begin_epoch_sentence()
+{
+  if (nmea.type != NMEA_GGA && nmea.type != NMEA_RMC)
+    return;
+  const NmeaFix &fix = nmea.stage.fix;
+  uint32_t time = (nmea.stage.fields & NMEA_TIME) ? ((fix.hour * 60 + fix.minute) * 60 + fix.second) * 100 + fix.centisecond + 1 : 0;
+  if (time != nmea.epoch_time)
+  {
+    if (nmea.epoch_seen != 0 && nmea.epoch_seen != NMEA_EPOCH_DONE)
+      nmea_end_epoch();
+    nmea.epoch_time = time;
+    nmea.epoch_seen = 0;
+  }
+  else if (time == 0 && (nmea.epoch_seen & (nmea.type == NMEA_GGA ? NMEA_EPOCH_GGA : NMEA_EPOCH_RMC)))
+    nmea_end_epoch();
+}
+
+/**
+ * @brief Track GGA / RMC after commit, ending epoch when both are committed
+ *
+ */
+static void nmea_end_epoch_sentence()
+{
+  if (nmea.epoch_seen == NMEA_EPOCH_DONE)
+    return;
+  if (nmea.type == NMEA_GGA)
+    nmea.epoch_seen |= NMEA_EPOCH_GGA;
+  else if (nmea.type == NMEA_RMC)
+    nmea.epoch_seen |= NMEA_EPOCH_RMC;
+  if (nmea.epoch_seen == (NMEA_EPOCH_GGA | NMEA_EPOCH_RMC))
+    nmea_end_epoch();
+}
+
+/**
+ * @brief Commit decoded sentence values
+ *
+ */
+static void nmea_commit()
+{
+  NmeaStage &stage = nmea.stage;
+  NmeaFix &fix = stage.fix;
+  uint16_t updated = stage.fields & (NMEA_TIME | NMEA_DATE);
+
+  nmea_begin_epoch_sentence();
+
+  if (stage.fields & NMEA_TIME)
+  {
+    nmea_fix.hour = fix.hour;
+    nmea_fix.minute = fix.minute;
+    nmea_fix.second = fix.second;
+    nmea_fix.centisecond = fix.centisecond;
+  }
+
+  switch (nmea.type)
+  {
+  case NMEA_GGA:
+    if ((stage.fields & NMEA_LOCATION) && fix.quality > 0)
+    {
+      nmea_fix.lat = fix.lat;
+      nmea_fix.lon = fix.lon;
+      updated |= NMEA_LOCATION;
+    }
+    if (stage.fields & NMEA_FIX)
+    {
+      nmea_fix.quality = fix.quality;
+      updated |= NMEA_FIX;
+    }
+    if (stage.fields & NMEA_SATELLITES)
+    {
+      nmea_fix.satellites = fix.satellites;
+      updated |= NMEA_SATELLITES;
+    }
+    if (stage.fields & NMEA_DOP)
+      nmea_fix.hdop = stage.hdop;
+    if (stage.fields & NMEA_ALTITUDE)
+    {
+      nmea_fix.altitude = fix.altitude;
+      updated |= NMEA_ALTITUDE;
+    }
+    break;
+
+  case NMEA_RMC:
+    if (stage.fields & NMEA_DATE)
+    {
+      nmea_fix.day = fix.day;
+      nmea_fix.month = fix.month;
+      nmea_fix.year = fix.year;
+    }
+    if (stage.status == 'A')
+    {
+      if (stage.fields & NMEA_LOCATION)
+      {
+        nmea_fix.lat = fix.lat;
+        nmea_fix.lon = fix.lon;
+        updated |= NMEA_LOCATION;
+      }
+      if (stage.fields & NMEA_SPEED)
+      {
+        nmea_fix.speed = fix.speed;
+        updated |= NMEA_SPEED;
+      }
+      if (stage.fields & NMEA_COURSE)
+      {
+        nmea_fix.course = fix.course;
+        updated |= NMEA_COURSE;
+      }
+    }
+    break;
+
+  case NMEA_VTG:
+    if (stage.fields & NMEA_SPEED)
+    {
+      nmea_fix.speed = fix.speed;
+      updated |= NMEA_SPEED;
+    }
+    if (stage.fields & NMEA_COURSE)
+    {
+      nmea_fix.course = fix.course;
+      updated |= NMEA_COURSE;
+    }
+    break;
+
+  case NMEA_GSA:
+  {
+    uint8_t system = nmea_gsa_system();
+    if (system < NMEA_SYSTEMS)
+    {
+      memcpy(nmea_gsa.used[system], stage.prn, stage.prn_count);
+      nmea_gsa.used_count[system] = stage.prn_count;
+    }
+    if (stage.fields & NMEA_FIX)
+      nmea_gsa.fix_mode = stage.fix_mode;
+    if (stage.fields & NMEA_DOP)
+    {
+      nmea_gsa.pdop = stage.pdop;
+      nmea_gsa.hdop = stage.hdop;
+      nmea_gsa.vdop = stage.vdop;
+      updated |= NMEA_DOP;
+    }
+    break;
+  }
+
+  case NMEA_GSV:
+  {
+    if (nmea.system >= NMEA_SYSTEMS || stage.gsv_num == 0)
+      break;
+    NmeaGsv &gsv = nmea_gsv[nmea.system];
+    if (stage.gsv_num == 1)
+      gsv.work_count = 0;
+    else if (stage.gsv_num != gsv.next_msg)
+    {
+      gsv.next_msg = 0; // Lost message, wait for next epoch
+      break;
+    }
+    for (int i = 0; i < stage.gsv_terms / 4 && i < 4 && gsv.work_count < NMEA_GSV_SATS; i++)
+      gsv.work[gsv.work_count++] = stage.sats[i];
+    gsv.next_msg = stage.gsv_num + 1;
+    if (stage.gsv_num == stage.gsv_total)
+    {
+      memcpy(gsv.sats, gsv.work, gsv.work_count * sizeof(NmeaSat));
+      gsv.count = gsv.work_count;
+      gsv.in_view = stage.gsv_view;
+      gsv.updated = true;
+      gsv.next_msg = 0;
+    }
+    break;
+  }
+  }
+
+  nmea_fix.valid |= updated;
+  nmea_updated |= updated;
+  nmea_end_epoch_sentence();
+}
+
+/**
+ * @brief Process received char
+ *
+ * @param c -> char
+ * @return true if a sentence was decoded
+ */
+bool encode_nmea(char c)
+{
+  switch (c)
+  {
+  case '$':
+    nmea.active = true;
+    nmea.in_checksum = false;
+    nmea.checksum = 0;
+    nmea.checksum_digits = 0;
+    nmea.term = 0;
+    nmea.type = NMEA_UNKNOWN;
+    nmea.decoder = NT_SKIP;
+    nmea.id_len = 0;
+    memset(nmea.id, 0, sizeof(nmea.id));
+    memset(&nmea.stage, 0, sizeof(nmea.stage));
+    return false;
+
+  case ',':
+    if (!nmea.active || nmea.in_checksum)
+      return false;
+    nmea.checksum ^= c;
+    nmea_end_term();
+    nmea.term++;
+    if (nmea.active)
+      nmea_begin_term();
+    return false;
+
+  case '*':
+    if (!nmea.active || nmea.in_checksum)
+      return false;
+    nmea_end_term();
+    nmea.in_checksum = true;
+    nmea.received_checksum = 0;
+    return false;
+
+  case '\r':
+  case '\n':
+    if (!nmea.active)
+      return false;
+    nmea.active = false;
+    if (!nmea.in_checksum || nmea.checksum_digits != 2 || nmea.type == NMEA_UNKNOWN)
+      return false;
+    if (nmea.received_checksum != nmea.checksum)
+    {
+      nmea_checksum_errors++;
+      return false;
+    }
+    nmea_commit();
+    nmea_sentences++;
+    return true;
+
+  default:
+    if (!nmea.active)
+      return false;
+    if (nmea.in_checksum)
+    {
+      if (nmea.checksum_digits < 2)
+      {
+        nmea.received_checksum = (nmea.received_checksum << 4) | (c <= '9' ? c - '0' : (c & 0xDF) - 'A' + 10);
+        nmea.checksum_digits++;
+      }
+      return false;
+    }
+    nmea.checksum ^= c;
+    if (nmea.term == 0)
+    {
+      if (nmea.id_len < sizeof(nmea.id))
+        nmea.id[nmea.id_len++] = c;
+      return false;
+    }
+    if (nmea.decoder == NT_SKIP)
+      return false;
+    nmea.empty = false;
+    if (c >= '0' && c <= '9')
+    {
+      if (!nmea.decimals)
+        nmea.integer = nmea.integer * 10 + (c - '0');
+      else if (nmea.fraction_digits < 9)
+      {
+        nmea.fraction = nmea.fraction * 10 + (c - '0');
+        nmea.fraction_digits++;
+      }
+    }
+    else if (c == '.')
+      nmea.decimals = true;
+    else if (c == '-')
+      nmea.negative = true;
+    else if (nmea.first == 0)
+      nmea.first = c;
+    return false;
+  }
+}
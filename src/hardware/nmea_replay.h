@@ -0,0 +1,365 @@
+/**
+ * @file nmea_replay.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  NMEA replay source: recorded NMEA logs (SD) or scripted synthetic tracks played at 1x, Nx
+ *         or max speed in place of GPS UART (device) or fed to parser on a simulated clock (native)
+ * @version 0.1.6
+ * @date 2023-06-14
+ *
+ * Device build flags: -D NMEA_REPLAY=\"/NMEA/drive.nmea\" (SD log) or -D NMEA_TRACK=1 (synthetic track
+ * from DEFAULT_LAT / DEFAULT_LON), -D NMEA_REPLAY_SPEED=N (0 -> max speed, default 1)
+ */
+
+#define REPLAY_MAX_SPEED 0
+#define REPLAY_EPOCH_BYTES 2048 // Buffered log line or synthetic epoch sentences
+#define REPLAY_READ_BYTES 256   // Log file read buffer
+#define REPLAY_MAX_GAP 1000     // Log time jumps (receiver off, midnight, ...) are replayed as this gap (ms)
+#define REPLAY_LOG_GAP 10000    // Log time jumps over this are considered gaps (ms)
+
+#ifndef NMEA_REPLAY_SPEED
+#define NMEA_REPLAY_SPEED 1
+#endif
+
+/**
+ * @brief Replay sources
+ *
+ */
+enum ReplaySource
+{
+  REPLAY_OFF,
+  REPLAY_LOG,
+  REPLAY_TRACK,
+};
+
+/**
+ * @brief Synthetic track: start position, constant speed and turn rate, epoch interval.
+ *        GSA and GSV sentences are sent once per second as real receivers do
+ *
+ */
+struct NmeaTrack
+{
+  double lat;
+  double lon;
+  float altitude;    // meters
+  float speed;       // Km/h
+  float course;      // degrees
+  float turn;        // degrees/s
+  uint16_t interval; // ms between epochs
+  uint32_t duration; // ms (0 -> endless)
+};
+
+/**
+ * @brief Replay state. Data is released when its simulated time (ms since replay start) is due
+ *
+ */
+struct NmeaReplay
+{
+  uint8_t source;
+  bool loop;
+  uint16_t speed;
+  uint32_t start;
+  File file;
+  NmeaTrack track;
+  char data[REPLAY_EPOCH_BYTES];
+  uint16_t len;
+  uint16_t pos;
+  uint32_t due;
+  int32_t log_time;
+  uint8_t read_buf[REPLAY_READ_BYTES];
+  uint16_t read_len;
+  uint16_t read_pos;
+  uint32_t epochs;
+  uint32_t bytes;
+};
+NmeaReplay nmea_replay = {};
+
+/**
+ * @brief Simulated satellites of synthetic track (per system: talker, first PRN and satellites)
+ *
+ */
+static const struct
+{
+  char talker[3];
+  uint8_t first_prn;
+  uint8_t count;
+  uint8_t gsa_id;
+} replay_sats[NMEA_SYSTEMS] = {
+    {"GP", 1, 12, 1}, {"GL", 65, 8, 2}, {"GA", 1, 0, 3}, {"BD", 1, 10, 4}, {"GQ", 193, 0, 5},
+};
+
+/**
+ * @brief Start log replay
+ *
+ * @param file -> NMEA log file
+ * @param speed -> replay speed (x times, REPLAY_MAX_SPEED as fast as possible)
+ * @param loop -> restart log when finished
+ * @return true if log is opened
+ */
+bool open_nmea_replay(File file, uint16_t speed, bool loop)
+{
+  if (!file)
+    return false;
+  nmea_replay = {};
+  nmea_replay.source = REPLAY_LOG;
+  nmea_replay.file = file;
+  nmea_replay.speed = speed;
+  nmea_replay.loop = loop;
+  nmea_replay.log_time = -1;
+  nmea_replay.start = millis();
+  return true;
+}
+
+/**
+ * @brief Start synthetic track replay
+ *
+ * @param track -> track
+ * @param speed -> replay speed (x times, REPLAY_MAX_SPEED as fast as possible)
+ */
+void start_nmea_track(const NmeaTrack &track, uint16_t speed)
+{
+  nmea_replay = {};
+  nmea_replay.source = REPLAY_TRACK;
+  nmea_replay.track = track;
+  if (nmea_replay.track.interval == 0)
+    nmea_replay.track.interval = 1000;
+  nmea_replay.speed = speed;
+  nmea_replay.start = millis();
+}
+
+/**
+ * @brief Replay simulated time (ms since replay start) from system clock and replay speed
+ *
+ * @return uint32_t -> simulated time
+ */
+uint32_t get_replay_clock()
+{
+  if (nmea_replay.speed == REPLAY_MAX_SPEED)
+    return UINT32_MAX;
+  return (millis() - nmea_replay.start) * nmea_replay.speed;
+}
+
+/**
+ * @brief Append sentence (without '$' and checksum) to replay data
+ *
+ * @param body -> sentence body
+ */
+static void add_replay_sentence(const char *body)
+{
+  uint8_t checksum = 0;
+  for (const char *c = body; *c; c++)
+    checksum ^= *c;
+  int len = snprintf(nmea_replay.data + nmea_replay.len, REPLAY_EPOCH_BYTES - nmea_replay.len, "$%s*%02X\r\n", body, checksum);
+  if (len > 0 && nmea_replay.len + len < REPLAY_EPOCH_BYTES)
+    nmea_replay.len += len;
+}
+
+/**
+ * @brief Generate next synthetic track epoch sentences and move track
+ *
+ * @return false if track is finished
+ */
+static bool next_track_epoch()
+{
+  NmeaTrack &track = nmea_replay.track;
+  uint32_t time = nmea_replay.epochs * track.interval;
+  if (track.duration > 0 && time >= track.duration)
+    return false;
+
+  uint32_t day_ms = (12 * 3600000 + time) % 86400000;
+  int hour = day_ms / 3600000, minute = (day_ms / 60000) % 60, second = (day_ms / 1000) % 60, ms = day_ms % 1000;
+  double lat = fabs(track.lat), lon = fabs(track.lon);
+  int lat_deg = (int)lat, lon_deg = (int)lon;
+  double lat_min = (lat - lat_deg) * 60.0, lon_min = (lon - lon_deg) * 60.0;
+  char ns = track.lat < 0 ? 'S' : 'N', ew = track.lon < 0 ? 'W' : 'E';
+  char body[128];
+
+  nmea_replay.len = 0;
+  nmea_replay.pos = 0;
+  snprintf(body, sizeof(body), "GNGGA,%02d%02d%02d.%03d,%02d%08.5f,%c,%03d%08.5f,%c,1,%02d,0.86,%.1f,M,49.6,M,,", hour,
+           minute, second, ms, lat_deg, lat_min, ns, lon_deg, lon_min, ew, 16, track.altitude);
+  add_replay_sentence(body);
+  snprintf(body, sizeof(body), "GNRMC,%02d%02d%02d.%03d,A,%02d%08.5f,%c,%03d%08.5f,%c,%.2f,%.2f,150623,,,A,V", hour, minute,
+           second, ms, lat_deg, lat_min, ns, lon_deg, lon_min, ew, track.speed / 1.852, track.course);
+  add_replay_sentence(body);
+  snprintf(body, sizeof(body), "GNVTG,%.2f,T,,M,%.2f,N,%.2f,K,A", track.course, track.speed / 1.852, track.speed);
+  add_replay_sentence(body);
+
+  if (time % 1000 < track.interval)
+  {
+    for (int system = 0; system < NMEA_SYSTEMS; system++)
+    {
+      if (replay_sats[system].count == 0)
+        continue;
+      int len = snprintf(body, sizeof(body), "GNGSA,A,3");
+      for (int i = 0; i < NMEA_GSA_SATS; i++)
+      {
+        if (i < replay_sats[system].count && i % 5 != 4)
+          len += snprintf(body + len, sizeof(body) - len, ",%02d", replay_sats[system].first_prn + i);
+        else
+          len += snprintf(body + len, sizeof(body) - len, ",");
+      }
+      snprintf(body + len, sizeof(body) - len, ",1.52,0.86,1.25,%d", replay_sats[system].gsa_id);
+      add_replay_sentence(body);
+    }
+
+    for (int system = 0; system < NMEA_SYSTEMS; system++)
+    {
+      int count = replay_sats[system].count;
+      int total = (count + 3) / 4;
+      for (int msg = 1; msg <= total; msg++)
+      {
+        int len = snprintf(body, sizeof(body), "%sGSV,%d,%d,%02d", replay_sats[system].talker, total, msg, count);
+        for (int i = (msg - 1) * 4; i < count && i < msg * 4; i++)
+        {
+          int elev = (i * 17 + system * 11 + time / 60000) % 90;
+          int azim = (i * 47 + system * 20 + time / 10000) % 360;
+          if (i % 5 == 4)
+            len += snprintf(body + len, sizeof(body) - len, ",%02d,%02d,%03d,", replay_sats[system].first_prn + i, elev, azim);
+          else
+            len += snprintf(body + len, sizeof(body) - len, ",%02d,%02d,%03d,%02d", replay_sats[system].first_prn + i, elev,
+                            azim, 20 + (i * 7) % 30);
+        }
+        snprintf(body + len, sizeof(body) - len, ",1");
+        add_replay_sentence(body);
+      }
+    }
+  }
+
+  double dist = track.speed / 3.6 * track.interval / 1000.0;
+  track.lat += dist * cos(radians(track.course)) / 111320.0;
+  track.lon += dist * sin(radians(track.course)) / (111320.0 * cos(radians(track.lat)));
+  track.course = fmod(track.course + track.turn * track.interval / 1000.0 + 360.0, 360.0);
+
+  nmea_replay.due = time;
+  nmea_replay.epochs++;
+  return true;
+}
+
+/**
+ * @brief Get UTC time of a GGA or RMC log line (ms of day)
+ *
+ * @param line -> NMEA sentence
+ * @param len -> sentence length
+ * @return int32_t -> time or -1 if line has no time
+ */
+static int32_t get_replay_line_time(const char *line, uint16_t len)
+{
+  if (len < 14 || line[0] != '$' || line[6] != ',' || !isdigit(line[7]))
+    return -1;
+  if (memcmp(line + 3, "GGA", 3) != 0 && memcmp(line + 3, "RMC", 3) != 0)
+    return -1;
+  int32_t hhmmss = 0;
+  for (int i = 7; i < 13; i++)
+    hhmmss = hhmmss * 10 + (line[i] - '0');
+  int32_t ms = 0;
+  if (line[13] == '.')
+  {
+    int32_t scale = 100;
+    for (int i = 14; i < len && isdigit(line[i]) && scale > 0; i++, scale /= 10)
+      ms += (line[i] - '0') * scale;
+  }
+  return (hhmmss / 10000) * 3600000 + ((hhmmss / 100) % 100) * 60000 + (hhmmss % 100) * 1000 + ms;
+}
+
+/**
+ * @brief Read next log line, new epoch (GGA or RMC with new time) moves due time by log time difference
+ *
+ * @return false if log is finished
+ */
+static bool next_log_line()
+{
+  nmea_replay.len = 0;
+  nmea_replay.pos = 0;
+  for (;;)
+  {
+    if (nmea_replay.read_pos == nmea_replay.read_len)
+    {
+      nmea_replay.read_len = nmea_replay.file.read(nmea_replay.read_buf, REPLAY_READ_BYTES);
+      nmea_replay.read_pos = 0;
+      if (nmea_replay.read_len == 0)
+      {
+        if (nmea_replay.len > 0)
+          break;
+        if (!nmea_replay.loop)
+          return false;
+        nmea_replay.file.seek(0);
+        nmea_replay.log_time = -1;
+        nmea_replay.due += REPLAY_MAX_GAP;
+        nmea_replay.read_len = nmea_replay.file.read(nmea_replay.read_buf, REPLAY_READ_BYTES);
+        if (nmea_replay.read_len == 0)
+          return false;
+      }
+    }
+    char c = nmea_replay.read_buf[nmea_replay.read_pos++];
+    if (nmea_replay.len < REPLAY_EPOCH_BYTES)
+      nmea_replay.data[nmea_replay.len++] = c;
+    if (c == '\n')
+      break;
+  }
+
+  int32_t time = get_replay_line_time(nmea_replay.data, nmea_replay.len);
+  if (time >= 0 && time != nmea_replay.log_time)
+  {
+    if (nmea_replay.log_time >= 0)
+    {
+      int32_t gap = time - nmea_replay.log_time;
+      nmea_replay.due += (gap > 0 && gap <= REPLAY_LOG_GAP) ? gap : REPLAY_MAX_GAP;
+    }
+    nmea_replay.log_time = time;
+    nmea_replay.epochs++;
+  }
+  return true;
+}
+
+/**
+ * @brief Read replay bytes due at simulated time
+ *
+ * @param buf -> buffer
+ * @param size -> buffer size
+ * @param clock -> simulated time (ms since replay start, see get_replay_clock)
+ * @return size_t -> bytes read (0 if nothing is due or replay is finished)
+ */
+size_t read_nmea_replay(uint8_t *buf, size_t size, uint32_t clock)
+{
+  size_t read = 0;
+  while (read < size && nmea_replay.source != REPLAY_OFF)
+  {
+    if (nmea_replay.pos == nmea_replay.len)
+    {
+      bool more = nmea_replay.source == REPLAY_LOG ? next_log_line() : next_track_epoch();
+      if (!more)
+      {
+        log_v("NMEA replay finished: %d epochs, %d bytes", nmea_replay.epochs, nmea_replay.bytes);
+        nmea_replay.file.close();
+        nmea_replay.source = REPLAY_OFF;
+        break;
+      }
+    }
+    if (nmea_replay.due > clock)
+      break;
+    size_t len = min(size - read, (size_t)(nmea_replay.len - nmea_replay.pos));
+    memcpy(buf + read, nmea_replay.data + nmea_replay.pos, len);
+    nmea_replay.pos += len;
+    nmea_replay.bytes += len;
+    read += len;
+  }
+  return read;
+}
+
+/**
+ * @brief Start replay selected with build flags (NMEA_REPLAY log on SD or NMEA_TRACK synthetic track)
+ *
+ */
+void init_nmea_replay()
+{
+#if defined(NMEA_REPLAY)
+  if (open_nmea_replay(SD.open(NMEA_REPLAY), NMEA_REPLAY_SPEED, true))
+    log_v("NMEA replay: %s at %dx", NMEA_REPLAY, NMEA_REPLAY_SPEED);
+  else
+    log_e("NMEA replay: can't open %s, using GPS", NMEA_REPLAY);
+#elif defined(NMEA_TRACK) && defined(DEFAULT_LAT)
+  NmeaTrack track = {DEFAULT_LAT, DEFAULT_LON, 120.0, 50.0, 0.0, 0.5, 1000, 0};
+  start_nmea_track(track, NMEA_REPLAY_SPEED);
+  log_v("NMEA replay: synthetic track at %dx", NMEA_REPLAY_SPEED);
+#endif
+}
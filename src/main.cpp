@@ -32,10 +32,24 @@ unsigned long millis_actual = 0;
 #include "hardware/bme.h"
 #endif
 #include "hardware/battery.h"
+#include "hardware/nmea.h"
+#include "hardware/casic.h"
+#include "hardware/gps_fix.h"
 #include "hardware/gps.h"
+#include "hardware/gps_rx.h"
+#include "hardware/nmea_replay.h"
+#include "hardware/gps_rate.h"
 #include "hardware/power.h"
+#include "utils/psram_arena.h"
 #include "utils/gps_maps.h"
+#include "utils/tile_pack.h"
+#include "utils/tile_codec.h"
+#include "utils/tile_index.h"
+#include "utils/tile_cache.h"
 #include "utils/gps_math.h"
+#include "utils/gps_filter.h"
+#include "utils/tile_prefetch.h"
+#include "utils/map_rotate.h"
 #include "utils/sat_info.h"
 #include "utils/lv_spiffs_fs.h"
 #include "utils/lv_sd_fs.h"
@@ -68,25 +82,53 @@ void setup()
   init_serial();
 #endif
   powerOn();
+  init_psram_arena();
   load_preferences();
   init_sd();
+  if (sdloaded)
+  {
+    init_tile_packs();
+    init_tile_format();
+    init_tile_index();
+  }
   init_SPIFFS();
   init_LVGL();
   init_tft();
+  init_gps_rx();
+  init_gps_fix();
   init_gps();
+  start_gps(warm_start.valid, warm_start.lat, warm_start.lon, warm_start.altitude);
   init_ADC();
 
-  map_spr.deleteSprite();
-  map_spr.createSprite(768, 768);
+  if (warm_start.zoom >= MIN_ZOOM && warm_start.zoom <= MAX_ZOOM)
+    zoom = warm_start.zoom;
+  arena_sprite(map_spr, ARENA_MAP, MAP_SPR_SIZE, MAP_SPR_SIZE);
+  init_tile_cache();
+#ifdef TILE_BENCHMARK
+  benchmark_tile_formats(DEF_ZOOM, lon2tilex(getLon(), DEF_ZOOM), lat2tiley(getLat(), DEF_ZOOM), 8);
+#endif
+  init_prefetch_task();
+  if (sdloaded)
+    init_nmea_replay();
+  init_gps_task();
 
   splash_scr();
   // init_tasks();
 
+  // Cached position: map opens at once (stale until first fix), satellite search screen is skipped
+  if (warm_start.valid)
+  {
+    set_map_cache(warm_start.lat, warm_start.lon);
+    load_main_screen();
+  }
+  else
+  {
 #ifdef DEFAULT_LAT
-  load_main_screen();
+    load_main_screen();
 #else
-  lv_scr_load(searchSat);
+    lv_scr_load(searchSat);
 #endif
+  }
 }
 
 /**
@@ -101,15 +143,4 @@ void loop()
 #endif
   lv_timer_handler();
   //lv_task_handler();
-  
-  while (gps->available()>0)
-  {
-#ifdef OUTPUT_NMEA
-    {
-      debug->write(gps->read());
-    }
-#else
-    GPS.encode(gps->read());
-#endif
-  }
 }
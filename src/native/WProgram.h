@@ -0,0 +1,28 @@
+/**
+ * @file WProgram.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Minimal Arduino core header for libraries built on host (TinyGPSPlus in nmea_bench)
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+typedef uint8_t byte;
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#define radians(deg) ((deg) * PI / 180.0)
+#define degrees(rad) ((rad) * 180.0 / PI)
+#endif
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+#define sq(x) ((x) * (x))
+
+uint32_t millis();
@@ -0,0 +1,197 @@
+/**
+ * @file casic_test.cpp
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Host (native) CASIC binary protocol test: AT6558D frames (NAV-PV, NAV-DOP, NAV-TIMEUTC, NAV-GPSINFO,
+ *         NAV-GLNINFO, ACK) fed byte by byte to the parser and decoded fields checked
+ * @version 0.1.6
+ * @date 2023-06-14
+ *
+ * usage: casic_test
+ *
+ * Frames are complete wire frames (sync, length, class, ID, payload, checksum) laid out as in the CASIC
+ * protocol document, not built with build_casic_frame. Exit code is the number of failed checks.
+ */
+
+#include "native/native.h"
+#include "hardware/nmea.h"
+#include "hardware/casic.h"
+
+static uint32_t failed = 0;
+
+#define CHECK(cond, ...)                        \
+  do                                            \
+  {                                             \
+    if (!(cond))                                \
+    {                                           \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__);                      \
+      printf("\n");                             \
+      failed++;                                 \
+    }                                           \
+  } while (0)
+
+/**
+ * @brief Test frames
+ *
+ *        NAV-PV: 3D fix, 11 SVs (6 GPS, 3 BDS, 2 GLN), pDop 1.75, lon 2.1734, lat 41.3851, height 150.5 m,
+ *        sepGeoid 49.5 m, hAcc 3.2, vAcc 4.5, velN 1.1, velE 12.45, velU -0.2, speed3D 13.0, speed2D 12.5 m/s,
+ *        heading 87.25, sAcc 0.5, cAcc 2.0
+ *
+ *        NAV-DOP: pDop 1.75, hDop 1.25, vDop 1.5, nDop 0.875, eDop 0.75, tDop 1.0
+ *        NAV-TIMEUTC: 2024-05-17 10:20:30.250, time and date valid
+ *        NAV-GPSINFO: 3 in view, 2 used (PRN 5, 12), PRN 25 elevation -2
+ *        NAV-GLNINFO: 1 in view, slot 3 used
+ *        ACK-ACK CFG-RATE, ACK-NAK CFG-MSG
+ *
+ */
+static const uint8_t pv_frame[] = {
+    0xBA, 0xCE, 0x50, 0x00, 0x01, 0x03, 0x40, 0xE2, 0x01, 0x00, 0x07, 0x07, 0x07, 0x0B, 0x06, 0x03,
+    0x02, 0x00, 0x00, 0x00, 0xE0, 0x3F, 0xDE, 0x02, 0x09, 0x8A, 0x1F, 0x63, 0x01, 0x40, 0x45, 0xD8,
+    0xF0, 0xF4, 0x4A, 0xB1, 0x44, 0x40, 0x00, 0x80, 0x16, 0x43, 0x00, 0x00, 0x46, 0x42, 0xCD, 0xCC,
+    0x4C, 0x40, 0x00, 0x00, 0x90, 0x40, 0xCD, 0xCC, 0x8C, 0x3F, 0x33, 0x33, 0x47, 0x41, 0xCD, 0xCC,
+    0x4C, 0xBE, 0x00, 0x00, 0x50, 0x41, 0x00, 0x00, 0x48, 0x41, 0x00, 0x80, 0xAE, 0x42, 0x00, 0x00,
+    0x00, 0x3F, 0x00, 0x00, 0x00, 0x40, 0xC3, 0x75, 0xCC, 0xD6,
+};
+static const uint8_t dop_frame[] = {
+    0xBA, 0xCE, 0x1C, 0x00, 0x01, 0x01, 0x40, 0xE2, 0x01, 0x00, 0x00, 0x00, 0xE0, 0x3F, 0x00, 0x00,
+    0xA0, 0x3F, 0x00, 0x00, 0xC0, 0x3F, 0x00, 0x00, 0x60, 0x3F, 0x00, 0x00, 0x40, 0x3F, 0x00, 0x00,
+    0x80, 0x3F, 0x5C, 0xE2, 0x62, 0x7E,
+};
+static const uint8_t timeutc_frame[] = {
+    0xBA, 0xCE, 0x18, 0x00, 0x01, 0x10, 0x40, 0xE2, 0x01, 0x00, 0xAC, 0xC5, 0x27, 0x37, 0x00, 0x00,
+    0x00, 0x00, 0xFA, 0x00, 0xE8, 0x07, 0x05, 0x11, 0x0A, 0x14, 0x1E, 0x01, 0x00, 0x01, 0x21, 0xBB,
+    0x1C, 0x64,
+};
+static const uint8_t gpsinfo_frame[] = {
+    0xBA, 0xCE, 0x2C, 0x00, 0x01, 0x20, 0x40, 0xE2, 0x01, 0x00, 0x03, 0x02, 0x00, 0x00, 0x00, 0x05,
+    0x01, 0x07, 0x2A, 0x23, 0x78, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0C, 0x01, 0x07, 0x26, 0x3C,
+    0x2C, 0x01, 0x00, 0x00, 0x00, 0x00, 0x02, 0x19, 0x00, 0x07, 0x14, 0xFE, 0x0F, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0xD6, 0x6B, 0xB9, 0x36,
+};
+static const uint8_t glninfo_frame[] = {
+    0xBA, 0xCE, 0x14, 0x00, 0x01, 0x22, 0x40, 0xE2, 0x01, 0x00, 0x01, 0x01, 0x02, 0x00, 0x00, 0x03,
+    0x01, 0x07, 0x21, 0x30, 0xD2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x76, 0x16, 0xD8, 0x29,
+};
+static const uint8_t ack_frame[] = {
+    0xBA, 0xCE, 0x04, 0x00, 0x05, 0x01, 0x06, 0x04, 0x00, 0x00, 0x0A, 0x04, 0x05, 0x01,
+};
+static const uint8_t nak_frame[] = {
+    0xBA, 0xCE, 0x04, 0x00, 0x05, 0x00, 0x06, 0x01, 0x00, 0x00, 0x0A, 0x01, 0x05, 0x00,
+};
+
+static uint32_t epochs = 0;
+static void count_epoch() { epochs++; }
+
+/**
+ * @brief Feed frame to parser byte by byte
+ *
+ * @return uint32_t -> decoded frames
+ */
+static uint32_t feed(const uint8_t *frame, size_t size)
+{
+  uint32_t decoded = 0;
+  for (size_t i = 0; i < size; i++)
+    decoded += encode_casic(frame[i]);
+  return decoded;
+}
+
+static bool near(double value, double expected, double tolerance) { return fabs(value - expected) <= tolerance; }
+
+static void test_pv()
+{
+  uint16_t updated = nmea_updated;
+  CHECK(feed(pv_frame, sizeof(pv_frame)) == 1, "NAV-PV not decoded");
+  CHECK(near(nmea_fix.lat, 41.3851, 1e-9) && near(nmea_fix.lon, 2.1734, 1e-9), "position %.7f,%.7f", nmea_fix.lat,
+        nmea_fix.lon);
+  CHECK(near(nmea_fix.altitude, 101.0, 1e-3), "altitude %.3f, 101.0 expected", nmea_fix.altitude);
+  CHECK(near(nmea_fix.speed, 45.0, 1e-3), "speed %.3f km/h, 45.0 expected", nmea_fix.speed);
+  CHECK(near(nmea_fix.course, 87.25, 1e-3), "course %.3f, 87.25 expected", nmea_fix.course);
+  CHECK(nmea_gsa.pdop == 175, "pdop %d, 175 expected", nmea_gsa.pdop);
+  CHECK(nmea_fix.satellites == 11, "%d satellites, 11 expected", nmea_fix.satellites);
+  CHECK(nmea_fix.quality == 1 && nmea_gsa.fix_mode == 3, "quality %d fix mode %d", nmea_fix.quality,
+        nmea_gsa.fix_mode);
+  uint16_t expected = NMEA_LOCATION | NMEA_ALTITUDE | NMEA_SPEED | NMEA_COURSE | NMEA_SATELLITES | NMEA_FIX | NMEA_DOP;
+  CHECK((nmea_updated & ~updated) == expected, "updated flags 0x%04X", nmea_updated);
+  CHECK(epochs == 1, "%d epochs after NAV-PV", epochs);
+}
+
+static void test_dop()
+{
+  CHECK(feed(dop_frame, sizeof(dop_frame)) == 1, "NAV-DOP not decoded");
+  CHECK(nmea_gsa.pdop == 175 && nmea_gsa.hdop == 125 && nmea_gsa.vdop == 150, "dop %d %d %d", nmea_gsa.pdop,
+        nmea_gsa.hdop, nmea_gsa.vdop);
+  CHECK(nmea_fix.hdop == 125, "fix hdop %d", nmea_fix.hdop);
+}
+
+static void test_time()
+{
+  CHECK(feed(timeutc_frame, sizeof(timeutc_frame)) == 1, "NAV-TIMEUTC not decoded");
+  CHECK(nmea_fix.year == 2024 && nmea_fix.month == 5 && nmea_fix.day == 17, "date %d-%d-%d", nmea_fix.year,
+        nmea_fix.month, nmea_fix.day);
+  CHECK(nmea_fix.hour == 10 && nmea_fix.minute == 20 && nmea_fix.second == 30 && nmea_fix.centisecond == 25,
+        "time %d:%d:%d.%d", nmea_fix.hour, nmea_fix.minute, nmea_fix.second, nmea_fix.centisecond);
+  CHECK((nmea_fix.valid & (NMEA_TIME | NMEA_DATE)) == (NMEA_TIME | NMEA_DATE), "time and date not valid");
+}
+
+static void test_sats()
+{
+  CHECK(feed(gpsinfo_frame, sizeof(gpsinfo_frame)) == 1, "NAV-GPSINFO not decoded");
+  const NmeaGsv &gps = nmea_gsv[NMEA_GPS];
+  CHECK(gps.updated && gps.in_view == 3 && gps.count == 3, "GPS in view %d, %d sats", gps.in_view, gps.count);
+  CHECK(gps.sats[0].prn == 5 && gps.sats[0].snr == 42 && gps.sats[0].elev == 35 && gps.sats[0].azim == 120,
+        "GPS sat 0: prn %d snr %d elev %d azim %d", gps.sats[0].prn, gps.sats[0].snr, gps.sats[0].elev,
+        gps.sats[0].azim);
+  CHECK(gps.sats[1].prn == 12 && gps.sats[1].azim == 300, "GPS sat 1: prn %d azim %d", gps.sats[1].prn,
+        gps.sats[1].azim);
+  CHECK(gps.sats[2].prn == 25 && gps.sats[2].elev == 0, "GPS sat 2: prn %d elev %d", gps.sats[2].prn,
+        gps.sats[2].elev);
+  CHECK(nmea_gsa.used_count[NMEA_GPS] == 2 && nmea_gsa.used[NMEA_GPS][0] == 5 && nmea_gsa.used[NMEA_GPS][1] == 12,
+        "GPS used %d", nmea_gsa.used_count[NMEA_GPS]);
+
+  CHECK(feed(glninfo_frame, sizeof(glninfo_frame)) == 1, "NAV-GLNINFO not decoded");
+  const NmeaGsv &gln = nmea_gsv[NMEA_GLONASS];
+  CHECK(gln.count == 1 && gln.sats[0].prn == 67 && gln.sats[0].snr == 33, "GLONASS sat prn %d snr %d",
+        gln.sats[0].prn, gln.sats[0].snr);
+  CHECK(nmea_gsa.used_count[NMEA_GLONASS] == 1, "GLONASS used %d", nmea_gsa.used_count[NMEA_GLONASS]);
+}
+
+static void test_ack()
+{
+  CHECK(feed(ack_frame, sizeof(ack_frame)) == 1, "ACK-ACK not decoded");
+  CHECK(casic_last_ack == ((CASIC_CFG << 8) | CASIC_CFG_RATE), "last ack 0x%04X", casic_last_ack);
+  CHECK(feed(nak_frame, sizeof(nak_frame)) == 1, "ACK-NAK not decoded");
+  CHECK(casic_last_nak == ((CASIC_CFG << 8) | CASIC_CFG_MSG), "last nak 0x%04X", casic_last_nak);
+}
+
+/**
+ * @brief NMEA text and a corrupted frame between frames are skipped, parser resyncs on next frame
+ *
+ */
+static void test_resync()
+{
+  const char *text = "$GNGGA,102030.25,4123.106,N,00210.404,E,1,11,1.2,101.0,M,49.5,M,,*4B\r\n";
+  CHECK(feed((const uint8_t *)text, strlen(text)) == 0, "NMEA text decoded as frame");
+
+  uint8_t bad[sizeof(pv_frame)];
+  memcpy(bad, pv_frame, sizeof(bad));
+  bad[30] ^= 0x40;
+  uint32_t errors = casic_checksum_errors;
+  CHECK(feed(bad, sizeof(bad)) == 0, "corrupted frame decoded");
+  CHECK(casic_checksum_errors == errors + 1, "checksum error not counted");
+  CHECK(feed(pv_frame, sizeof(pv_frame)) == 1, "no resync after corrupted frame");
+}
+
+int main()
+{
+  on_nmea_epoch = count_epoch;
+  test_pv();
+  test_dop();
+  test_time();
+  test_sats();
+  test_ack();
+  test_resync();
+
+  printf("frames: %d, checksum errors %d, unknown %d\n", casic_frames, casic_checksum_errors, casic_unknown);
+  printf("%s: %d failed checks\n", failed == 0 ? "PASS" : "FAIL", failed);
+  return failed;
+}
@@ -0,0 +1,150 @@
+/**
+ * @file codec_bench.cpp
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Host (native) tile codec benchmark: decode time of palette + RLE tiles (decode_ipt_tile) against
+ *         PNG tiles (libpng) from memory, compressed sizes and pixel check
+ * @version 0.1.6
+ * @date 2023-06-14
+ *
+ * usage: codec_bench <tiles dir> [--runs N]
+ *
+ * Tiles dir is the output of tools/png2ipt.py --keep-png (zoom/x/y.ipt with zoom/x/y.png next to it).
+ * Tiles are read before timing, only decode is measured. Decoded tiles must match pixel by pixel unless the PNG
+ * tile has more than 256 colors (quantized by png2ipt.py). Exit code is the number of tiles that fail to decode
+ * or don't match.
+ */
+
+#include "native/native.h"
+#include "utils/psram_arena.h"
+#include "utils/gps_maps.h"
+#include "utils/tile_codec.h"
+#include <ftw.h>
+#include <set>
+
+/**
+ * @brief Tile pair (same tile in both formats)
+ *
+ */
+struct CodecTile
+{
+  std::string path;
+  std::vector<uint8_t> ipt;
+  std::vector<uint8_t> png;
+};
+
+static std::vector<CodecTile> tiles;
+
+/**
+ * @brief Read whole file
+ *
+ */
+static bool read_file(const std::string &path, std::vector<uint8_t> &data)
+{
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == NULL)
+    return false;
+  fseek(file, 0, SEEK_END);
+  data.resize(ftell(file));
+  fseek(file, 0, SEEK_SET);
+  bool read = fread(data.data(), 1, data.size(), file) == data.size();
+  fclose(file);
+  return read;
+}
+
+/**
+ * @brief Add .ipt tiles with a .png tile next to them
+ *
+ */
+static int add_tile(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+  std::string ipt = path;
+  if (flag != FTW_F || ipt.size() < 4 || ipt.compare(ipt.size() - 4, 4, ".ipt") != 0)
+    return 0;
+  CodecTile tile;
+  tile.path = ipt.substr(0, ipt.size() - 4);
+  if (read_file(ipt, tile.ipt) && read_file(tile.path + ".png", tile.png))
+    tiles.push_back(std::move(tile));
+  return 0;
+}
+
+/**
+ * @brief Count different colors of a decoded tile
+ *
+ */
+static size_t count_colors(const uint16_t *buffer)
+{
+  std::set<uint16_t> colors(buffer, buffer + (tileSize * tileSize));
+  return colors.size();
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    printf("usage: codec_bench <tiles dir> [--runs N]\n");
+    return 1;
+  }
+  uint32_t runs = 10;
+  for (int i = 2; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "--runs") == 0)
+      runs = max(atoi(argv[i + 1]), 1);
+  }
+
+  nftw(argv[1], add_tile, 16, FTW_PHYS);
+  if (tiles.empty())
+  {
+    printf("no .ipt tiles with .png tile found in %s\n", argv[1]);
+    return 1;
+  }
+
+  static uint16_t ipt_buf[256 * 256];
+  static uint16_t png_buf[256 * 256];
+  TFT_eSprite png_spr = TFT_eSprite(&tft);
+  png_spr.setBuffer(png_buf, tileSize, tileSize);
+
+  uint64_t ipt_us = 0, png_us = 0, ipt_bytes = 0, png_bytes = 0;
+  uint32_t failed = 0, quantized = 0;
+
+  for (const CodecTile &tile : tiles)
+  {
+    ipt_bytes += tile.ipt.size();
+    png_bytes += tile.png.size();
+
+    bool ipt_ok = true, png_ok = true;
+    uint32_t start = micros();
+    for (uint32_t run = 0; run < runs; run++)
+      ipt_ok &= decode_ipt_tile(tile.ipt.data(), tile.ipt.size(), ipt_buf, tileSize);
+    ipt_us += micros() - start;
+
+    start = micros();
+    for (uint32_t run = 0; run < runs; run++)
+      png_ok &= png_spr.drawPng(tile.png.data(), tile.png.size(), 0, 0);
+    png_us += micros() - start;
+
+    if (!ipt_ok || !png_ok)
+    {
+      printf("%s: %s decode failed\n", tile.path.c_str(), ipt_ok ? "png" : "ipt");
+      failed++;
+    }
+    else if (memcmp(ipt_buf, png_buf, TILE_BYTES) != 0)
+    {
+      if (count_colors(png_buf) > 256)
+        quantized++;
+      else
+      {
+        printf("%s: ipt tile doesn't match png tile\n", tile.path.c_str());
+        failed++;
+      }
+    }
+  }
+
+  uint32_t decodes = tiles.size() * runs;
+  printf("tiles: %d (%d quantized)  png: %llu bytes  ipt: %llu bytes (%llu%%)\n", (int)tiles.size(), quantized,
+         (unsigned long long)png_bytes, (unsigned long long)ipt_bytes,
+         (unsigned long long)(ipt_bytes * 100 / png_bytes));
+  printf("decode: png (libpng) %.1f us/tile  ipt %.1f us/tile  (x%.1f)\n", (double)png_us / decodes,
+         (double)ipt_us / decodes, ipt_us > 0 ? (double)png_us / ipt_us : 0.0);
+  printf("%s: %d failed tiles\n", failed == 0 ? "PASS" : "FAIL", failed);
+  return failed;
+}
@@ -0,0 +1,268 @@
+/**
+ * @file filter_bench.cpp
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Host (native) GPS filter benchmark: position error and cost of the Kalman filter (gps_filter.h)
+ *         against holding last fix, on a simulated drive or a recorded NMEA log
+ * @version 0.1.6
+ * @date 2023-06-14
+ *
+ * usage: filter_bench [NMEA log] [--rate HZ] [--noise M] [--outliers P] [--seed N]
+ *
+ * Without log a scripted drive (stops, straights, turns and a roundabout) is simulated: fixes at rate Hz with
+ * noise M meters sigma and P outlier probability (multipath, 30-100 m), compass heading with 3 degrees noise.
+ * Errors against true position are measured at display rate (UPDATE_MAINSCR_PERIOD).
+ * With a log there is no true position: error is measured one epoch ahead (prediction at next fix time
+ * against next fix).
+ */
+
+#include "native/native.h"
+#include "hardware/nmea.h"
+#include "hardware/gps_fix.h"
+#include "utils/gps_filter.h"
+#include <random>
+#include <vector>
+
+#define UPDATE_MAINSCR_PERIOD 30
+#define SIM_STEP 10 // ms
+
+/**
+ * @brief Simulated drive segments: duration, target speed and turn rate
+ *
+ */
+static const struct
+{
+  uint32_t duration; // ms
+  float speed;       // m/s
+  float turn;        // degrees/s
+} drive[] = {
+    {10000, 0.0f, 0.0f},  {30000, 14.0f, 0.0f}, {15000, 14.0f, 6.0f},  {20000, 25.0f, 0.0f}, {10000, 8.0f, 0.0f},
+    {12000, 8.0f, -25.0f}, {30000, 14.0f, 0.0f}, {20000, 5.0f, 10.0f}, {10000, 0.0f, 0.0f}, {40000, 30.0f, 1.0f},
+};
+
+/**
+ * @brief Error statistics (meters)
+ *
+ */
+struct ErrorStats
+{
+  double sum2;
+  double max;
+  double step_max;
+  uint32_t count;
+
+  void add(double error)
+  {
+    sum2 += error * error;
+    if (error > max)
+      max = error;
+    count++;
+  }
+  double rms() const { return count > 0 ? sqrt(sum2 / count) : 0.0; }
+};
+
+static uint64_t micros64()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - native_start).count();
+}
+
+/**
+ * @brief Distance in meters between two close positions
+ *
+ */
+static double distance(double lat1, double lon1, double lat2, double lon2)
+{
+  double dn = (lat2 - lat1) * GPS_FILTER_M_PER_DEG;
+  double de = (lon2 - lon1) * GPS_FILTER_M_PER_DEG * cos(radians(lat1));
+  return sqrt(dn * dn + de * de);
+}
+
+/**
+ * @brief Print error statistics
+ *
+ */
+static void print_stats(const char *name, const ErrorStats &stats, bool steps)
+{
+  printf("%-8s error RMS %6.2f m, max %7.2f m", name, stats.rms(), stats.max);
+  if (steps)
+    printf(", max step between frames %6.2f m", stats.step_max);
+  printf("\n");
+}
+
+/**
+ * @brief Simulated drive
+ *
+ */
+static void simulate(float rate, float noise, float outliers, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> normal(0.0f, 1.0f);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+  double lat = 41.3851, lon = 2.1734;
+  float speed = 0.0f, course = 0.0f;
+  uint32_t interval = (uint32_t)(1000 / rate);
+  uint32_t time = 0, next_fix = 0, next_frame = 0, outlier_count = 0;
+  double hold_lat = 0.0, hold_lon = 0.0, last_hold_lat = 0.0, last_hold_lon = 0.0;
+  double last_lat = 0.0, last_lon = 0.0;
+  bool has_fix = false, has_frame = false;
+  ErrorStats hold = {}, filter = {};
+  uint64_t update_us = 0, predict_us = 0;
+  uint32_t predictions = 0;
+
+  for (const auto &segment : drive)
+  {
+    for (uint32_t t = 0; t < segment.duration; t += SIM_STEP, time += SIM_STEP)
+    {
+      float dt = SIM_STEP * 0.001f;
+      speed += constrain(segment.speed - speed, -2.0f * dt, 2.0f * dt);
+      course = fmodf(course + segment.turn * dt + 360.0f, 360.0f);
+      lat += speed * dt * cos(radians(course)) / GPS_FILTER_M_PER_DEG;
+      lon += speed * dt * sin(radians(course)) / (GPS_FILTER_M_PER_DEG * cos(radians(lat)));
+      int16_t compass = (int16_t)(fmodf(course + normal(rng) * 3.0f + 360.0f, 360.0f));
+
+      if (time >= next_fix)
+      {
+        next_fix += interval;
+        float err_n = normal(rng) * noise, err_e = normal(rng) * noise;
+        if (uniform(rng) < outliers)
+        {
+          float offset = 30.0f + uniform(rng) * 70.0f, angle = uniform(rng) * 2 * PI;
+          err_n += offset * cosf(angle);
+          err_e += offset * sinf(angle);
+          outlier_count++;
+        }
+        nmea_fix.lat = lat + err_n / GPS_FILTER_M_PER_DEG;
+        nmea_fix.lon = lon + err_e / (GPS_FILTER_M_PER_DEG * cos(radians(lat)));
+        nmea_fix.speed = max(speed + normal(rng) * 0.2f, 0.0f) * 3.6f;
+        nmea_fix.course = fmodf(course + normal(rng) * 2.0f + 360.0f, 360.0f);
+        nmea_fix.hdop = noise / GPS_FILTER_UERE * 100;
+        nmea_fix.quality = 1;
+        nmea_fix.valid = NMEA_LOCATION | NMEA_SPEED | NMEA_COURSE;
+        native_millis = time;
+        publish_gps_fix();
+
+        GpsFix fix;
+        read_gps_fix(fix);
+        uint64_t start = micros64();
+        update_gps_filter(fix, compass);
+        update_us += micros64() - start;
+        hold_lat = fix.lat;
+        hold_lon = fix.lon;
+        has_fix = true;
+      }
+
+      if (time >= next_frame && has_fix)
+      {
+        next_frame += UPDATE_MAINSCR_PERIOD;
+        double filter_lat, filter_lon;
+        uint64_t start = micros64();
+        get_gps_filter_position(time, compass, filter_lat, filter_lon);
+        predict_us += micros64() - start;
+        predictions++;
+
+        hold.add(distance(lat, lon, hold_lat, hold_lon));
+        filter.add(distance(lat, lon, filter_lat, filter_lon));
+        if (has_frame)
+        {
+          hold.step_max = max(hold.step_max, distance(last_hold_lat, last_hold_lon, hold_lat, hold_lon));
+          filter.step_max = max(filter.step_max, distance(last_lat, last_lon, filter_lat, filter_lon));
+        }
+        last_hold_lat = hold_lat;
+        last_hold_lon = hold_lon;
+        last_lat = filter_lat;
+        last_lon = filter_lon;
+        has_frame = true;
+      }
+    }
+  }
+
+  printf("simulated drive: %d s, %.1f Hz fixes, %.1f m noise, %d outliers in %d fixes\n", time / 1000, rate, noise,
+         outlier_count, gps_filter.updates);
+  print_stats("hold", hold, true);
+  print_stats("filter", filter, true);
+  printf("filter: %d rejected, %d resets, %.2f us/update, %.2f us/prediction\n", gps_filter.rejected,
+         gps_filter.resets, (double)update_us / max(gps_filter.updates, (uint32_t)1),
+         (double)predict_us / max(predictions, (uint32_t)1));
+}
+
+/**
+ * @brief Recorded log fixes (stamped with NMEA time)
+ *
+ */
+static std::vector<GpsFix> log_fixes;
+
+static void publish_log_fix()
+{
+  native_millis = ((nmea_fix.hour * 60 + nmea_fix.minute) * 60 + nmea_fix.second) * 1000 + nmea_fix.centisecond * 10;
+  publish_gps_fix();
+  GpsFix fix;
+  read_gps_fix(fix);
+  if (fix.quality > 0 && (fix.valid & NMEA_LOCATION))
+    log_fixes.push_back(fix);
+}
+
+/**
+ * @brief Recorded log (one epoch ahead prediction error)
+ *
+ */
+static bool replay_log(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  on_nmea_epoch = publish_log_fix;
+  int c;
+  while ((c = fgetc(file)) != EOF)
+    encode_nmea(c);
+  fclose(file);
+
+  ErrorStats hold = {}, filter = {};
+  uint64_t update_us = 0;
+  for (size_t i = 0; i + 1 < log_fixes.size(); i++)
+  {
+    uint64_t start = micros64();
+    update_gps_filter(log_fixes[i], -1);
+    update_us += micros64() - start;
+    const GpsFix &next = log_fixes[i + 1];
+    double lat, lon;
+    get_gps_filter_position(next.time, -1, lat, lon);
+    hold.add(distance(next.lat, next.lon, log_fixes[i].lat, log_fixes[i].lon));
+    filter.add(distance(next.lat, next.lon, lat, lon));
+  }
+
+  printf("log: %s, %zu fixes (one epoch ahead error against next fix)\n", path, log_fixes.size());
+  print_stats("hold", hold, false);
+  print_stats("filter", filter, false);
+  printf("filter: %d rejected, %d resets, %.2f us/update\n", gps_filter.rejected, gps_filter.resets,
+         (double)update_us / max(gps_filter.updates, (uint32_t)1));
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = NULL;
+  float rate = 1.0f, noise = 3.0f, outliers = 0.03f;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+      rate = max((float)atof(argv[++i]), 0.1f);
+    else if (strcmp(argv[i], "--noise") == 0 && i + 1 < argc)
+      noise = atof(argv[++i]);
+    else if (strcmp(argv[i], "--outliers") == 0 && i + 1 < argc)
+      outliers = atof(argv[++i]);
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+      seed = atoi(argv[++i]);
+    else
+      path = argv[i];
+  }
+
+  if (path == NULL)
+    simulate(rate, noise, outliers, seed);
+  else if (!replay_log(path))
+  {
+    printf("can't read %s\n", path);
+    return 1;
+  }
+  return 0;
+}
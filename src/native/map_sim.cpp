@@ -0,0 +1,297 @@
+/**
+ * @file map_sim.cpp
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Host (native) map rendering pipeline: renders map frames for a recorded NMEA log or a synthetic
+ *         track (replayed on a simulated clock) from a local tile directory, dumps frames and reports
+ *         per-stage timings
+ * @version 0.1.6
+ * @date 2023-06-14
+ *
+ * usage: map_sim <SD root (with MAP folder)> [--lat LAT] [--lon LON] [--zoom Z] [--frames N]
+ *                [--speed KMH] [--course DEG] [--turn DEG_PER_S] [--gps-rate HZ] [--nmea LOG] [--replay-speed N]
+ *                [--dump DIR] [--dump-every N] [--pan FRAME] [--zoom-in FRAME] [--zoom-out FRAME]
+ *
+ * --pan enters free pan mode at FRAME (long press) and drags the map for PAN_DRAG_FRAMES frames (then
+ * inertial scrolling), --zoom-in / --zoom-out send a vertical swipe at FRAME.
+ * PNG tiles are decoded with libpng.
+ */
+
+#include "native/native.h"
+#include "hardware/nmea.h"
+#include "hardware/gps_fix.h"
+#include "hardware/nmea_replay.h"
+#include "utils/psram_arena.h"
+#include "utils/gps_maps.h"
+#include "utils/tile_pack.h"
+#include "utils/tile_codec.h"
+#include "utils/tile_index.h"
+#include "utils/tile_cache.h"
+#include "utils/gps_math.h"
+#include "utils/gps_filter.h"
+#include "utils/map_rotate.h"
+#include "gui/images/navigation.c"
+#include "gui/images/compass.c"
+#include "gui/images/zoom.c"
+#include "gui/images/speed.c"
+
+/**
+ * @brief Map screen state (stand-ins of LVGL screen objects and events/main_scr.h variables)
+ *
+ */
+#define UPDATE_MAINSCR_PERIOD 30
+#define MIN_ZOOM 6
+#define MAX_ZOOM 17
+#define DEF_ZOOM 17
+#define PAN_DRAG_FRAMES 30
+#define PAN_DRAG_X 12 // px per frame
+#define PAN_DRAG_Y 6
+enum tilename
+{
+  COMPASS,
+  MAP,
+  SATTRACK,
+};
+uint8_t act_tile = MAP;
+bool is_main_screen = true;
+lv_obj_t *tiles = NULL;
+lv_obj_t *map_tile = NULL;
+bool is_map_draw = false;
+bool map_found = false;
+MapTile OldMapTile = {(char *)"", 0, 0, 0};
+TFT_eSprite sprArrow = TFT_eSprite(&tft);
+TFT_eSprite map_spr = TFT_eSprite(&tft);
+TFT_eSprite map_rot = TFT_eSprite(&tft);
+TFT_eSprite zoom_spr = TFT_eSprite(&tft);
+uint8_t zoom = DEF_ZOOM;
+
+/**
+ * @brief Tile prefetch runs in its own task on device, not used on host
+ *
+ */
+void receive_prefetch_tiles() {}
+void send_prefetch_hint(double lon, double lat, double course, double speed, uint8_t zoom_level, bool zoom_in, bool zoom_out) {}
+void log_prefetch_stats() {}
+
+#include "gui/screens/Main/events/map_hud.h"
+#include "gui/screens/Main/events/map.h"
+
+/**
+ * @brief Write panel frame as PPM image
+ *
+ * @param path -> output file
+ */
+static bool write_frame(const char *path)
+{
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return false;
+  fprintf(file, "P6\n%d %d\n255\n", TFT_WIDTH, TFT_HEIGHT);
+  for (int i = 0; i < TFT_WIDTH * TFT_HEIGHT; i++)
+  {
+    uint16_t color = native_swap(tft.frame[i]);
+    uint8_t rgb[3] = {(uint8_t)((color >> 8) & 0xF8), (uint8_t)((color >> 3) & 0xFC), (uint8_t)((color << 3) & 0xF8)};
+    fwrite(rgb, 1, 3, file);
+  }
+  fclose(file);
+  return true;
+}
+
+/**
+ * @brief Time difference of a map counter that may be reset by map frame stats
+ *
+ */
+static uint32_t counter_delta(uint32_t before, uint32_t after)
+{
+  return after >= before ? after - before : after;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    printf("usage: %s <SD root> [--lat LAT] [--lon LON] [--zoom Z] [--frames N] [--speed KMH] [--course DEG]\n"
+           "       [--turn DEG_PER_S] [--gps-rate HZ] [--nmea LOG] [--replay-speed N] [--dump DIR] [--dump-every N]\n"
+           "       [--pan FRAME] [--zoom-in FRAME] [--zoom-out FRAME]\n",
+           argv[0]);
+    return 1;
+  }
+
+#ifdef DEFAULT_LAT
+  double lat = DEFAULT_LAT;
+  double lon = DEFAULT_LON;
+#else
+  double lat = 0.0;
+  double lon = 0.0;
+#endif
+  uint32_t frames = 300;
+  double speed = 50.0;
+  double course = 0.0;
+  double turn = 15.0;
+  uint32_t gps_rate = 10;
+  const char *nmea_log = NULL;
+  uint16_t replay_speed = 1;
+  const char *dump = NULL;
+  uint32_t dump_every = 10;
+  int64_t pan_frame = -1;
+  int64_t zoom_in_frame = -1;
+  int64_t zoom_out_frame = -1;
+
+  SD.root = argv[1];
+  for (int i = 2; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "--lat") == 0)
+      lat = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--lon") == 0)
+      lon = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--zoom") == 0)
+      zoom = constrain(atoi(argv[i + 1]), MIN_ZOOM, MAX_ZOOM);
+    else if (strcmp(argv[i], "--frames") == 0)
+      frames = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--speed") == 0)
+      speed = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--course") == 0)
+      course = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--turn") == 0)
+      turn = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--gps-rate") == 0)
+      gps_rate = constrain(atoi(argv[i + 1]), 1, 10);
+    else if (strcmp(argv[i], "--nmea") == 0)
+      nmea_log = argv[i + 1];
+    else if (strcmp(argv[i], "--replay-speed") == 0)
+      replay_speed = max(atoi(argv[i + 1]), 1);
+    else if (strcmp(argv[i], "--dump") == 0)
+      dump = argv[i + 1];
+    else if (strcmp(argv[i], "--dump-every") == 0)
+      dump_every = max(atoi(argv[i + 1]), 1);
+    else if (strcmp(argv[i], "--pan") == 0)
+      pan_frame = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--zoom-in") == 0)
+      zoom_in_frame = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--zoom-out") == 0)
+      zoom_out_frame = atoi(argv[i + 1]);
+  }
+
+  if (dump != NULL)
+    mkdir(dump, 0755);
+
+  if (nmea_log != NULL)
+  {
+    if (!open_nmea_replay(SD.open_path(nmea_log), replay_speed, false))
+    {
+      printf("can't open %s\n", nmea_log);
+      return 1;
+    }
+  }
+  else
+  {
+    NmeaTrack track = {lat, lon, 120.0, (float)speed, (float)course, (float)turn, (uint16_t)(1000 / gps_rate), 0};
+    start_nmea_track(track, replay_speed);
+  }
+
+  init_gps_fix();
+  init_psram_arena();
+  init_tile_packs();
+  init_tile_format();
+  init_tile_index();
+  arena_sprite(map_spr, ARENA_MAP, MAP_SPR_SIZE, MAP_SPR_SIZE);
+  init_tile_cache();
+  create_map_scr_sprites();
+  uint32_t init_io_us = native_io_us;
+  native_io_us = 0;
+
+  uint32_t push_us = 0;
+  uint32_t frame_us = 0;
+  uint32_t frame_max_us = 0;
+  uint32_t dumped = 0;
+  uint32_t nmea_us = 0;
+  uint32_t nmea_bytes = 0;
+  lv_event_t refresh = {LV_EVENT_REFRESH};
+
+  for (uint32_t frame = 0; frame < frames && nmea_replay.source != REPLAY_OFF; frame++)
+  {
+    // NMEA due at simulated time, one frame every UPDATE_MAINSCR_PERIOD ms
+    uint8_t data[256];
+    size_t len;
+    uint32_t clock = frame * UPDATE_MAINSCR_PERIOD * replay_speed;
+    native_millis = clock;
+    uint32_t start = micros();
+    while ((len = read_nmea_replay(data, sizeof(data), clock)) > 0)
+    {
+      for (size_t i = 0; i < len; i++)
+        encode_nmea(data[i]);
+      nmea_bytes += len;
+    }
+    nmea_us += micros() - start;
+    GpsFix fix;
+    read_gps_fix(fix);
+    native_heading = (int)fix.course;
+
+    // Scripted touch: long press and drag (pan mode), vertical swipes (zoom)
+    lv_event_t touch = {LV_EVENT_PRESSED};
+    if (frame == pan_frame)
+    {
+      map_pan_event(&touch);
+      touch.code = LV_EVENT_LONG_PRESSED;
+      map_pan_event(&touch);
+    }
+    else if (pan_frame >= 0 && frame > pan_frame && frame <= pan_frame + PAN_DRAG_FRAMES)
+    {
+      native_touch_vect = {PAN_DRAG_X, PAN_DRAG_Y};
+      touch.code = frame < pan_frame + PAN_DRAG_FRAMES ? LV_EVENT_PRESSING : LV_EVENT_RELEASED;
+      map_pan_event(&touch);
+    }
+    if (frame == zoom_in_frame || frame == zoom_out_frame)
+    {
+      native_gesture_dir = frame == zoom_in_frame ? LV_DIR_TOP : LV_DIR_BOTTOM;
+      get_zoom_value(&touch);
+      native_gesture_dir = LV_DIR_NONE;
+    }
+
+    check_arena_pressure();
+    uint32_t rendered = map_frames_rendered;
+    uint32_t push_before = map_push_us;
+    start = micros();
+    update_map(&refresh);
+    uint32_t elapsed = micros() - start;
+
+    if (map_frames_rendered != rendered)
+    {
+      push_us += counter_delta(push_before, map_push_us);
+      frame_us += elapsed;
+      frame_max_us = max(frame_max_us, elapsed);
+      if (dump != NULL && (map_frames_rendered % dump_every) == 0)
+      {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/frame_%05d.ppm", dump, frame);
+        if (write_frame(path))
+          dumped++;
+      }
+    }
+  }
+
+  release_map_scr();
+
+  uint32_t rendered = max(map_frames_rendered, (uint32_t)1);
+  uint32_t decoded = 0;
+  uint32_t decode_us = 0;
+  for (int i = 0; i < TILE_FORMATS; i++)
+  {
+    decoded += tile_decode_count[i];
+    decode_us += tile_decode_us[i];
+  }
+
+  printf("\nframes: %d rendered, %d skipped, %d dumped\n", map_frames_rendered, map_frames_skipped, dumped);
+  printf("frame: %d us avg, %d us max (render only, no panel transfer)\n", frame_us / rendered, frame_max_us);
+  printf("NMEA: %d epochs, %d bytes, %d sentences, %d checksum errors, %d us replay + parse, %d fixes published\n",
+         nmea_replay.epochs, nmea_bytes, nmea_sentences, nmea_checksum_errors, nmea_us, gps_fix_seq.load() / 2);
+  printf("GPS filter: %d fixes, %d rejected, %d resets\n", gps_filter.updates, gps_filter.rejected, gps_filter.resets);
+  printf("init I/O (packs, index): %d us\n", init_io_us);
+  printf("tile I/O: %d us total, %d us/frame\n", native_io_us, native_io_us / rendered);
+  printf("tile decode (incl. I/O): %d tiles, %d us/tile\n", decoded, decoded ? decode_us / decoded : 0);
+  printf("rotate: %d us/frame\n", map_rotate_us / rendered);
+  printf("HUD: %d us/frame (%d layer redraws)\n", map_hud_us / rendered, hud_redraws);
+  printf("push: %d us/frame\n", push_us / rendered);
+  log_tile_cache_stats();
+  log_arena_stats();
+  return 0;
+}
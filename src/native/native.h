@@ -0,0 +1,454 @@
+/**
+ * @file native.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Host (native) stand-ins for Arduino, SD, FreeRTOS, LovyanGFX and LVGL
+ *         used by the map rendering pipeline. PNG tiles are decoded with libpng (link with -lpng)
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <dirent.h>
+#include <png.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using std::max;
+using std::min;
+
+/**
+ * @brief Arduino / ESP32 core
+ *
+ */
+#define PROGMEM
+#define PSTR(s) (s)
+#define log_v(format, ...) printf("[V] " format "\n", ##__VA_ARGS__)
+#define log_d(format, ...) printf("[D] " format "\n", ##__VA_ARGS__)
+#define log_e(format, ...) printf("[E] " format "\n", ##__VA_ARGS__)
+#define ps_malloc malloc
+#define ps_calloc calloc
+#define ps_realloc realloc
+#define PI 3.1415926535897932384626433832795
+#define radians(deg) ((deg) * PI / 180.0)
+#define degrees(rad) ((rad) * 180.0 / PI)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+static const auto native_start = std::chrono::steady_clock::now();
+
+uint32_t micros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - native_start).count();
+}
+
+/**
+ * @brief Simulated time (ms) returned by millis when set (map_sim, filter_bench), micros keeps host clock
+ *
+ */
+int64_t native_millis = -1;
+
+uint32_t millis()
+{
+  if (native_millis >= 0)
+    return native_millis;
+  return micros() / 1000;
+}
+
+/**
+ * @brief ESP32 PSRAM info (host heap is never short)
+ *
+ */
+struct NativeESP
+{
+  uint32_t getPsramSize() { return 8 * 1024 * 1024; }
+  uint32_t getFreePsram() { return 8 * 1024 * 1024; }
+} ESP;
+
+/**
+ * @brief FreeRTOS (single thread on host)
+ *
+ */
+typedef void *SemaphoreHandle_t;
+#define portMAX_DELAY 0xFFFFFFFF
+#define xSemaphoreCreateMutex() ((SemaphoreHandle_t)1)
+#define xSemaphoreTake(mutex, wait) ((void)0)
+#define xSemaphoreGive(mutex) ((void)0)
+
+/**
+ * @brief SD card backed by a local directory (SD root). Time spent in open, seek and read is
+ *        accumulated as tile I/O time
+ *
+ */
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+uint32_t native_io_us = 0;
+
+struct NativeFile
+{
+  FILE *fp = NULL;
+  DIR *dir = NULL;
+  std::string path;
+  std::string name;
+  ~NativeFile()
+  {
+    if (fp != NULL)
+      fclose(fp);
+    if (dir != NULL)
+      closedir(dir);
+  }
+};
+
+class File
+{
+public:
+  File() {}
+  File(std::shared_ptr<NativeFile> file) : _file(file) {}
+  operator bool() const { return _file != NULL; }
+  bool isDirectory() { return _file != NULL && _file->dir != NULL; }
+  const char *name() { return _file->name.c_str(); }
+  void close() { _file.reset(); }
+
+  size_t read(uint8_t *buf, size_t size)
+  {
+    uint32_t start = micros();
+    size_t read = (_file != NULL && _file->fp != NULL) ? fread(buf, 1, size, _file->fp) : 0;
+    native_io_us += micros() - start;
+    return read;
+  }
+
+  size_t write(const uint8_t *buf, size_t size)
+  {
+    return (_file != NULL && _file->fp != NULL) ? fwrite(buf, 1, size, _file->fp) : 0;
+  }
+
+  bool seek(uint32_t pos)
+  {
+    uint32_t start = micros();
+    bool done = _file != NULL && _file->fp != NULL && fseek(_file->fp, pos, SEEK_SET) == 0;
+    native_io_us += micros() - start;
+    return done;
+  }
+
+  size_t size()
+  {
+    struct stat st;
+    return (_file != NULL && stat(_file->path.c_str(), &st) == 0) ? st.st_size : 0;
+  }
+
+  File openNextFile();
+
+private:
+  std::shared_ptr<NativeFile> _file;
+};
+
+class SDClass
+{
+public:
+  std::string root = ".";
+
+  File open(const char *path, const char *mode = FILE_READ)
+  {
+    uint32_t start = micros();
+    File file = open_path(root + path, mode);
+    native_io_us += micros() - start;
+    return file;
+  }
+
+  bool remove(const char *path) { return ::remove((root + path).c_str()) == 0; }
+
+  File open_path(const std::string &path, const char *mode = FILE_READ)
+  {
+    auto file = std::make_shared<NativeFile>();
+    file->path = path;
+    file->name = path.substr(path.find_last_of('/') + 1);
+    struct stat st;
+    if (strcmp(mode, FILE_WRITE) == 0)
+      file->fp = fopen(path.c_str(), "wb");
+    else if (stat(path.c_str(), &st) != 0)
+      return File();
+    else if (S_ISDIR(st.st_mode))
+      file->dir = opendir(path.c_str());
+    else
+      file->fp = fopen(path.c_str(), "rb");
+    if (file->dir == NULL && file->fp == NULL)
+      return File();
+    return File(file);
+  }
+};
+SDClass SD;
+
+File File::openNextFile()
+{
+  if (!isDirectory())
+    return File();
+  struct dirent *entry;
+  while ((entry = readdir(_file->dir)) != NULL)
+  {
+    if (entry->d_name[0] != '.')
+      return SD.open_path(_file->path + "/" + entry->d_name);
+  }
+  return File();
+}
+
+/**
+ * @brief Panel and sprites (RGB565 byte swapped in memory, like LGFX_Sprite).
+ *        Text is not rasterized on host (HUD layers are blended without digits)
+ *
+ */
+#define TFT_WIDTH 320
+#define TFT_HEIGHT 480
+#define TFT_BLACK 0x0000
+#define TFT_WHITE 0xFFFF
+#define LVGL_BKG 0x10A3
+
+namespace fonts
+{
+  static const int FreeSansBold9pt7b = 0;
+}
+
+static inline uint16_t native_swap(uint16_t color)
+{
+  return (color >> 8) | (color << 8);
+}
+
+class LGFX
+{
+public:
+  uint16_t frame[TFT_WIDTH * TFT_HEIGHT] = {};
+
+  void startWrite() {}
+  void endWrite() {}
+  void waitDMA() {}
+
+  void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data)
+  {
+    for (int32_t row = 0; row < h; row++)
+    {
+      if (y + row < 0 || y + row >= TFT_HEIGHT)
+        continue;
+      int32_t x0 = max(x, (int32_t)0);
+      int32_t x1 = min(x + w, (int32_t)TFT_WIDTH);
+      if (x1 > x0)
+        memcpy(frame + ((y + row) * TFT_WIDTH) + x0, data + (row * w) + (x0 - x), (x1 - x0) * sizeof(uint16_t));
+    }
+  }
+
+  void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data)
+  {
+    pushImage(x, y, w, h, data);
+  }
+};
+LGFX tft;
+
+class TFT_eSprite
+{
+public:
+  TFT_eSprite(LGFX *parent) : _parent(parent) {}
+
+  void *createSprite(int32_t w, int32_t h)
+  {
+    deleteSprite();
+    _buf = (uint16_t *)calloc(w * h, sizeof(uint16_t));
+    _owned = true;
+    _w = w;
+    _h = h;
+    setPivot(w / 2.0, h / 2.0);
+    return _buf;
+  }
+
+  void setBuffer(void *buf, int32_t w, int32_t h)
+  {
+    deleteSprite();
+    _buf = (uint16_t *)buf;
+    _w = w;
+    _h = h;
+    setPivot(w / 2.0, h / 2.0);
+  }
+
+  void deleteSprite()
+  {
+    if (_owned)
+      free(_buf);
+    _buf = NULL;
+    _owned = false;
+    _w = _h = 0;
+  }
+
+  void setColorDepth(int bits) {}
+  void *getBuffer() { return _buf; }
+  int32_t width() { return _w; }
+  int32_t height() { return _h; }
+  void setPivot(float x, float y)
+  {
+    _px = x;
+    _py = y;
+  }
+  float getPivotX() { return _px; }
+  float getPivotY() { return _py; }
+
+  void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color)
+  {
+    for (int32_t j = max(y, (int32_t)0); j < min(y + h, _h); j++)
+      for (int32_t i = max(x, (int32_t)0); i < min(x + w, _w); i++)
+        _buf[(j * _w) + i] = native_swap(color);
+  }
+  void fillSprite(uint32_t color) { fillRect(0, 0, _w, _h, color); }
+  void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color) { fillRect(x, y, w, 1, color); }
+  void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color) { fillRect(x, y, 1, h, color); }
+
+  void setTextColor(uint32_t fg, uint32_t bg) {}
+  void setTextSize(float size) {}
+  void drawNumber(long value, int32_t x, int32_t y, const void *font = NULL) {}
+  void drawCenterString(const char *text, int32_t x, int32_t y) {}
+  void drawString(const char *text, int32_t x, int32_t y, const void *font = NULL) {}
+
+  void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data, uint32_t transp = 0x10000)
+  {
+    for (int32_t j = 0; j < h; j++)
+      for (int32_t i = 0; i < w; i++)
+        put_pixel(x + i, y + j, data[(j * w) + i], transp);
+  }
+
+  void pushImageRotateZoom(float dst_x, float dst_y, float src_x, float src_y, float angle, float zoom_x, float zoom_y,
+                           int32_t w, int32_t h, const uint16_t *data, uint32_t transp)
+  {
+    rotate_zoom(this, dst_x, dst_y, src_x, src_y, angle, zoom_x, zoom_y, w, h, data, transp);
+  }
+
+  void pushRotateZoom(TFT_eSprite *dst, float dst_x, float dst_y, float angle, float zoom_x, float zoom_y, uint32_t transp)
+  {
+    rotate_zoom(dst, dst_x, dst_y, _px, _py, angle, zoom_x, zoom_y, _w, _h, _buf, transp);
+  }
+
+  void pushRotated(TFT_eSprite *dst, float angle, uint32_t transp)
+  {
+    pushRotateZoom(dst, dst->getPivotX(), dst->getPivotY(), angle, 1, 1, transp);
+  }
+
+  void pushSprite(int32_t x, int32_t y) { _parent->pushImage(x, y, _w, _h, _buf); }
+
+  bool drawPngFile(SDClass &fs, const char *path, int32_t x, int32_t y)
+  {
+    File file = fs.open(path, FILE_READ);
+    if (!file)
+      return false;
+    std::vector<uint8_t> data(file.size());
+    return file.read(data.data(), data.size()) == data.size() && drawPng(data.data(), data.size(), x, y);
+  }
+
+  bool drawPng(const uint8_t *data, uint32_t size, int32_t x, int32_t y)
+  {
+    png_image image = {};
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&image, data, size))
+      return false;
+    image.format = PNG_FORMAT_RGB;
+    std::vector<uint8_t> rgb(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, NULL, rgb.data(), 0, NULL))
+      return false;
+    for (uint32_t j = 0; j < image.height; j++)
+    {
+      const uint8_t *p = rgb.data() + (j * image.width * 3);
+      for (uint32_t i = 0; i < image.width; i++, p += 3)
+        put_pixel(x + i, y + j, native_swap(((p[0] & 0xF8) << 8) | ((p[1] & 0xFC) << 3) | (p[2] >> 3)), 0x10000);
+    }
+    return true;
+  }
+
+private:
+  LGFX *_parent;
+  uint16_t *_buf = NULL;
+  bool _owned = false;
+  int32_t _w = 0;
+  int32_t _h = 0;
+  float _px = 0;
+  float _py = 0;
+
+  void put_pixel(int32_t x, int32_t y, uint16_t color, uint32_t transp)
+  {
+    if (x >= 0 && y >= 0 && x < _w && y < _h && color != transp)
+      _buf[(y * _w) + x] = color;
+  }
+
+  static void rotate_zoom(TFT_eSprite *dst, float dst_x, float dst_y, float src_x, float src_y, float angle, float zoom_x,
+                          float zoom_y, int32_t w, int32_t h, const uint16_t *data, uint32_t transp)
+  {
+    float cos_a = cos(angle * M_PI / 180.0);
+    float sin_a = sin(angle * M_PI / 180.0);
+    int32_t radius = (int32_t)(sqrt((float)(w * w + h * h)) * max(zoom_x, zoom_y)) + 1;
+    for (int32_t y = -radius; y <= radius; y++)
+    {
+      for (int32_t x = -radius; x <= radius; x++)
+      {
+        int32_t sx = (int32_t)floor(src_x + ((x * cos_a) + (y * sin_a)) / zoom_x);
+        int32_t sy = (int32_t)floor(src_y + ((y * cos_a) - (x * sin_a)) / zoom_y);
+        if (sx >= 0 && sy >= 0 && sx < w && sy < h)
+          dst->put_pixel((int32_t)dst_x + x, (int32_t)dst_y + y, data[(sy * w) + sx], transp);
+      }
+    }
+  }
+};
+
+/**
+ * @brief LVGL (only what map screen events use)
+ *
+ */
+typedef void lv_obj_t;
+typedef void lv_indev_t;
+typedef int lv_event_code_t;
+typedef uint8_t lv_dir_t;
+struct lv_event_t
+{
+  lv_event_code_t code;
+};
+struct lv_point_t
+{
+  int16_t x;
+  int16_t y;
+};
+enum
+{
+  LV_EVENT_PRESSED,
+  LV_EVENT_PRESSING,
+  LV_EVENT_RELEASED,
+  LV_EVENT_LONG_PRESSED,
+  LV_EVENT_REFRESH,
+};
+enum
+{
+  LV_DIR_NONE,
+  LV_DIR_LEFT,
+  LV_DIR_RIGHT,
+  LV_DIR_TOP,
+  LV_DIR_BOTTOM,
+};
+#define LV_OBJ_FLAG_SCROLLABLE 0
+lv_point_t native_touch_vect = {};
+lv_dir_t native_gesture_dir = LV_DIR_NONE;
+static inline lv_event_code_t lv_event_get_code(lv_event_t *event) { return event->code; }
+static inline lv_obj_t *lv_event_get_current_target(lv_event_t *event) { return NULL; }
+static inline lv_indev_t *lv_indev_get_act() { return NULL; }
+static inline lv_dir_t lv_indev_get_gesture_dir(lv_indev_t *indev) { return native_gesture_dir; }
+static inline void lv_indev_get_vect(lv_indev_t *indev, lv_point_t *point) { *point = native_touch_vect; }
+static inline void lv_event_send(lv_obj_t *obj, lv_event_code_t code, void *param) {}
+static inline void lv_obj_add_flag(lv_obj_t *obj, int flag) {}
+static inline void lv_obj_clear_flag(lv_obj_t *obj, int flag) {}
+
+/**
+ * @brief Compass (heading set by scripted track)
+ *
+ */
+int heading = 0;
+int native_heading = 0;
+int get_heading()
+{
+  return native_heading;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file nmea_bench.cpp
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Host (native) NMEA parser benchmark: sentences per second of encode_nmea on a recorded
+ *         (or synthetic) multi-GNSS log, compared with TinyGPSPlus and its custom fields when available
+ * @version 0.1.6
+ * @date 2023-06-14
+ *
+ * usage: nmea_bench [NMEA log] [--epochs N] [--runs N]
+ *
+ * Without log a synthetic multi-GNSS log is generated with the replay synthetic track (see nmea_replay.h).
+ */
+
+#include "native/native.h"
+#include "hardware/nmea.h"
+#include "hardware/nmea_replay.h"
+
+#if __has_include(<TinyGPS++.h>)
+#include <TinyGPS++.h>
+#define BENCH_TINYGPS 1
+#endif
+
+static uint64_t micros64()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - native_start).count();
+}
+
+/**
+ * @brief Generate synthetic multi-GNSS log (NMEA 4.1, as sent by AT6558D with GPS+BDS+GLONASS at 1Hz)
+ *        from replay synthetic track
+ *
+ * @param epochs -> seconds of log
+ * @return std::string -> NMEA log
+ */
+static std::string synthetic_log(int epochs)
+{
+  std::string log;
+  NmeaTrack track = {41.3851, 2.1734, 120.0, 45.0, 0.0, 1.0, 1000, (uint32_t)epochs * 1000};
+  start_nmea_track(track, REPLAY_MAX_SPEED);
+  uint8_t data[256];
+  size_t len;
+  while ((len = read_nmea_replay(data, sizeof(data), get_replay_clock())) > 0)
+    log.append((const char *)data, len);
+  return log;
+}
+
+/**
+ * @brief Read NMEA log file
+ *
+ */
+static bool read_log(const char *path, std::string &log)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  char buffer[4096];
+  size_t len;
+  while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    log.append(buffer, len);
+  fclose(file);
+  return true;
+}
+
+#ifdef BENCH_TINYGPS
+/**
+ * @brief TinyGPSPlus with the custom fields registered by firmware before nmea.h (see init_gps)
+ *
+ */
+struct TinyGpsBench
+{
+  TinyGPSPlus gps;
+  TinyGPSCustom pdop, hdop, vdop, fix, fix_mode;
+  struct
+  {
+    TinyGPSCustom total, num, view, prn[4], elev[4], azim[4], snr[4];
+  } gsv[3];
+
+  TinyGpsBench()
+  {
+    static const char *gsv_id[3] = {"GPGSV", "GLGSV", "BDGSV"};
+    pdop.begin(gps, "GNGSA", 15);
+    hdop.begin(gps, "GNGSA", 16);
+    vdop.begin(gps, "GNGSA", 17);
+    fix.begin(gps, "GNGGA", 6);
+    fix_mode.begin(gps, "GNGSA", 2);
+    for (int s = 0; s < 3; s++)
+    {
+      gsv[s].total.begin(gps, gsv_id[s], 1);
+      gsv[s].num.begin(gps, gsv_id[s], 2);
+      gsv[s].view.begin(gps, gsv_id[s], 3);
+      for (int i = 0; i < 4; i++)
+      {
+        gsv[s].prn[i].begin(gps, gsv_id[s], 4 + 4 * i);
+        gsv[s].elev[i].begin(gps, gsv_id[s], 5 + 4 * i);
+        gsv[s].azim[i].begin(gps, gsv_id[s], 6 + 4 * i);
+        gsv[s].snr[i].begin(gps, gsv_id[s], 7 + 4 * i);
+      }
+    }
+  }
+};
+#endif
+
+int main(int argc, char **argv)
+{
+  const char *path = NULL;
+  int epochs = 3600;
+  int runs = 20;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--epochs") == 0 && i + 1 < argc)
+      epochs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+      runs = atoi(argv[++i]);
+    else
+      path = argv[i];
+  }
+
+  std::string log;
+  if (path != NULL)
+  {
+    if (!read_log(path, log))
+    {
+      printf("can't read %s\n", path);
+      return 1;
+    }
+  }
+  else
+    log = synthetic_log(epochs);
+
+  uint64_t start = micros64();
+  for (int run = 0; run < runs; run++)
+    for (char c : log)
+      encode_nmea(c);
+  uint64_t elapsed = micros64() - start;
+  uint32_t sentences = nmea_sentences / runs;
+  double nmea_rate = (double)nmea_sentences * 1e6 / elapsed;
+
+  printf("log: %s, %zu bytes, %d sentences (%d checksum errors, %d ignored)\n", path ? path : "synthetic", log.size(),
+         sentences, nmea_checksum_errors / runs, nmea_ignored / runs);
+  printf("encode_nmea: %.0f sentences/s, %.1f ns/byte\n", nmea_rate, elapsed * 1000.0 / ((double)log.size() * runs));
+  printf("last fix: %.6f %.6f alt %.1f m, %.1f Km/h, course %.1f, %d sats, fix mode %d, PDOP %d.%02d\n", nmea_fix.lat,
+         nmea_fix.lon, nmea_fix.altitude, nmea_fix.speed, nmea_fix.course, nmea_fix.satellites, nmea_gsa.fix_mode,
+         nmea_gsa.pdop / 100, nmea_gsa.pdop % 100);
+  for (int s = 0; s < NMEA_SYSTEMS; s++)
+    if (nmea_gsv[s].count > 0)
+      printf("system %d: %d in view, %d in GSV epoch, %d used in fix\n", s, nmea_gsv[s].in_view, nmea_gsv[s].count,
+             nmea_gsa.used_count[s]);
+
+#ifdef BENCH_TINYGPS
+  TinyGpsBench tiny;
+  start = micros64();
+  for (int run = 0; run < runs; run++)
+    for (char c : log)
+      tiny.gps.encode(c);
+  elapsed = micros64() - start;
+  double tiny_rate = (double)tiny.gps.passedChecksum() * 1e6 / elapsed;
+  printf("TinyGPSPlus: %.0f sentences/s, %.1f ns/byte (%.2fx)\n", tiny_rate,
+         elapsed * 1000.0 / ((double)log.size() * runs), nmea_rate / tiny_rate);
+  printf("TinyGPSPlus last fix: %.6f %.6f alt %.1f m, %.1f Km/h\n", tiny.gps.location.lat(), tiny.gps.location.lng(),
+         tiny.gps.altitude.meters(), tiny.gps.speed.kmph());
+#else
+  printf("TinyGPSPlus not available, build with env:native_nmea to compare\n");
+#endif
+  return 0;
+}
@@ -0,0 +1,7 @@
+/**
+ * @file pgmspace.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Host (native) stand-in for ESP32 pgmspace.h (PROGMEM is defined in native.h)
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
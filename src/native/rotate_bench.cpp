@@ -0,0 +1,169 @@
+/**
+ * @file rotate_bench.cpp
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Host (native) map rotation test and benchmark: rotate_wrap against a per pixel floating point
+ *         reference for every angle (pivots near the wrap, transparent key, partial blocks) and us/frame
+ * @version 0.1.6
+ * @date 2023-06-14
+ *
+ * usage: rotate_bench [--runs N]
+ *
+ * The reference maps every destination pixel to the source independently (double, same 16.16 sin/cos steps
+ * as the kernel), so rotated frames must match pixel by pixel. Exit code is the number of failed checks.
+ */
+
+#include "native/native.h"
+#include "utils/psram_arena.h"
+#include "utils/gps_maps.h"
+#include "utils/gps_math.h"
+#include "utils/map_rotate.h"
+#include <vector>
+
+#define KEY_COLOR 0xF81F
+#define BACKGROUND 0x1234
+
+static uint32_t failed = 0;
+
+#define CHECK(cond, ...)                        \
+  do                                            \
+  {                                             \
+    if (!(cond))                                \
+    {                                           \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__);                      \
+      printf("\n");                             \
+      failed++;                                 \
+    }                                           \
+  } while (0)
+
+/**
+ * @brief Source test pattern (some pixels are KEY_COLOR)
+ *
+ */
+static uint16_t src_pixel(int32_t x, int32_t y)
+{
+  if ((x * 13 + y * 7) % 23 == 0)
+    return KEY_COLOR;
+  return (uint16_t)((x * 40503) ^ (y * 9973) ^ (x >> 3) * (y >> 3));
+}
+
+/**
+ * @brief Kernel fixed point sin/cos step of an angle (as double)
+ *
+ */
+static double fixed_step(double value)
+{
+  return (int32_t)(value * 65536) / 65536.0;
+}
+
+/**
+ * @brief Reference rotation, each destination pixel computed on its own
+ *
+ */
+static void rotate_reference(const uint16_t *src, int32_t src_size, float pivot_x, float pivot_y, uint16_t *dst,
+                             int32_t dst_w, int32_t dst_h, int16_t angle, uint32_t key)
+{
+  double rad = DEGtoRAD(((angle % 360) + 360) % 360);
+  double c = fixed_step(cos(rad));
+  double s = fixed_step(sin(rad));
+  double fx = (int32_t)(pivot_x * 65536) / 65536.0;
+  double fy = (int32_t)(pivot_y * 65536) / 65536.0;
+  int32_t cx = dst_w >> 1, cy = dst_h >> 1;
+
+  for (int32_t y = 0; y < dst_h; y++)
+  {
+    for (int32_t x = 0; x < dst_w; x++)
+    {
+      int64_t sx = (int64_t)floor(fx + (x - cx) * c + (y - cy) * s) % src_size;
+      int64_t sy = (int64_t)floor(fy - (x - cx) * s + (y - cy) * c) % src_size;
+      if (sx < 0)
+        sx += src_size;
+      if (sy < 0)
+        sy += src_size;
+      uint16_t color = src[(sy * src_size) + sx];
+      if (key == ROTATE_NO_KEY || color != key)
+        dst[(y * dst_w) + x] = color;
+    }
+  }
+}
+
+/**
+ * @brief Check rotate_wrap against reference for every angle
+ *
+ */
+static void test_angles(const uint16_t *src, int32_t src_size, float pivot_x, float pivot_y, int32_t dst_w,
+                        int32_t dst_h, uint32_t key)
+{
+  std::vector<uint16_t> dst(dst_w * dst_h), ref(dst_w * dst_h);
+  uint32_t bad_angles = 0;
+  for (int16_t angle = -360; angle < 720; angle++)
+  {
+    std::fill(dst.begin(), dst.end(), BACKGROUND);
+    std::fill(ref.begin(), ref.end(), BACKGROUND);
+    rotate_wrap(src, src_size, pivot_x, pivot_y, dst.data(), dst_w, dst_h, angle, key);
+    rotate_reference(src, src_size, pivot_x, pivot_y, ref.data(), dst_w, dst_h, angle, key);
+    if (dst != ref)
+    {
+      uint32_t pixels = 0;
+      for (size_t i = 0; i < dst.size(); i++)
+        pixels += dst[i] != ref[i];
+      if (bad_angles++ < 4)
+        printf("  angle %d: %d pixels differ\n", angle, pixels);
+    }
+  }
+  CHECK(bad_angles == 0, "pivot %.3f,%.3f frame %dx%d%s: %d of 1080 angles differ", pivot_x, pivot_y, dst_w, dst_h,
+        key == ROTATE_NO_KEY ? "" : " (key)", bad_angles);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t runs = 3;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "--runs") == 0)
+      runs = max(atoi(argv[i + 1]), 1);
+  }
+
+  const int32_t size = MAP_SPR_SIZE;
+  std::vector<uint16_t> src(size * size);
+  for (int32_t y = 0; y < size; y++)
+    for (int32_t x = 0; x < size; x++)
+      src[(y * size) + x] = src_pixel(x, y);
+
+  // Map sprite pivot (center tile), fractional pivots and pivots next to the wrap, partial blocks
+  test_angles(src.data(), size, size / 2, size / 2, MAP_FRAME_WIDTH, MAP_FRAME_HEIGHT, ROTATE_NO_KEY);
+  test_angles(src.data(), size, 400.25f, 371.75f, MAP_FRAME_WIDTH, MAP_FRAME_HEIGHT, ROTATE_NO_KEY);
+  test_angles(src.data(), size, 3.5f, size - 2.125f, MAP_FRAME_WIDTH, MAP_FRAME_HEIGHT, ROTATE_NO_KEY);
+  test_angles(src.data(), size, size - 0.5f, 0.25f, 97, 61, ROTATE_NO_KEY);
+  test_angles(src.data(), size, 10.0f, 384.0f, 97, 61, KEY_COLOR);
+
+  // us/frame over all angles at map sprite pivot
+  std::vector<uint16_t> frame(MAP_FRAME_WIDTH * MAP_FRAME_HEIGHT);
+  uint32_t total_us = 0, max_us = 0, max_angle = 0, copy_us = 0;
+  for (int16_t angle = 0; angle < 360; angle++)
+  {
+    uint32_t start = micros();
+    for (uint32_t run = 0; run < runs; run++)
+      rotate_wrap(src.data(), size, size / 2, size / 2, frame.data(), MAP_FRAME_WIDTH, MAP_FRAME_HEIGHT, angle);
+    uint32_t us = (micros() - start) / runs;
+    total_us += us;
+    if (angle == 0)
+      copy_us = us;
+    else if (us > max_us)
+    {
+      max_us = us;
+      max_angle = angle;
+    }
+  }
+
+  uint32_t start = micros();
+  for (int16_t angle = 0; angle < 360; angle += 10)
+    rotate_reference(src.data(), size, size / 2, size / 2, frame.data(), MAP_FRAME_WIDTH, MAP_FRAME_HEIGHT, angle,
+                     ROTATE_NO_KEY);
+  uint32_t ref_us = (micros() - start) / 36;
+
+  printf("rotate %dx%d from %dx%d: %d us/frame (0 deg copy %d us, worst %d us at %d deg), reference %d us/frame\n",
+         MAP_FRAME_WIDTH, MAP_FRAME_HEIGHT, size, size, total_us / 360, copy_us, max_us, max_angle, ref_us);
+  printf("%s: %d failed checks\n", failed == 0 ? "PASS" : "FAIL", failed);
+  return failed;
+}
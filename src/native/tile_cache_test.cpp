@@ -0,0 +1,260 @@
+/**
+ * @file tile_cache_test.cpp
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Host (native) tile cache test: hit rate against a reference LRU model, missing tiles not evicting
+ *         cached ones, overzoom synthesis and PSRAM pressure per region, on a generated raw tile set
+ * @version 0.1.6
+ * @date 2023-06-14
+ *
+ * usage: tile_cache_test [--slots N] [--lookups N] [--seed N]
+ *
+ * Tiles are written to a temporary SD root, every pixel encodes its tile and position so decoded buffers
+ * can be checked. Exit code is the number of failed checks.
+ */
+
+#include "native/native.h"
+#include "utils/psram_arena.h"
+#include "utils/gps_maps.h"
+#include "utils/tile_pack.h"
+#include "utils/tile_codec.h"
+#include "utils/tile_index.h"
+#include "utils/tile_cache.h"
+#include <ftw.h>
+#include <list>
+#include <random>
+
+#define TEST_ZOOM 15
+#define GRID_X 100 // zoom 15 tiles GRID_X..GRID_X + GRID - 1, GRID_Y..GRID_Y + GRID - 1
+#define GRID_Y 200
+#define GRID 8
+#define PARENT_X 60 // zoom 14 tile with no zoom 15 children on SD (overzoom)
+#define PARENT_Y 110
+
+static uint32_t failed = 0;
+
+#define CHECK(cond, ...)                        \
+  do                                            \
+  {                                             \
+    if (!(cond))                                \
+    {                                           \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__);                      \
+      printf("\n");                             \
+      failed++;                                 \
+    }                                           \
+  } while (0)
+
+/**
+ * @brief Test pixel of a tile
+ *
+ */
+static uint16_t tile_pixel(uint8_t zoom, uint32_t x, uint32_t y, uint16_t px, uint16_t py)
+{
+  return (uint16_t)((x * 31 + y * 17 + zoom * 7) * 0x9E37 + py * 256 + px);
+}
+
+/**
+ * @brief Write raw tile (/MAP/zoom/x/y.rgb) under SD root
+ *
+ */
+static bool write_tile(uint8_t zoom, uint32_t x, uint32_t y)
+{
+  std::string dir = SD.root + "/MAP/" + std::to_string(zoom);
+  mkdir(dir.c_str(), 0755);
+  dir += "/" + std::to_string(x);
+  mkdir(dir.c_str(), 0755);
+  FILE *file = fopen((dir + "/" + std::to_string(y) + ".rgb").c_str(), "wb");
+  if (file == NULL)
+    return false;
+  static uint16_t pixels[256 * 256];
+  for (int py = 0; py < 256; py++)
+    for (int px = 0; px < 256; px++)
+      pixels[py * 256 + px] = tile_pixel(zoom, x, y, px, py);
+  fwrite(pixels, sizeof(pixels), 1, file);
+  fclose(file);
+  return true;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+  return remove(path);
+}
+
+/**
+ * @brief Get tile from cache
+ *
+ */
+static uint16_t *get_tile(uint8_t zoom, uint32_t x, uint32_t y)
+{
+  char path[40];
+  get_tile_path(path, zoom, x, y);
+  MapTile tile = {path, x, y, zoom};
+  return get_cached_tile(tile);
+}
+
+/**
+ * @brief Check decoded tile against its test pattern
+ *
+ */
+static bool is_tile_ok(const uint16_t *buffer, uint8_t zoom, uint32_t x, uint32_t y)
+{
+  for (int py = 0; py < 256; py += 15)
+    for (int px = 0; px < 256; px += 15)
+      if (buffer[py * 256 + px] != tile_pixel(zoom, x, y, px, py))
+        return false;
+  return true;
+}
+
+/**
+ * @brief Random walk over tile grid with missing tile lookups, hits against reference LRU model
+ *
+ */
+static void test_hit_rate(uint8_t slots, uint32_t lookups, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::list<uint32_t> model;
+  uint32_t model_hits = 0, bad_tiles = 0, missing = 0;
+  uint32_t hits = tile_cache_hits;
+  int32_t x = GRID / 2, y = GRID / 2;
+
+  for (uint32_t i = 0; i < lookups; i++)
+  {
+    if (rng() % 8 == 0)
+    {
+      // Missing tile (no ancestor on SD either)
+      CHECK(get_tile(TEST_ZOOM, 5000 + rng() % 16, 5000) == NULL, "missing tile returned a buffer");
+      missing++;
+      continue;
+    }
+    int32_t dx = rng() % 3, dy = rng() % 3;
+    x = constrain(x + dx - 1, 0, GRID - 1);
+    y = constrain(y + dy - 1, 0, GRID - 1);
+    uint32_t key = y * GRID + x;
+
+    auto it = std::find(model.begin(), model.end(), key);
+    if (it != model.end())
+    {
+      model_hits++;
+      model.erase(it);
+    }
+    else if (model.size() == slots)
+      model.pop_back();
+    model.push_front(key);
+
+    uint16_t *buffer = get_tile(TEST_ZOOM, GRID_X + x, GRID_Y + y);
+    if (buffer == NULL || !is_tile_ok(buffer, TEST_ZOOM, GRID_X + x, GRID_Y + y))
+      bad_tiles++;
+  }
+
+  hits = tile_cache_hits - hits;
+  printf("hit rate: %d lookups, %d missing, %d hits (%d%%), reference LRU %d hits\n", lookups, missing, hits,
+         hits * 100 / (lookups - missing), model_hits);
+  CHECK(hits == model_hits, "hits %d, reference LRU %d", hits, model_hits);
+  CHECK(bad_tiles == 0, "%d lookups returned wrong tile content", bad_tiles);
+}
+
+/**
+ * @brief Missing tiles must not evict cached tiles, and are not looked up again on SD
+ *
+ */
+static void test_missing_tiles(uint8_t slots)
+{
+  clear_tile_cache();
+  for (int i = 0; i < slots; i++)
+    get_tile(TEST_ZOOM, GRID_X + i % GRID, GRID_Y + i / GRID);
+
+  uint32_t decoded = tile_decode_count[TILE_RAW];
+  uint32_t skipped = tile_missing_skipped;
+  for (int i = 0; i < 2 * MAX_CACHED_TILES; i++)
+    get_tile(TEST_ZOOM, 6000 + i % 4, 6000);
+  skipped = tile_missing_skipped - skipped;
+
+  uint32_t hits = tile_cache_hits;
+  for (int i = 0; i < slots; i++)
+    get_tile(TEST_ZOOM, GRID_X + i % GRID, GRID_Y + i / GRID);
+  CHECK(tile_cache_hits - hits == slots, "%d of %d cached tiles kept after missing lookups", tile_cache_hits - hits,
+        slots);
+  CHECK(tile_decode_count[TILE_RAW] == decoded, "cached tiles decoded again");
+  CHECK(skipped == 2 * MAX_CACHED_TILES - 4, "%d of %d repeated missing lookups skipped", skipped,
+        2 * MAX_CACHED_TILES - 4);
+}
+
+/**
+ * @brief Missing tile with a zoom - 1 ancestor is synthesized (upscaled quarter of ancestor)
+ *
+ */
+static void test_overzoom()
+{
+  uint32_t x = PARENT_X * 2 + 1, y = PARENT_Y * 2;
+  uint16_t *buffer = get_tile(TEST_ZOOM, x, y);
+  CHECK(buffer != NULL, "overzoom tile not synthesized");
+  if (buffer == NULL)
+    return;
+  bool ok = true;
+  for (int py = 0; py < 256; py += 7)
+    for (int px = 0; px < 256; px += 7)
+      ok &= buffer[py * 256 + px] == tile_pixel(TEST_ZOOM - 1, PARENT_X, PARENT_Y, 128 + px / 2, py / 2);
+  CHECK(ok, "overzoom tile doesn't match ancestor quarter");
+}
+
+/**
+ * @brief Only the region over budget is shrunk (indexes over budget don't shrink the tile cache)
+ *
+ */
+static void test_arena_pressure()
+{
+  uint8_t slots = tile_cache_slots;
+  int32_t over = ARENA_INDEX_SIZE - arena[ARENA_INDEX].used + 1024;
+  arena_heap_account(ARENA_INDEX, over);
+  check_arena_pressure();
+  arena_heap_account(ARENA_INDEX, -over);
+  CHECK(tile_cache_slots == slots, "index over budget shrunk tile cache to %d slots", tile_cache_slots);
+
+  if (slots <= MIN_CACHED_TILES + 2)
+    return;
+  over = ARENA_TILES_SIZE - arena[ARENA_TILES].used + 2 * TILE_BYTES;
+  arena_heap_account(ARENA_TILES, over);
+  check_arena_pressure();
+  arena_heap_account(ARENA_TILES, -over);
+  CHECK(tile_cache_slots == slots - 2, "tiles 2 slots over budget: %d slots, %d expected", tile_cache_slots, slots - 2);
+}
+
+int main(int argc, char **argv)
+{
+  uint8_t slots = 8;
+  uint32_t lookups = 5000, seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "--slots") == 0)
+      slots = constrain(atoi(argv[i + 1]), 1, MAX_CACHED_TILES);
+    else if (strcmp(argv[i], "--lookups") == 0)
+      lookups = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--seed") == 0)
+      seed = atoi(argv[i + 1]);
+  }
+
+  char root[] = "/tmp/tile_cache_test_XXXXXX";
+  if (mkdtemp(root) == NULL)
+    return 1;
+  SD.root = root;
+  mkdir((SD.root + "/MAP").c_str(), 0755);
+  for (int y = 0; y < GRID; y++)
+    for (int x = 0; x < GRID; x++)
+      write_tile(TEST_ZOOM, GRID_X + x, GRID_Y + y);
+  write_tile(TEST_ZOOM - 1, PARENT_X, PARENT_Y);
+
+  init_psram_arena();
+  init_tile_format();
+  init_tile_cache(slots * TILE_BYTES);
+  CHECK(tile_cache_slots == slots, "%d cache slots, %d expected", tile_cache_slots, slots);
+
+  test_hit_rate(slots, lookups, seed);
+  test_missing_tiles(slots);
+  test_overzoom();
+  test_arena_pressure();
+  log_tile_cache_stats();
+
+  nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  printf("%s: %d failed checks\n", failed == 0 ? "PASS" : "FAIL", failed);
+  return failed;
+}
@@ -7,7 +7,9 @@
  */
 
 /**
- * @brief Task 1 - Read GPS data
+ * @brief Task 1 - Parse GPS data received in GPS ring (woken by UART receive events). Parsed epochs are
+ *        published as fix snapshot (see gps_fix.h), satellite table is updated with gps_mutex taken.
+ *        Output rate changes requested by UI are sent to receiver here (see gps_rate.h)
  *
  * @param pvParameters
  */
@@ -17,21 +19,72 @@ void Read_GPS(void *pvParameters)
   log_v("Stack size: %d",uxTaskGetStackHighWaterMark(NULL));
   for (;;)
   {
-    while (gps->available() > 0)
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(GPS_RX_STATS_PERIOD));
+    GpsRxChunk *chunk;
+    while ((chunk = peek_gps_rx()) != NULL)
     {
 #ifdef OUTPUT_NMEA
-      {
-        debug->write(gps->read());
-      }
+      debug->write(chunk->data, chunk->len);
 #else
-      GPS.encode(gps->read());
-      vTaskDelay(10);
+      uint32_t start = micros();
+      for (int i = 0; i < chunk->len; i++)
+        encode_gps(chunk->data[i]);
+      gps_parse_time += micros() - start;
 #endif
+      pop_gps_rx();
     }
-    
+    apply_gps_rate();
+#ifndef OUTPUT_NMEA
+    xSemaphoreTake(gps_mutex, portMAX_DELAY);
+    update_sat_table();
+    xSemaphoreGive(gps_mutex);
+#endif
+    log_gps_rx_stats();
   }
 }
 
+/**
+ * @brief Task 1b - Feed GPS ring from NMEA replay (in place of UART receive events)
+ *
+ * @param pvParameters
+ */
+void Replay_GPS(void *pvParameters)
+{
+  log_v("Task1b - Replay GPS - running on core %d", xPortGetCoreID());
+  uint8_t data[GPS_RX_CHUNK];
+  for (;;)
+  {
+    size_t len = read_nmea_replay(data, sizeof(data), get_replay_clock());
+    if (len == 0)
+    {
+      if (nmea_replay.source == REPLAY_OFF)
+        vTaskDelete(NULL);
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    while (!push_gps_rx(data, len))
+      vTaskDelay(1);
+  }
+}
+
+/**
+ * @brief Init GPS task (on the core not running LVGL) and start UART receive events or NMEA replay
+ *
+ */
+void init_gps_task()
+{
+  TaskHandle_t task;
+  xTaskCreatePinnedToCore(Read_GPS, PSTR("Read GPS"), 8192, NULL, 3, &task, !xPortGetCoreID());
+  if (nmea_replay.source != REPLAY_OFF)
+  {
+    gps_casic = false;
+    gps_task = task;
+    xTaskCreatePinnedToCore(Replay_GPS, PSTR("Replay GPS"), 4096, NULL, 2, NULL, !xPortGetCoreID());
+  }
+  else
+    start_gps_rx(task);
+}
+
 /**
  * @brief Task2 - LVGL Task
  * 
@@ -47,14 +100,38 @@ void LVGL_Task(void *pvParameters)
   }
 }
 
+/**
+ * @brief Task3 - Map tile prefetch
+ *
+ * @param pvParameters
+ */
+void Prefetch_Tiles(void *pvParameters)
+{
+  log_v("Task3 - Prefetch Tiles - running on core %d", xPortGetCoreID());
+  PrefetchHint hint;
+  for (;;)
+  {
+    if (xQueueReceive(prefetch_hint_queue, &hint, portMAX_DELAY) == pdTRUE)
+      prefetch_tiles(hint);
+  }
+}
+
+/**
+ * @brief Init map tile prefetch task (on the core not running LVGL)
+ *
+ */
+void init_prefetch_task()
+{
+  if (init_tile_prefetch())
+    xTaskCreatePinnedToCore(Prefetch_Tiles, PSTR("Prefetch Tiles"), 16384, NULL, 1, NULL, !xPortGetCoreID());
+}
+
 /**
  * @brief Init Core tasks
  *
  */
 void init_tasks()
 {
-  xTaskCreatePinnedToCore(Read_GPS, PSTR("Read GPS"), 20000, NULL, 3, NULL, 1);
-  delay(500);
   //xTaskCreatePinnedToCore(LVGL_Task, PSTR("LVGL Task"), 20000, NULL, 1, NULL, 1);
   //delay(500);
 }
\ No newline at end of file
@@ -0,0 +1,247 @@
+/**
+ * @file gps_filter.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Position / velocity Kalman filter: constant velocity model on a local east / north plane, fed by
+ *         GNSS fixes (HDOP derived noise) and turned by compass heading changes, predicts position at
+ *         display rate (dead reckoning between epochs) and rejects outlier fixes (multipath)
+ * @version 0.1.6
+ * @date 2023-06-14
+ *
+ * East and north axes are filtered as two independent position / velocity states, so an update costs a few
+ * dozens of float operations. Compass heading change between updates rotates velocity (turns at 1 Hz)
+ */
+
+#define GPS_FILTER_UERE 5.0f          // m, user equivalent range error (position sigma = HDOP * UERE)
+#define GPS_FILTER_MIN_SIGMA 2.0f     // m, minimum position sigma
+#define GPS_FILTER_DEF_HDOP 150       // x100, HDOP used when fix has none
+#define GPS_FILTER_VEL_SIGMA 0.5f     // m/s, GNSS velocity sigma
+#define GPS_FILTER_ACCEL 2.0f         // m/s², process noise (acceleration sigma)
+#define GPS_FILTER_GATE 16.0f         // squared normalized innovation of rejected fixes (2 DOF, 99.97%)
+#define GPS_FILTER_MAX_REJECT 4       // consecutive rejected fixes resetting filter (real jump)
+#define GPS_FILTER_MAX_PREDICT 3000   // ms, dead reckoning limit without fixes
+#define GPS_FILTER_TURN_SPEED 2.0f    // m/s, compass turns velocity above this speed
+#define GPS_FILTER_MAX_OFFSET 50000.0 // m, local plane origin is moved beyond this
+#define GPS_FILTER_M_PER_DEG 111320.0
+
+/**
+ * @brief Position and velocity of an axis and its covariance
+ *
+ */
+struct GpsAxis
+{
+  float pos;   // m
+  float vel;   // m/s
+  float p_pp;
+  float p_pv;
+  float p_vv;
+};
+
+/**
+ * @brief Filter state (at time of last fix) and counters
+ *
+ */
+struct GpsFilter
+{
+  bool ready;
+  double lat0;          // local plane origin
+  double lon0;
+  double m_per_deg_lon;
+  GpsAxis east;
+  GpsAxis north;
+  uint32_t time;        // ms, last fix
+  int16_t heading;      // compass heading at last fix (-1 no compass)
+  uint8_t reject_run;
+  uint32_t updates;
+  uint32_t rejected;
+  uint32_t resets;
+};
+GpsFilter gps_filter = {};
+
+/**
+ * @brief Heading difference in -180..180 degrees
+ *
+ */
+static float gps_filter_turn(int16_t from, int16_t to)
+{
+  if (from < 0 || to < 0)
+    return 0.0f;
+  int16_t diff = (to - from) % 360;
+  if (diff > 180)
+    diff -= 360;
+  else if (diff < -180)
+    diff += 360;
+  return diff;
+}
+
+/**
+ * @brief Predict axes dt seconds ahead, velocity turned by turn degrees (position moves with mean velocity)
+ *
+ * @param east -> east axis
+ * @param north -> north axis
+ * @param dt -> seconds
+ * @param turn -> degrees (clockwise)
+ */
+static void predict_gps_axes(GpsAxis &east, GpsAxis &north, float dt, float turn)
+{
+  float half_s = sinf(radians(turn) * 0.5f), half_c = cosf(radians(turn) * 0.5f);
+  float s = sinf(radians(turn)), c = cosf(radians(turn));
+  float ve = east.vel, vn = north.vel;
+  east.pos += (ve * half_c + vn * half_s) * dt;
+  north.pos += (vn * half_c - ve * half_s) * dt;
+  east.vel = ve * c + vn * s;
+  north.vel = vn * c - ve * s;
+
+  float q = GPS_FILTER_ACCEL * GPS_FILTER_ACCEL;
+  float dt2 = dt * dt;
+  GpsAxis *axes[] = {&east, &north};
+  for (GpsAxis *a : axes)
+  {
+    a->p_pp += 2 * dt * a->p_pv + dt2 * a->p_vv + q * dt2 * dt2 * 0.25f;
+    a->p_pv += dt * a->p_vv + q * dt2 * dt * 0.5f;
+    a->p_vv += q * dt2;
+  }
+}
+
+/**
+ * @brief Update axis with position measurement
+ *
+ */
+static void update_gps_axis_pos(GpsAxis &a, float z, float r)
+{
+  float s = a.p_pp + r;
+  float k_p = a.p_pp / s, k_v = a.p_pv / s;
+  float innovation = z - a.pos;
+  a.pos += k_p * innovation;
+  a.vel += k_v * innovation;
+  a.p_vv -= k_v * a.p_pv;
+  a.p_pp *= 1 - k_p;
+  a.p_pv *= 1 - k_p;
+}
+
+/**
+ * @brief Update axis with velocity measurement
+ *
+ */
+static void update_gps_axis_vel(GpsAxis &a, float z, float r)
+{
+  float s = a.p_vv + r;
+  float k_p = a.p_pv / s, k_v = a.p_vv / s;
+  float innovation = z - a.vel;
+  a.pos += k_p * innovation;
+  a.vel += k_v * innovation;
+  a.p_pp -= k_p * a.p_pv;
+  a.p_pv *= 1 - k_v;
+  a.p_vv *= 1 - k_v;
+}
+
+/**
+ * @brief Reset filter at fix
+ *
+ */
+static void reset_gps_filter(const GpsFix &fix, float r, bool has_vel, float ve, float vn)
+{
+  gps_filter.lat0 = fix.lat;
+  gps_filter.lon0 = fix.lon;
+  gps_filter.m_per_deg_lon = GPS_FILTER_M_PER_DEG * cos(radians(fix.lat));
+  float r_vel = has_vel ? GPS_FILTER_VEL_SIGMA * GPS_FILTER_VEL_SIGMA : 25.0f;
+  gps_filter.east = {0.0f, has_vel ? ve : 0.0f, r, 0.0f, r_vel};
+  gps_filter.north = {0.0f, has_vel ? vn : 0.0f, r, 0.0f, r_vel};
+  gps_filter.reject_run = 0;
+  gps_filter.ready = true;
+  gps_filter.resets++;
+}
+
+/**
+ * @brief Feed filter with new GNSS fix
+ *
+ * @param fix -> fix (time is used as fix time)
+ * @param heading -> compass heading (degrees, -1 no compass)
+ * @return true if fix was accepted
+ */
+bool update_gps_filter(const GpsFix &fix, int16_t heading)
+{
+  if (fix.quality == 0 || (fix.valid & NMEA_LOCATION) == 0)
+    return false;
+
+  float sigma = max((fix.hdop > 0 ? fix.hdop : GPS_FILTER_DEF_HDOP) * 0.01f * GPS_FILTER_UERE, GPS_FILTER_MIN_SIGMA);
+  float r = sigma * sigma;
+  bool has_vel = (fix.valid & NMEA_SPEED) != 0;
+  float speed = fix.speed / 3.6f;
+  float ve = speed * sinf(radians(fix.course)), vn = speed * cosf(radians(fix.course));
+  float dt = (fix.time - gps_filter.time) * 0.001f;
+  gps_filter.updates++;
+
+  if (!gps_filter.ready || dt * 1000 > GPS_FILTER_MAX_PREDICT || dt < 0)
+  {
+    reset_gps_filter(fix, r, has_vel, ve, vn);
+    gps_filter.time = fix.time;
+    gps_filter.heading = heading;
+    return true;
+  }
+
+  GpsAxis east = gps_filter.east, north = gps_filter.north;
+  float turn = hypotf(east.vel, north.vel) > GPS_FILTER_TURN_SPEED ? gps_filter_turn(gps_filter.heading, heading) : 0.0f;
+  predict_gps_axes(east, north, dt, turn);
+  gps_filter.time = fix.time;
+  gps_filter.heading = heading;
+
+  float z_e = (fix.lon - gps_filter.lon0) * gps_filter.m_per_deg_lon;
+  float z_n = (fix.lat - gps_filter.lat0) * GPS_FILTER_M_PER_DEG;
+  float i_e = z_e - east.pos, i_n = z_n - north.pos;
+  float d2 = i_e * i_e / (east.p_pp + r) + i_n * i_n / (north.p_pp + r);
+  if (d2 > GPS_FILTER_GATE)
+  {
+    gps_filter.east = east;
+    gps_filter.north = north;
+    gps_filter.rejected++;
+    if (++gps_filter.reject_run >= GPS_FILTER_MAX_REJECT)
+      reset_gps_filter(fix, r, has_vel, ve, vn);
+    return false;
+  }
+  gps_filter.reject_run = 0;
+
+  update_gps_axis_pos(east, z_e, r);
+  update_gps_axis_pos(north, z_n, r);
+  if (has_vel)
+  {
+    float r_vel = GPS_FILTER_VEL_SIGMA * GPS_FILTER_VEL_SIGMA;
+    update_gps_axis_vel(east, ve, r_vel);
+    update_gps_axis_vel(north, vn, r_vel);
+  }
+  gps_filter.east = east;
+  gps_filter.north = north;
+
+  if (fabsf(east.pos) > GPS_FILTER_MAX_OFFSET || fabsf(north.pos) > GPS_FILTER_MAX_OFFSET)
+  {
+    gps_filter.lat0 += north.pos / GPS_FILTER_M_PER_DEG;
+    gps_filter.lon0 += east.pos / gps_filter.m_per_deg_lon;
+    gps_filter.m_per_deg_lon = GPS_FILTER_M_PER_DEG * cos(radians(gps_filter.lat0));
+    gps_filter.east.pos = 0.0f;
+    gps_filter.north.pos = 0.0f;
+  }
+  return true;
+}
+
+/**
+ * @brief Get predicted position (dead reckoning from last fix, up to GPS_FILTER_MAX_PREDICT)
+ *
+ * @param now -> ms
+ * @param heading -> compass heading (degrees, -1 no compass)
+ * @param lat -> predicted latitude
+ * @param lon -> predicted longitude
+ * @return true if filter has a position
+ */
+bool get_gps_filter_position(uint32_t now, int16_t heading, double &lat, double &lon)
+{
+  if (!gps_filter.ready)
+    return false;
+  GpsAxis east = gps_filter.east, north = gps_filter.north;
+  uint32_t elapsed = min(now - gps_filter.time, (uint32_t)GPS_FILTER_MAX_PREDICT);
+  if ((int32_t)(now - gps_filter.time) < 0)
+    elapsed = 0;
+  float turn = hypotf(east.vel, north.vel) > GPS_FILTER_TURN_SPEED ? gps_filter_turn(gps_filter.heading, heading) : 0.0f;
+  predict_gps_axes(east, north, elapsed * 0.001f, turn);
+  lat = gps_filter.lat0 + north.pos / GPS_FILTER_M_PER_DEG;
+  lon = gps_filter.lon0 + east.pos / gps_filter.m_per_deg_lon;
+  return true;
+}
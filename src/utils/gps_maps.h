@@ -24,6 +24,24 @@ struct MapTile
  */
 uint16_t tileSize = 256;
 
+/**
+ * @brief Map tile file formats
+ *
+ *        TILE_PNG -> 256x256 PNG (Maperitive output)
+ *        TILE_RAW -> 256x256 RGB565 byte-swapped (LGFX_Sprite memory layout), no header
+ *        TILE_IPT -> 256x256 palette + RLE (see tile_codec.h)
+ *
+ */
+enum TileFormat
+{
+  TILE_PNG,
+  TILE_RAW,
+  TILE_IPT,
+  TILE_FORMATS,
+};
+static const char *tile_ext[TILE_FORMATS] = {"png", "rgb", "ipt"};
+uint8_t map_tile_format = TILE_PNG;
+
 /**
  * @brief Get TileY for OpenStreeMap files
  *
@@ -72,6 +90,124 @@ uint16_t lat2posy(float f_lat, uint8_t zoom)
   return ((uint16_t)(((1.0 - log(tan(f_lat * M_PI / 180.0) + 1.0 / cos(f_lat * M_PI / 180.0)) / M_PI) / 2.0 * (pow(2.0, zoom)) * tileSize)) % tileSize);
 }
 
+/**
+ * @brief Get world pixel X position (all tiles) from longitude
+ *
+ * @param f_lon -> longitude
+ * @param zoom -> zoom
+ * @return X world position
+ */
+double lon2worldx(double f_lon, uint8_t zoom)
+{
+  return (f_lon + 180.0) / 360.0 * pow(2.0, zoom) * tileSize;
+}
+
+/**
+ * @brief Get world pixel Y position (all tiles) from latitude
+ *
+ * @param f_lat -> latitude
+ * @param zoom -> zoom
+ * @return Y world position
+ */
+double lat2worldy(double f_lat, uint8_t zoom)
+{
+  return (1.0 - log(tan(f_lat * M_PI / 180.0) + 1.0 / cos(f_lat * M_PI / 180.0)) / M_PI) / 2.0 * pow(2.0, zoom) * tileSize;
+}
+
+/**
+ * @brief Get longitude from world pixel X position
+ *
+ * @param x -> X world position
+ * @param zoom -> zoom
+ * @return longitude
+ */
+double worldx2lon(double x, uint8_t zoom)
+{
+  return x / (pow(2.0, zoom) * tileSize) * 360.0 - 180.0;
+}
+
+/**
+ * @brief Get latitude from world pixel Y position
+ *
+ * @param y -> Y world position
+ * @param zoom -> zoom
+ * @return latitude
+ */
+double worldy2lat(double y, uint8_t zoom)
+{
+  double n = M_PI - 2.0 * M_PI * y / (pow(2.0, zoom) * tileSize);
+  return 180.0 / M_PI * atan(0.5 * (exp(n) - exp(-n)));
+}
+
+/**
+ * @brief Get map tile file path
+ *
+ * @param path -> output path buffer
+ * @param zoom_level -> zoom level
+ * @param x -> Tile X
+ * @param y -> Tile Y
+ */
+void get_tile_path(char *path, uint8_t zoom_level, uint32_t x, uint32_t y)
+{
+  sprintf(path, PSTR("/MAP/%d/%d/%d.%s"), zoom_level, x, y, tile_ext[map_tile_format]);
+}
+
+/**
+ * @brief Get map tile file format from file extension
+ *
+ * @param path -> tile file path
+ * @return TileFormat -> tile format (TILE_PNG if unknown)
+ */
+uint8_t get_tile_format(const char *path)
+{
+  const char *ext = strrchr(path, '.');
+  if (ext != NULL)
+  {
+    for (int i = 0; i < TILE_FORMATS; i++)
+    {
+      if (strcmp(ext + 1, tile_ext[i]) == 0)
+        return i;
+    }
+  }
+  return TILE_PNG;
+}
+
+/**
+ * @brief Detect map tile format on SD from the first tiles folder found in /MAP/zoom/x
+ *
+ */
+void init_tile_format()
+{
+  map_tile_format = TILE_PNG;
+
+  File map_dir = SD.open(PSTR("/MAP"));
+  if (!map_dir)
+    return;
+  File zoom_dir = map_dir.openNextFile();
+  while (zoom_dir && !zoom_dir.isDirectory())
+    zoom_dir = map_dir.openNextFile();
+  if (!zoom_dir)
+    return;
+  File x_dir = zoom_dir.openNextFile();
+  while (x_dir && !x_dir.isDirectory())
+    x_dir = zoom_dir.openNextFile();
+  if (!x_dir)
+    return;
+
+  File tile = x_dir.openNextFile();
+  while (tile)
+  {
+    uint8_t format = get_tile_format(tile.name());
+    if (format != TILE_PNG)
+    {
+      map_tile_format = format;
+      break;
+    }
+    tile = x_dir.openNextFile();
+  }
+  log_v("Map tile format: %s", tile_ext[map_tile_format]);
+}
+
 /**
  * @brief Get the map tile structure from GPS Coordinates
  *
@@ -88,7 +224,7 @@ MapTile get_map_tile(double lon, double lat, uint8_t zoom_level, int16_t off_x,
   uint32_t x = lon2tilex(lon, zoom_level) + off_x;
   uint32_t y = lat2tiley(lat, zoom_level) + off_y;
 
-  sprintf(s_file, PSTR("/MAP/%d/%d/%d.png"), zoom_level, x, y);
+  get_tile_path(s_file, zoom_level, x, y);
   MapTile data;
   data.file = s_file;
   data.tilex = x;
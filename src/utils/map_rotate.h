@@ -0,0 +1,194 @@
+/**
+ * @file map_rotate.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Map rotation kernel (RGB565, toroidal source)
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+/**
+ * @brief Destination block size. Rotating block by block keeps source reads of each
+ *        block in a small PSRAM area (cache friendly)
+ *
+ */
+#define ROTATE_BLOCK 32
+#define ROTATE_NO_KEY 0xFFFFFFFF
+
+/**
+ * @brief Copy a destination row from source row (no rotation), reading through the wrap
+ *
+ * @param src_row -> source row
+ * @param src_size -> source width
+ * @param src_x -> first source column (0..src_size-1)
+ * @param dst -> destination row
+ * @param width -> pixels to copy
+ */
+static void copy_row_wrap(const uint16_t *src_row, int32_t src_size, int32_t src_x, uint16_t *dst, int32_t width)
+{
+  while (width > 0)
+  {
+    int32_t n = min(width, src_size - src_x);
+    memcpy(dst, src_row + src_x, n * sizeof(uint16_t));
+    dst += n;
+    width -= n;
+    src_x = 0;
+  }
+}
+
+/**
+ * @brief Rotate a destination block (source area inside source bounds, no wrap checks)
+ *
+ */
+static void rotate_block(const uint16_t *src, int32_t src_size, int32_t sx, int32_t sy, int32_t cos_a, int32_t sin_a,
+                         uint16_t *dst, int32_t dst_w, int32_t block_w, int32_t block_h, uint32_t key)
+{
+  for (int32_t y = 0; y < block_h; y++)
+  {
+    int32_t px = sx;
+    int32_t py = sy;
+    uint16_t *d = dst;
+    if (key == ROTATE_NO_KEY)
+    {
+      for (int32_t x = 0; x < block_w; x++)
+      {
+        *d++ = src[((py >> 16) * src_size) + (px >> 16)];
+        px += cos_a;
+        py -= sin_a;
+      }
+    }
+    else
+    {
+      for (int32_t x = 0; x < block_w; x++)
+      {
+        uint16_t color = src[((py >> 16) * src_size) + (px >> 16)];
+        if (color != key)
+          *d = color;
+        d++;
+        px += cos_a;
+        py -= sin_a;
+      }
+    }
+    sx += sin_a;
+    sy += cos_a;
+    dst += dst_w;
+  }
+}
+
+/**
+ * @brief Rotate a destination block reading source through the toroidal wrap
+ *
+ */
+static void rotate_block_wrap(const uint16_t *src, int32_t src_size, int32_t sx, int32_t sy, int32_t cos_a, int32_t sin_a,
+                              uint16_t *dst, int32_t dst_w, int32_t block_w, int32_t block_h, uint32_t key)
+{
+  const int32_t wrap = src_size << 16;
+  for (int32_t y = 0; y < block_h; y++)
+  {
+    int32_t px = sx;
+    int32_t py = sy;
+    uint16_t *d = dst;
+    for (int32_t x = 0; x < block_w; x++)
+    {
+      if (px >= wrap)
+        px -= wrap;
+      else if (px < 0)
+        px += wrap;
+      if (py >= wrap)
+        py -= wrap;
+      else if (py < 0)
+        py += wrap;
+      uint16_t color = src[((py >> 16) * src_size) + (px >> 16)];
+      if (key == ROTATE_NO_KEY || color != key)
+        *d = color;
+      d++;
+      px += cos_a;
+      py -= sin_a;
+    }
+    sx += sin_a;
+    sy += cos_a;
+    dst += dst_w;
+  }
+}
+
+/**
+ * @brief Rotate square toroidal RGB565 source around pivot into destination center
+ *        (nearest neighbour, 16.16 fixed point incremental stepping)
+ *
+ * @param src -> source buffer (src_size x src_size)
+ * @param src_size -> source width and height
+ * @param pivot_x -> source pivot X
+ * @param pivot_y -> source pivot Y
+ * @param dst -> destination buffer
+ * @param dst_w -> destination width
+ * @param dst_h -> destination height
+ * @param angle -> rotation angle (degrees, clockwise)
+ * @param key -> transparent color (sprite memory layout) or ROTATE_NO_KEY
+ */
+void rotate_wrap(const uint16_t *src, int32_t src_size, float pivot_x, float pivot_y,
+                 uint16_t *dst, int32_t dst_w, int32_t dst_h, int16_t angle, uint32_t key = ROTATE_NO_KEY)
+{
+  const int32_t wrap = src_size << 16;
+  const int32_t cx = dst_w >> 1;
+  const int32_t cy = dst_h >> 1;
+  const int32_t fx = (int32_t)(pivot_x * 65536);
+  const int32_t fy = (int32_t)(pivot_y * 65536);
+
+  angle %= 360;
+  if (angle < 0)
+    angle += 360;
+
+  // No rotation, copy rows
+  if (angle == 0 && key == ROTATE_NO_KEY)
+  {
+    int32_t src_x = ((fx >> 16) - cx) % src_size;
+    int32_t src_y = ((fy >> 16) - cy) % src_size;
+    if (src_x < 0)
+      src_x += src_size;
+    if (src_y < 0)
+      src_y += src_size;
+    for (int32_t y = 0; y < dst_h; y++)
+    {
+      copy_row_wrap(src + (src_y * src_size), src_size, src_x, dst + (y * dst_w), dst_w);
+      if (++src_y == src_size)
+        src_y = 0;
+    }
+    return;
+  }
+
+  const int32_t cos_a = (int32_t)(cos(DEGtoRAD(angle)) * 65536);
+  const int32_t sin_a = (int32_t)(sin(DEGtoRAD(angle)) * 65536);
+
+  // Source position of destination (0,0)
+  const int32_t sx0 = fx - (cx * cos_a) - (cy * sin_a);
+  const int32_t sy0 = fy + (cx * sin_a) - (cy * cos_a);
+
+  for (int32_t by = 0; by < dst_h; by += ROTATE_BLOCK)
+  {
+    int32_t block_h = min((int32_t)ROTATE_BLOCK, dst_h - by);
+    for (int32_t bx = 0; bx < dst_w; bx += ROTATE_BLOCK)
+    {
+      int32_t block_w = min((int32_t)ROTATE_BLOCK, dst_w - bx);
+
+      int32_t sx = (sx0 + (bx * cos_a) + (by * sin_a)) % wrap;
+      int32_t sy = (sy0 - (bx * sin_a) + (by * cos_a)) % wrap;
+      if (sx < 0)
+        sx += wrap;
+      if (sy < 0)
+        sy += wrap;
+
+      // Source bounding box of block corners
+      int32_t dxw = (block_w - 1) * cos_a, dyw = -(block_w - 1) * sin_a;
+      int32_t dxh = (block_h - 1) * sin_a, dyh = (block_h - 1) * cos_a;
+      int32_t min_x = sx + min((int32_t)0, dxw) + min((int32_t)0, dxh);
+      int32_t max_x = sx + max((int32_t)0, dxw) + max((int32_t)0, dxh);
+      int32_t min_y = sy + min((int32_t)0, dyw) + min((int32_t)0, dyh);
+      int32_t max_y = sy + max((int32_t)0, dyw) + max((int32_t)0, dyh);
+
+      uint16_t *d = dst + (by * dst_w) + bx;
+      if (min_x >= 0 && max_x < wrap && min_y >= 0 && max_y < wrap)
+        rotate_block(src, src_size, sx, sy, cos_a, sin_a, d, dst_w, block_w, block_h, key);
+      else
+        rotate_block_wrap(src, src_size, sx, sy, cos_a, sin_a, d, dst_w, block_w, block_h, key);
+    }
+  }
+}
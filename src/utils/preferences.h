@@ -10,6 +10,113 @@
 
 Preferences preferences;
 
+/**
+ * @brief Warm start cache: last good fix and zoom, saved on first fix and every WARM_START_PERIOD ms when
+ *        position or zoom changed (there is no power off hook, cache may lag up to one period). Main screen opens
+ *        on it at boot (stale until first fix)
+ * 
+ */
+#define WARM_START_PERIOD 300000 // ms
+#define WARM_START_DISTANCE 100  // m
+struct WarmStart
+{
+    bool valid;
+    double lat;
+    double lon;
+    float altitude;
+    time_t time;       // UTC of fix (0 unknown)
+    uint8_t zoom;
+    uint8_t fix_mode;
+    uint8_t satellites;
+    uint32_t saved_ms; // millis of last save (0 not saved in this session)
+};
+WarmStart warm_start = {};
+
+/**
+ * @brief Load warm start cache
+ * 
+ */
+static void load_warm_start()
+{
+    warm_start.valid = preferences.getBool("ws_valid",false);
+    warm_start.lat = preferences.getDouble("ws_lat",0.0);
+    warm_start.lon = preferences.getDouble("ws_lon",0.0);
+    warm_start.altitude = preferences.getFloat("ws_alt",0.0);
+    warm_start.time = preferences.getULong("ws_time",0);
+    warm_start.zoom = preferences.getUChar("ws_zoom",0);
+    warm_start.fix_mode = preferences.getUChar("ws_fix",0);
+    warm_start.satellites = preferences.getUChar("ws_sats",0);
+    if (warm_start.valid)
+        log_v("Warm start: %f %f zoom %d, fix time %lu", warm_start.lat, warm_start.lon, warm_start.zoom,
+              (unsigned long)warm_start.time);
+}
+
+/**
+ * @brief Save warm start cache
+ * 
+ */
+static void save_warm_start()
+{
+    if (!warm_start.valid)
+        return;
+    preferences.begin("ICENAV",false);
+    preferences.putBool("ws_valid",true);
+    preferences.putDouble("ws_lat",warm_start.lat);
+    preferences.putDouble("ws_lon",warm_start.lon);
+    preferences.putFloat("ws_alt",warm_start.altitude);
+    preferences.putULong("ws_time",(uint32_t)warm_start.time);
+    preferences.putUChar("ws_zoom",warm_start.zoom);
+    preferences.putUChar("ws_fix",warm_start.fix_mode);
+    preferences.putUChar("ws_sats",warm_start.satellites);
+    preferences.end();
+    warm_start.saved_ms = millis();
+}
+
+/**
+ * @brief Set warm start cache from fix and zoom
+ * 
+ * @param fix 
+ * @param zoom 
+ */
+static void set_warm_start(const GpsFix &fix, uint8_t zoom)
+{
+    warm_start.valid = true;
+    warm_start.lat = fix.lat;
+    warm_start.lon = fix.lon;
+    warm_start.altitude = fix.altitude;
+    warm_start.time = 0;
+    if ((fix.valid & (NMEA_TIME | NMEA_DATE)) == (NMEA_TIME | NMEA_DATE) && fix.year >= 1970)
+    {
+        tmElements_t tm = {fix.second, fix.minute, fix.hour, 0, fix.day, fix.month, (uint8_t)CalendarYrToTm(fix.year)};
+        warm_start.time = makeTime(tm);
+    }
+    warm_start.zoom = zoom;
+    warm_start.fix_mode = fix.fix_mode;
+    warm_start.satellites = fix.satellites;
+}
+
+/**
+ * @brief Update warm start cache with current fix and zoom, saved on first fix of session and then every
+ *        WARM_START_PERIOD ms if moved WARM_START_DISTANCE meters or zoom changed
+ * 
+ * @param fix 
+ * @param zoom 
+ */
+static void update_warm_start(const GpsFix &fix, uint8_t zoom)
+{
+    if (fix.quality == 0 || (fix.valid & NMEA_LOCATION) == 0)
+        return;
+    bool first = warm_start.saved_ms == 0;
+    if (!first && millis() - warm_start.saved_ms < WARM_START_PERIOD)
+        return;
+    if (!first && zoom == warm_start.zoom &&
+        calc_dist(warm_start.lat, warm_start.lon, fix.lat, fix.lon) < WARM_START_DISTANCE)
+        return;
+
+    set_warm_start(fix, zoom);
+    save_warm_start();
+}
+
 /**
  * @brief Load stored preferences
  * 
@@ -21,6 +128,7 @@ static void load_preferences()
     offy = preferences.getFloat("C_offset_y",0.0);
     log_v("OFFSET X  %f",offx);
     log_v("OFFSET Y  %f",offy);
+    load_warm_start();
     preferences.end();
 }
 
@@ -36,4 +144,4 @@ static void save_compass_cal(float offset_x, float offset_y)
     preferences.putFloat("C_offset_x",offset_x);
     preferences.putFloat("C_offset_y",offset_y);
     preferences.end();
-}
\ No newline at end of file
+}
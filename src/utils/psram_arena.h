@@ -0,0 +1,314 @@
+/**
+ * @file psram_arena.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  PSRAM arena: fixed regions for long lived sprites and buffers, memory budget per subsystem
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+/**
+ * @brief Map screen frame size (tile view area) and sprite sizes
+ *
+ */
+#define MAP_FRAME_WIDTH 320
+#define MAP_FRAME_HEIGHT 374
+#define MAP_FRAME_BYTES (MAP_FRAME_WIDTH * MAP_FRAME_HEIGHT * 2)
+#define MAP_SPR_SIZE 768
+
+/**
+ * @brief Memory budget table (bytes per subsystem), override with build flags
+ *
+ *        ARENA_LVGL     -> LVGL draw buffer
+ *        ARENA_MAP      -> 3x3 tiles map sprite
+ *        ARENA_MAP_SCR  -> map frames, arrow, zoom and HUD sprites
+ *        ARENA_SAT_INFO -> sky plot and SNR sprites
+ *        ARENA_TILES    -> tile cache slots (TILE_CACHE_SIZE), overzoom, prefetch staging and tile decode buffers (heap)
+ *        ARENA_INDEX    -> tile pack and tile availability indexes (heap)
+ *
+ */
+#ifndef ARENA_LVGL_SIZE
+#define ARENA_LVGL_SIZE (TFT_WIDTH * TFT_HEIGHT * 2)
+#endif
+#ifndef ARENA_MAP_SIZE
+#define ARENA_MAP_SIZE (MAP_SPR_SIZE * MAP_SPR_SIZE * 2)
+#endif
+#ifndef ARENA_MAP_SCR_SIZE
+#ifdef MAP_SYNC_PUSH
+#define ARENA_MAP_SCR_SIZE (MAP_FRAME_BYTES + 20 * 1024)
+#else
+#define ARENA_MAP_SCR_SIZE (2 * MAP_FRAME_BYTES + 20 * 1024)
+#endif
+#endif
+#ifndef ARENA_SAT_INFO_SIZE
+#define ARENA_SAT_INFO_SIZE (2 * 200 * 150 * 2 + 2 * TFT_WIDTH * 10 * 2 + 64)
+#endif
+#define TILE_BYTES (256 * 256 * 2)
+#define TILE_DECODE_BYTES (96 * 1024) // Compressed tile buffer (renderer and prefetch task), IPT worst case is 66.6 KB
+#ifndef TILE_CACHE_SIZE
+#define TILE_CACHE_SIZE (12 * TILE_BYTES)
+#endif
+#ifndef ARENA_TILES_SIZE
+#define ARENA_TILES_SIZE (TILE_CACHE_SIZE + 8 * TILE_BYTES + 2 * TILE_DECODE_BYTES)
+#endif
+#ifndef ARENA_INDEX_SIZE
+#define ARENA_INDEX_SIZE (64 * 1024)
+#endif
+
+/**
+ * @brief Free PSRAM (heap) under which caches are asked to shrink
+ *
+ */
+#ifndef ARENA_LOW_WATER
+#define ARENA_LOW_WATER (64 * 1024)
+#endif
+
+/**
+ * @brief Arena regions. Fixed regions are carved from one PSRAM block reserved at boot and
+ *        bump allocated (never freed), so sprites attached to them don't fragment the heap.
+ *        Heap regions are regular ps_malloc allocations, only accounted against its budget
+ *
+ */
+enum ArenaRegionId
+{
+  ARENA_LVGL,
+  ARENA_MAP,
+  ARENA_MAP_SCR,
+  ARENA_SAT_INFO,
+  ARENA_TILES,
+  ARENA_INDEX,
+  ARENA_REGIONS,
+};
+#define ARENA_FIXED_REGIONS ARENA_TILES
+
+/**
+ * @brief Pressure callback: release up to bytes from a cache and return released bytes
+ *        (always called from LVGL task, see check_arena_pressure)
+ *
+ */
+typedef uint32_t (*ArenaPressureCb)(uint32_t bytes);
+
+/**
+ * @brief Structure to store arena region, its budget and usage
+ *
+ */
+struct ArenaRegion
+{
+  const char *name;
+  uint32_t budget;
+  uint8_t *base;
+  uint32_t used;
+  uint32_t high_water;
+  uint32_t failed;
+  ArenaPressureCb on_pressure;
+};
+
+ArenaRegion arena[ARENA_REGIONS] = {
+    {"lvgl", ARENA_LVGL_SIZE, NULL, 0, 0, 0, NULL},
+    {"map", ARENA_MAP_SIZE, NULL, 0, 0, 0, NULL},
+    {"map_scr", ARENA_MAP_SCR_SIZE, NULL, 0, 0, 0, NULL},
+    {"sat_info", ARENA_SAT_INFO_SIZE, NULL, 0, 0, 0, NULL},
+    {"tiles", ARENA_TILES_SIZE, NULL, 0, 0, 0, NULL},
+    {"index", ARENA_INDEX_SIZE, NULL, 0, 0, 0, NULL},
+};
+
+SemaphoreHandle_t arena_mutex = NULL;
+volatile uint32_t arena_pressure_bytes = 0;
+uint32_t arena_pressure_released = 0;
+
+/**
+ * @brief Reserve fixed regions in PSRAM (one block, or one block per region if PSRAM is too fragmented)
+ *
+ */
+void init_psram_arena()
+{
+  arena_mutex = xSemaphoreCreateMutex();
+
+  uint32_t total = 0;
+  for (int i = 0; i < ARENA_FIXED_REGIONS; i++)
+    total += arena[i].budget;
+
+  uint8_t *block = (uint8_t *)ps_malloc(total);
+  for (int i = 0; i < ARENA_FIXED_REGIONS; i++)
+  {
+    if (block != NULL)
+    {
+      arena[i].base = block;
+      block += arena[i].budget;
+    }
+    else
+      arena[i].base = (uint8_t *)ps_malloc(arena[i].budget);
+    if (arena[i].base == NULL)
+      log_e("PSRAM arena: can't reserve %s region (%d bytes)", arena[i].name, arena[i].budget);
+  }
+  log_v("PSRAM arena: %d bytes reserved, %d bytes PSRAM free", total, ESP.getFreePsram());
+}
+
+/**
+ * @brief Allocate buffer from a fixed region (4 bytes aligned). Fixed region buffers are never freed
+ *
+ * @param region -> arena region
+ * @param bytes -> buffer size
+ * @return void* -> buffer or NULL if region is full
+ */
+void *arena_alloc(uint8_t region, uint32_t bytes)
+{
+  ArenaRegion &reg = arena[region];
+  bytes = (bytes + 3) & ~3;
+  if (reg.base == NULL || reg.used + bytes > reg.budget)
+  {
+    reg.failed++;
+    log_e("PSRAM arena: %s region full (%d of %d bytes used, %d requested)", reg.name, reg.used, reg.budget, bytes);
+    return NULL;
+  }
+  void *buffer = reg.base + reg.used;
+  reg.used += bytes;
+  reg.high_water = max(reg.high_water, reg.used);
+  return buffer;
+}
+
+/**
+ * @brief Attach sprite (16 bits) to a buffer of a fixed region. Sprite keeps its buffer once
+ *        attached, so calling it again with the same size doesn't allocate.
+ *        Falls back to createSprite if region is full
+ *
+ * @param spr -> sprite
+ * @param region -> arena region
+ * @param width -> sprite width
+ * @param height -> sprite height
+ * @return true if sprite has a buffer
+ */
+bool arena_sprite(TFT_eSprite &spr, uint8_t region, int32_t width, int32_t height)
+{
+  if (spr.getBuffer() != NULL && spr.width() == width && spr.height() == height)
+    return true;
+
+  void *buffer = arena_alloc(region, width * height * 2);
+  if (buffer == NULL)
+    return spr.createSprite(width, height) != NULL;
+  spr.setBuffer(buffer, width, height);
+  return true;
+}
+
+/**
+ * @brief Request caches to release memory (from any task), callbacks run on next check_arena_pressure
+ *
+ * @param bytes -> needed bytes
+ */
+void request_arena_pressure(uint32_t bytes)
+{
+  if (bytes > arena_pressure_bytes)
+    arena_pressure_bytes = bytes;
+}
+
+/**
+ * @brief Account PSRAM heap memory to a heap region (buffers not allocated with arena_heap_alloc,
+ *        like indexes grown with realloc). A region over its budget is shrunk by its own cache on
+ *        next check_arena_pressure (regions without cache, like indexes, are only accounted)
+ *
+ * @param region -> arena region
+ * @param bytes -> allocated (positive) or released (negative) bytes
+ */
+void arena_heap_account(uint8_t region, int32_t bytes)
+{
+  xSemaphoreTake(arena_mutex, portMAX_DELAY);
+  ArenaRegion &reg = arena[region];
+  reg.used += bytes;
+  reg.high_water = max(reg.high_water, reg.used);
+  xSemaphoreGive(arena_mutex);
+}
+
+/**
+ * @brief Allocate buffer in PSRAM heap accounted to a heap region.
+ *        If allocation fails caches are asked to shrink (next allocation may succeed)
+ *
+ * @param region -> arena region
+ * @param bytes -> buffer size
+ * @return void* -> buffer or NULL
+ */
+void *arena_heap_alloc(uint8_t region, uint32_t bytes)
+{
+  void *buffer = ps_malloc(bytes);
+  if (buffer == NULL)
+  {
+    arena[region].failed++;
+    request_arena_pressure(bytes);
+    return NULL;
+  }
+  arena_heap_account(region, bytes);
+  return buffer;
+}
+
+/**
+ * @brief Free buffer allocated with arena_heap_alloc
+ *
+ * @param region -> arena region
+ * @param buffer -> buffer
+ * @param bytes -> buffer size
+ */
+void arena_heap_free(uint8_t region, void *buffer, uint32_t bytes)
+{
+  if (buffer == NULL)
+    return;
+  free(buffer);
+  arena_heap_account(region, -(int32_t)bytes);
+}
+
+/**
+ * @brief Register pressure callback of a region cache
+ *
+ * @param region -> arena region
+ * @param callback -> pressure callback
+ */
+void set_arena_pressure_cb(uint8_t region, ArenaPressureCb callback)
+{
+  arena[region].on_pressure = callback;
+}
+
+/**
+ * @brief Check PSRAM pressure and let caches shrink. A heap region over its budget is shrunk by its own cache,
+ *        pending requests or free PSRAM under ARENA_LOW_WATER ask all caches. Must be called from LVGL task
+ *
+ */
+void check_arena_pressure()
+{
+  uint32_t released = 0;
+  for (int i = ARENA_FIXED_REGIONS; i < ARENA_REGIONS; i++)
+  {
+    if (arena[i].on_pressure != NULL && arena[i].used > arena[i].budget)
+      released += arena[i].on_pressure(arena[i].used - arena[i].budget);
+  }
+
+  uint32_t needed = arena_pressure_bytes;
+  uint32_t free_psram = ESP.getFreePsram();
+  if (free_psram < ARENA_LOW_WATER)
+    needed = max(needed, (uint32_t)(ARENA_LOW_WATER - free_psram));
+  if (needed > 0)
+  {
+    uint32_t global = 0;
+    for (int i = 0; i < ARENA_REGIONS && global < needed; i++)
+    {
+      if (arena[i].on_pressure != NULL)
+        global += arena[i].on_pressure(needed - global);
+    }
+    arena_pressure_bytes = 0;
+    released += global;
+  }
+
+  if (released > 0)
+  {
+    arena_pressure_released += released;
+    log_v("PSRAM pressure: %d bytes released (%d bytes requested)", released, needed);
+  }
+}
+
+/**
+ * @brief Log arena regions usage, high-water marks and free PSRAM
+ *
+ */
+void log_arena_stats()
+{
+  for (int i = 0; i < ARENA_REGIONS; i++)
+    log_v("PSRAM %s: %d/%d bytes used, %d high-water, %d failed", arena[i].name, arena[i].used, arena[i].budget,
+          arena[i].high_water, arena[i].failed);
+  log_v("PSRAM free: %d bytes, %d bytes released by caches", ESP.getFreePsram(), arena_pressure_released);
+}
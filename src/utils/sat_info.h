@@ -24,6 +24,20 @@ struct SatPos
  */
 SatPos sat_pos;
 
+/**
+ * @brief Satellite color of each system and systems shown (bit mask, 1 << NmeaSystem)
+ *
+ */
+static const uint16_t sat_system_color[NMEA_SYSTEMS] = {TFT_GREEN, TFT_BLUE, TFT_YELLOW, TFT_RED, TFT_ORANGE};
+uint8_t sat_system_mask = 0xFF;
+
+/**
+ * @brief Satellite table version shown (sky plot and SNR bars are updated when table changes)
+ *
+ */
+uint32_t sat_view_version = 0;
+bool sat_view_refresh = true;
+
 /**
  * @brief Sprite for snr GPS Satellite Labels
  *
@@ -32,17 +46,75 @@ TFT_eSprite spr_SNR1 = TFT_eSprite(&tft);
 TFT_eSprite spr_SNR2 = TFT_eSprite(&tft);
 
 /**
- * @brief Sprite for satellite position in map
+ * @brief Sky plot sprites: static background (circles and cardinal points, drawn once)
+ *        and plot (background + satellite marks)
+ *
+ */
+TFT_eSprite constel_spr = TFT_eSprite(&tft);
+TFT_eSprite constel_spr_bkg = TFT_eSprite(&tft);
+
+/**
+ * @brief Sky plot position on screen, size and satellite mark size (dot and number)
  *
  */
-TFT_eSprite spr_Sat = TFT_eSprite(&tft);
+#define SKY_PLOT_X 120
+#define SKY_PLOT_Y 30
+#define SKY_PLOT_W 200
+#define SKY_PLOT_H 150
+#define SKY_MARK_W 18
+#define SKY_MARK_H 16
+#define SKY_DIRTY_RECTS 8
+#define SKY_STATS_UPDATES 10
 
 /**
- * @brief Double Buffering Sprites for Satellite Constellation
+ * @brief Sky plot area (sprite coordinates)
  *
  */
-TFT_eSprite constel_spr = TFT_eSprite(&tft);
-TFT_eSprite constel_spr_bkg = TFT_eSprite(&tft);
+struct SkyRect
+{
+  int16_t x;
+  int16_t y;
+  int16_t w;
+  int16_t h;
+};
+
+/**
+ * @brief Satellite mark drawn in sky plot
+ *
+ */
+struct SkyMark
+{
+  uint16_t x;
+  uint16_t y;
+  uint8_t system;
+  uint8_t prn;
+  bool used;
+  bool drawn;
+};
+SkyMark sky_mark[MAX_SATELLITES] = {};
+
+/**
+ * @brief Sky plot state: areas changed since last push to display, marks slots in use (last drawn + 1)
+ *
+ */
+struct SkyPlot
+{
+  bool ready;
+  bool full_push;
+  uint8_t marks;
+  uint8_t dirty_count;
+  SkyRect dirty[SKY_DIRTY_RECTS];
+};
+SkyPlot sky_plot = {};
+
+/**
+ * @brief Sky plot cost counters (per GSV epoch update, including push to display)
+ *
+ */
+uint32_t sky_bkg_us = 0;
+uint32_t sky_updates = 0;
+uint32_t sky_update_us = 0;
+uint32_t sky_pushed_px = 0;
 
 /**
  * @brief Satellite Signal Graphics Bars Definitions
@@ -70,27 +142,12 @@ SatPos get_sat_pos(uint8_t elev, uint16_t azim)
 }
 
 /**
- * @brief Delete sat info screen sprites and release PSRAM
- *
- */
-static void delete_sat_info_sprites()
-{
-  spr_SNR1.deleteSprite();
-  spr_SNR2.deleteSprite();
-  spr_Sat.deleteSprite();
-  constel_spr.deleteSprite();
-  constel_spr_bkg.deleteSprite();
-}
-
-/**
- * @brief Create Constellation sprite
+ * @brief Draw sky plot background (done once)
  *
  * @param spr -> Sprite
  */
-static void create_const_spr(TFT_eSprite &spr)
+static void draw_sky_plot_bkg(TFT_eSprite &spr)
 {
-  spr.deleteSprite();
-  spr.createSprite(200, 150);
   spr.fillScreen(LVGL_BKG);
   spr.drawCircle(100, 75, 60, TFT_WHITE);
   spr.drawCircle(100, 75, 30, TFT_WHITE);
@@ -101,20 +158,222 @@ static void create_const_spr(TFT_eSprite &spr)
   spr.drawString("S", 97, 127);
   spr.drawString("W", 37, 67);
   spr.drawString("E", 157, 67);
-  spr.setTextFont(1);
 }
 
 /**
- * @brief Create satellite sprite
+ * @brief Clear sky plot satellites (plot is pushed full on next update)
  *
- * @param spr -> Sprite
  */
-static void create_sat_spr(TFT_eSprite &spr)
+static void reset_sky_plot()
 {
-  spr.deleteSprite();
-  spr.createSprite(8, 8);
-  spr.setColorDepth(8);
-  spr.fillScreen(LVGL_BKG);
+  if (!sky_plot.ready)
+  {
+    uint32_t start = micros();
+    arena_sprite(constel_spr_bkg, ARENA_SAT_INFO, SKY_PLOT_W, SKY_PLOT_H);
+    arena_sprite(constel_spr, ARENA_SAT_INFO, SKY_PLOT_W, SKY_PLOT_H);
+    draw_sky_plot_bkg(constel_spr_bkg);
+    constel_spr.setTextFont(1);
+    constel_spr.setTextColor(TFT_WHITE, LVGL_BKG);
+    sky_bkg_us = micros() - start;
+    sky_plot.ready = true;
+  }
+  memcpy(constel_spr.getBuffer(), constel_spr_bkg.getBuffer(), SKY_PLOT_W * SKY_PLOT_H * 2);
+  for (int i = 0; i < sky_plot.marks; i++)
+    sky_mark[i].drawn = false;
+  sky_plot.marks = 0;
+  sky_plot.dirty_count = 0;
+  sky_plot.full_push = true;
+}
+
+/**
+ * @brief Get satellite mark area in sky plot (clipped to plot)
+ *
+ * @param mark -> satellite mark
+ * @return SkyRect -> mark area
+ */
+static SkyRect get_sky_mark_rect(const SkyMark &mark)
+{
+  SkyRect rect = {(int16_t)mark.x, (int16_t)mark.y, SKY_MARK_W, SKY_MARK_H};
+  rect.w = min(rect.w, (int16_t)(SKY_PLOT_W - rect.x));
+  rect.h = min(rect.h, (int16_t)(SKY_PLOT_H - rect.y));
+  return rect;
+}
+
+/**
+ * @brief Check if two sky plot areas overlap
+ *
+ * @param a -> area
+ * @param b -> area
+ * @return true if areas overlap
+ */
+static bool sky_rect_overlap(const SkyRect &a, const SkyRect &b)
+{
+  return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+/**
+ * @brief Add changed area to push (last area grows to include it when list is full)
+ *
+ * @param rect -> changed area
+ */
+static void add_sky_dirty(const SkyRect &rect)
+{
+  if (sky_plot.dirty_count < SKY_DIRTY_RECTS)
+  {
+    sky_plot.dirty[sky_plot.dirty_count++] = rect;
+    return;
+  }
+  SkyRect &last = sky_plot.dirty[SKY_DIRTY_RECTS - 1];
+  int16_t x2 = max(last.x + last.w, rect.x + rect.w);
+  int16_t y2 = max(last.y + last.h, rect.y + rect.h);
+  last.x = min(last.x, rect.x);
+  last.y = min(last.y, rect.y);
+  last.w = x2 - last.x;
+  last.h = y2 - last.y;
+}
+
+/**
+ * @brief Erase satellite mark restoring plot background below it
+ *
+ * @param mark -> satellite mark
+ */
+static void erase_sky_mark(SkyMark &mark)
+{
+  SkyRect rect = get_sky_mark_rect(mark);
+  for (int y = rect.y; y < rect.y + rect.h; y++)
+    memcpy(get_sprite_ptr(constel_spr, rect.x, y), get_sprite_ptr(constel_spr_bkg, rect.x, y), rect.w * 2);
+  add_sky_dirty(rect);
+  mark.drawn = false;
+}
+
+/**
+ * @brief Draw satellite mark (dot, filled if satellite is used in fix, and satellite number)
+ *
+ * @param id -> satellite table slot
+ */
+static void draw_sky_mark(uint8_t id)
+{
+  SkyMark &mark = sky_mark[id];
+  uint16_t color = sat_system_color[mark.system];
+  if (mark.used)
+    constel_spr.fillCircle(mark.x + 4, mark.y + 4, 2, color);
+  else
+    constel_spr.drawCircle(mark.x + 4, mark.y + 4, 2, color);
+  constel_spr.setCursor(mark.x, mark.y + 8);
+  constel_spr.print(mark.prn);
+  mark.drawn = true;
+  if (id >= sky_plot.marks)
+    sky_plot.marks = id + 1;
+}
+
+/**
+ * @brief Check if satellite is shown (seen and its system selected)
+ *
+ * @param sat -> satellite
+ * @return true if satellite is shown
+ */
+static bool is_sat_shown(const SatInfo &sat)
+{
+  return sat.prn != 0 && (sat_system_mask & (1 << sat.system));
+}
+
+/**
+ * @brief Push changed sky plot areas to display
+ *
+ */
+static void push_sky_plot()
+{
+  if (sky_plot.full_push)
+  {
+    constel_spr.pushSprite(SKY_PLOT_X, SKY_PLOT_Y);
+    sky_pushed_px += SKY_PLOT_W * SKY_PLOT_H;
+  }
+  else
+  {
+    for (int i = 0; i < sky_plot.dirty_count; i++)
+    {
+      const SkyRect &rect = sky_plot.dirty[i];
+      tft.setClipRect(SKY_PLOT_X + rect.x, SKY_PLOT_Y + rect.y, rect.w, rect.h);
+      constel_spr.pushSprite(SKY_PLOT_X, SKY_PLOT_Y);
+      sky_pushed_px += rect.w * rect.h;
+    }
+    tft.clearClipRect();
+  }
+  sky_plot.full_push = false;
+  sky_plot.dirty_count = 0;
+}
+
+/**
+ * @brief Update sky plot with shown satellites positions (once per satellite table update).
+ *        Only moved, new or lost satellite marks are redrawn and pushed
+ *
+ */
+static void update_sky_plot()
+{
+  uint32_t start = micros();
+  if (!sky_plot.ready)
+    reset_sky_plot();
+
+  // Erase lost and moved marks
+  for (int i = 0; i < sky_plot.marks; i++)
+  {
+    SkyMark &mark = sky_mark[i];
+    if (!mark.drawn)
+      continue;
+    const SatInfo &sat = sat_table.sat[i];
+    if (i >= sat_table.count || !is_sat_shown(sat) || mark.prn != sat.prn || mark.system != sat.system ||
+        mark.used != sat.used || mark.x != sat.pos_x || mark.y != sat.pos_y)
+      erase_sky_mark(mark);
+  }
+
+  // Redraw marks overlapping erased areas
+  uint8_t erased = sky_plot.dirty_count;
+  for (int i = 0; i < sky_plot.marks && erased > 0; i++)
+  {
+    if (!sky_mark[i].drawn)
+      continue;
+    SkyRect rect = get_sky_mark_rect(sky_mark[i]);
+    for (int j = 0; j < erased; j++)
+    {
+      if (sky_rect_overlap(rect, sky_plot.dirty[j]))
+      {
+        draw_sky_mark(i);
+        break;
+      }
+    }
+  }
+
+  // Draw new marks
+  for (int i = 0; i < sat_table.count; i++)
+  {
+    SkyMark &mark = sky_mark[i];
+    const SatInfo &sat = sat_table.sat[i];
+    if (is_sat_shown(sat) && !mark.drawn)
+    {
+      mark.x = sat.pos_x;
+      mark.y = sat.pos_y;
+      mark.system = sat.system;
+      mark.prn = sat.prn;
+      mark.used = sat.used;
+      draw_sky_mark(i);
+      add_sky_dirty(get_sky_mark_rect(mark));
+    }
+  }
+  while (sky_plot.marks > 0 && !sky_mark[sky_plot.marks - 1].drawn)
+    sky_plot.marks--;
+
+  push_sky_plot();
+
+  sky_update_us += micros() - start;
+  sky_updates++;
+  if (sky_updates == SKY_STATS_UPDATES)
+  {
+    log_v("Sky plot: %d us/update, %d px pushed/update (full plot %d px), background %d us (built once)",
+          sky_update_us / sky_updates, sky_pushed_px / sky_updates, SKY_PLOT_W * SKY_PLOT_H, sky_bkg_us);
+    sky_updates = 0;
+    sky_update_us = 0;
+    sky_pushed_px = 0;
+  }
 }
 
 /**
@@ -124,9 +383,7 @@ static void create_sat_spr(TFT_eSprite &spr)
  */
 static void create_snr_spr(TFT_eSprite &spr)
 {
-  spr.deleteSprite();
-  spr.createSprite(TFT_WIDTH, 10);
-  spr.setColorDepth(8);
+  arena_sprite(spr, ARENA_SAT_INFO, TFT_WIDTH, 10);
   spr.fillScreen(LVGL_BKG);
   spr.setTextColor(TFT_WHITE, LVGL_BKG);
 }
@@ -139,107 +396,78 @@ static void create_snr_spr(TFT_eSprite &spr)
  * @param id -> Active Sat
  * @param sat_num -> Sat ID
  * @param snr -> Sat SNR
+ * @param color -> Sat number color (system color)
  * @param spr -> Sat number sprite
  */
-static void draw_snr_bar(lv_obj_t *bar, lv_chart_series_t *bar_ser, uint8_t id, uint8_t sat_num, uint8_t snr, TFT_eSprite &spr)
+static void draw_snr_bar(lv_obj_t *bar, lv_chart_series_t *bar_ser, uint8_t id, uint8_t sat_num, uint8_t snr, uint16_t color, TFT_eSprite &spr)
 {
   lv_point_t p;
   bar_ser->y_points[id] = snr;
   lv_chart_get_point_pos_by_id(bar, bar_ser, id, &p);
+  spr.setTextColor(color, LVGL_BKG);
   spr.setCursor(p.x - 2, 0);
   spr.print(sat_num);
 }
 
 /**
- * @brief Clear Satellite in View found
+ * @brief Select shown satellite systems (sky plot and SNR bars are redrawn)
  *
+ * @param mask -> systems bit mask (1 << NmeaSystem)
  */
-static void clear_sat_in_view()
+static void set_sat_system_mask(uint8_t mask)
 {
-  for (int clear = 0; clear < MAX_SATELLITES; clear++)
-  {
-    sat_tracker[clear].sat_num = 0;
-    sat_tracker[clear].elev = 0;
-    sat_tracker[clear].azim = 0;
-    sat_tracker[clear].snr = 0;
-    sat_tracker[clear].active = false;
-  }
+  sat_system_mask = mask;
+  sat_view_refresh = true;
 }
 
 /**
- * @brief Display satellite in view info
+ * @brief Display satellites in view of all shown systems (when satellite table changes).
+ *        Satellite table is read with gps_mutex taken
  *
- * @param gsv -> GSV NMEA sentence
- * @param color -> Satellite color in constellation
  */
-static void fill_sat_in_view(GSV &gsv, int color)
+static void update_sat_in_view()
 {
-  if (gsv.totalMsg.isUpdated())
-  {
-    lv_chart_refresh(satbar_1);
-    lv_chart_refresh(satbar_2);
+  if (!sat_view_refresh && sat_view_version == sat_table.version)
+    return;
+  xSemaphoreTake(gps_mutex, portMAX_DELAY);
+  sat_view_refresh = false;
+  sat_view_version = sat_table.version;
 
-    for (int i = 0; i < 4; ++i)
-    {
-      int no = atoi(gsv.satNum[i].value());
-      if (no >= 1 && no <= MAX_SATELLITES)
-      {
-        sat_tracker[no - 1].sat_num = atoi(gsv.satNum[i].value());
-        sat_tracker[no - 1].elev = atoi(gsv.elev[i].value());
-        sat_tracker[no - 1].azim = atoi(gsv.azim[i].value());
-        sat_tracker[no - 1].snr = atoi(gsv.snr[i].value());
-        sat_tracker[no - 1].active = true;
-      }
-    }
+  lv_chart_refresh(satbar_1);
+  lv_chart_refresh(satbar_2);
 
-    uint8_t totalMessages = atoi(gsv.totalMsg.value());
-    uint8_t currentMessage = atoi(gsv.msgNum.value());
+  create_snr_spr(spr_SNR1);
+  create_snr_spr(spr_SNR2);
 
-    if (totalMessages == currentMessage)
-    {
-      create_snr_spr(spr_SNR1);
-      create_snr_spr(spr_SNR2);
+  for (int i = 0; i < (MAX_SATELLLITES_IN_VIEW / 2); i++)
+  {
+    satbar_ser1->y_points[i] = LV_CHART_POINT_NONE;
+    satbar_ser2->y_points[i] = LV_CHART_POINT_NONE;
+  }
 
-      for (int i = 0; i < (MAX_SATELLLITES_IN_VIEW / 2); i++)
-      {
-        satbar_ser1->y_points[i] = LV_CHART_POINT_NONE;
-        satbar_ser2->y_points[i] = LV_CHART_POINT_NONE;
-      }
+  uint8_t active_sat = 0;
+  for (int i = 0; i < sat_table.count; ++i)
+  {
+    SatInfo &sat = sat_table.sat[i];
+    if (!is_sat_shown(sat))
+      continue;
 
-      uint8_t active_sat = 0;
-      for (int i = 0; i < MAX_SATELLITES; ++i)
-      {
-        if (sat_tracker[i].active) // && sat_tracker[i].snr > 0)
-        {
-          if (active_sat < (MAX_SATELLLITES_IN_VIEW / 2))
-            draw_snr_bar(satbar_1, satbar_ser1, active_sat, sat_tracker[i].sat_num, sat_tracker[i].snr, spr_SNR1);
-          else
-            draw_snr_bar(satbar_2, satbar_ser2, (active_sat - (MAX_SATELLLITES_IN_VIEW / 2)), sat_tracker[i].sat_num, sat_tracker[i].snr, spr_SNR2);
-
-          active_sat++;
-
-          sat_pos = get_sat_pos(sat_tracker[i].elev, sat_tracker[i].azim);
-
-          spr_Sat.fillCircle(4, 4, 2, color);
-          spr_Sat.pushSprite(&constel_spr, sat_pos.x, sat_pos.y, TFT_TRANSPARENT);
-          constel_spr.setCursor(sat_pos.x, sat_pos.y + 8);
-          constel_spr.print(i + 1);
-
-          if (sat_tracker[i].pos_x != sat_pos.x || sat_tracker[i].pos_y != sat_pos.y)
-          {
-            constel_spr_bkg.pushSprite(120, 30);
-          }
-
-          sat_tracker[i].pos_x = sat_pos.x;
-          sat_tracker[i].pos_y = sat_pos.y;
-        }
-      }
-      constel_spr.pushSprite(120, 30);
-    }
+    uint16_t color = sat_system_color[sat.system];
+    if (active_sat < (MAX_SATELLLITES_IN_VIEW / 2))
+      draw_snr_bar(satbar_1, satbar_ser1, active_sat, sat.prn, sat.snr, color, spr_SNR1);
+    else if (active_sat < MAX_SATELLLITES_IN_VIEW)
+      draw_snr_bar(satbar_2, satbar_ser2, (active_sat - (MAX_SATELLLITES_IN_VIEW / 2)), sat.prn, sat.snr, color, spr_SNR2);
+    active_sat++;
 
-    lv_chart_refresh(satbar_1);
-    spr_SNR1.pushSprite(0, 260);
-    lv_chart_refresh(satbar_2);
-    spr_SNR2.pushSprite(0, 345);
+    sat_pos = get_sat_pos(sat.elev, sat.azim);
+    sat.pos_x = sat_pos.x;
+    sat.pos_y = sat_pos.y;
   }
+  update_sky_plot();
+
+  lv_chart_refresh(satbar_1);
+  spr_SNR1.pushSprite(0, 260);
+  lv_chart_refresh(satbar_2);
+  spr_SNR2.pushSprite(0, 345);
+  xSemaphoreGive(gps_mutex);
 }
@@ -0,0 +1,673 @@
+/**
+ * @file tile_cache.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Decoded map tile cache (PSRAM) with LRU eviction
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+#include <atomic>
+
+/**
+ * @brief Max decoded tiles in cache (cache budget TILE_CACHE_SIZE is set in psram_arena.h)
+ *
+ */
+#define MAX_CACHED_TILES 32
+#define MIN_CACHED_TILES 1
+#define OVERZOOM_LEVELS 4
+#define MISSING_TILES 64 // Recently missing tiles (not found and not synthesized), not looked up again
+
+/**
+ * @brief Tile decoders (each task decoding tiles uses its own sprite and compressed data buffer)
+ *
+ */
+enum TileDecoder
+{
+  DECODER_UI,
+  DECODER_PREFETCH,
+  TILE_DECODERS
+};
+
+/**
+ * @brief Structure to store a decoded RGB565 tile and its key (zoom, tileX, tileY)
+ *
+ */
+struct CachedTile
+{
+  uint16_t *buffer;
+  uint32_t tilex;
+  uint32_t tiley;
+  uint8_t zoom;
+  bool valid;
+  bool prefetched;
+  uint32_t last_used;
+};
+
+CachedTile tile_cache[MAX_CACHED_TILES];
+uint8_t tile_cache_slots = 0;
+
+/**
+ * @brief Tile cache counters
+ *
+ */
+uint32_t tile_cache_tick = 0;
+uint32_t tile_cache_hits = 0;
+uint32_t tile_cache_misses = 0;
+uint32_t tile_cache_evictions = 0;
+uint32_t tile_prefetch_ready = 0;
+uint32_t tile_synthesized = 0;
+uint32_t tile_missing_skipped = 0;
+
+/**
+ * @brief Tile decode latency counters (per tile format, updated by renderer and prefetch task)
+ *
+ */
+std::atomic<uint32_t> tile_decode_us[TILE_FORMATS] = {};
+std::atomic<uint32_t> tile_decode_count[TILE_FORMATS] = {};
+
+/**
+ * @brief Sprite used to decode tiles directly into a cache slot buffer
+ *
+ */
+TFT_eSprite tile_spr = TFT_eSprite(&tft);
+
+/**
+ * @brief Staging buffer where missed tiles are decoded, swapped with the LRU slot buffer only if decode succeeds
+ *        (a missing tile never evicts a cached one)
+ *
+ */
+uint16_t *tile_stage_buf = NULL;
+
+/**
+ * @brief Recently missing tiles (ring)
+ *
+ */
+MapTile tile_missing[MISSING_TILES] = {};
+uint8_t tile_missing_idx = 0;
+
+/**
+ * @brief Ancestor tile buffer used to synthesize missing tiles (overzoom)
+ *
+ */
+uint16_t *overzoom_buf = NULL;
+MapTile overzoom_tile = {NULL, 0, 0, 0xFF};
+
+/**
+ * @brief Persistent compressed tile data buffers (per decoder), larger tiles use a temporary heap buffer
+ *
+ */
+uint8_t *tile_decode_buf[TILE_DECODERS] = {};
+
+/**
+ * @brief Release least recently used cache slots on PSRAM pressure (keeps MIN_CACHED_TILES slots)
+ *
+ * @param bytes -> bytes to release
+ * @return uint32_t -> released bytes
+ */
+uint32_t shrink_tile_cache(uint32_t bytes)
+{
+  uint32_t released = 0;
+  while (released < bytes && tile_cache_slots > MIN_CACHED_TILES)
+  {
+    uint8_t lru = 0;
+    for (int i = 1; i < tile_cache_slots; i++)
+    {
+      if (!tile_cache[i].valid || (tile_cache[lru].valid && tile_cache[i].last_used < tile_cache[lru].last_used))
+        lru = i;
+    }
+    arena_heap_free(ARENA_TILES, tile_cache[lru].buffer, TILE_BYTES);
+    tile_cache_slots--;
+    tile_cache[lru] = tile_cache[tile_cache_slots];
+    tile_cache[tile_cache_slots].buffer = NULL;
+    tile_cache[tile_cache_slots].valid = false;
+    released += TILE_BYTES;
+  }
+  if (released > 0)
+    log_v("Tile cache: shrunk to %d slots", tile_cache_slots);
+  return released;
+}
+
+/**
+ * @brief Reserve compressed tile data buffer of a decoder
+ *
+ * @param decoder -> tile decoder
+ */
+void init_tile_decoder(uint8_t decoder)
+{
+  if (tile_decode_buf[decoder] == NULL)
+    tile_decode_buf[decoder] = (uint8_t *)arena_heap_alloc(ARENA_TILES, TILE_DECODE_BYTES);
+}
+
+/**
+ * @brief Get buffer for compressed tile data
+ *
+ * @param decoder -> tile decoder
+ * @param size -> tile data size
+ * @return uint8_t* -> decoder buffer, or heap buffer if tile doesn't fit (release with release_decode_buffer)
+ */
+static uint8_t *get_decode_buffer(uint8_t decoder, uint32_t size)
+{
+  if (tile_decode_buf[decoder] != NULL && size <= TILE_DECODE_BYTES)
+    return tile_decode_buf[decoder];
+  return (uint8_t *)arena_heap_alloc(ARENA_TILES, size);
+}
+
+/**
+ * @brief Release buffer got with get_decode_buffer
+ *
+ * @param decoder -> tile decoder
+ * @param data -> buffer
+ * @param size -> tile data size
+ */
+static void release_decode_buffer(uint8_t decoder, uint8_t *data, uint32_t size)
+{
+  if (data != tile_decode_buf[decoder])
+    arena_heap_free(ARENA_TILES, data, size);
+}
+
+/**
+ * @brief Init tile cache and reserve PSRAM slots
+ *
+ * @param budget -> cache size in bytes
+ */
+void init_tile_cache(uint32_t budget = TILE_CACHE_SIZE)
+{
+  uint8_t slots = budget / TILE_BYTES;
+  if (slots > MAX_CACHED_TILES)
+    slots = MAX_CACHED_TILES;
+
+  // Staging buffer first: cache slots are useless without it (renderer then decodes into map sprite)
+  tile_cache_slots = 0;
+  tile_stage_buf = (uint16_t *)arena_heap_alloc(ARENA_TILES, TILE_BYTES);
+  if (tile_stage_buf == NULL)
+  {
+    log_e("Tile cache: no PSRAM for staging buffer, cache disabled");
+    slots = 0;
+  }
+  for (int i = 0; i < slots; i++)
+  {
+    tile_cache[i].buffer = (uint16_t *)arena_heap_alloc(ARENA_TILES, TILE_BYTES);
+    if (tile_cache[i].buffer == NULL)
+      break;
+    tile_cache[i].valid = false;
+    tile_cache[i].prefetched = false;
+    tile_cache[i].last_used = 0;
+    tile_cache_slots++;
+  }
+  overzoom_buf = (uint16_t *)arena_heap_alloc(ARENA_TILES, TILE_BYTES);
+  init_tile_decoder(DECODER_UI);
+  for (int i = 0; i < MISSING_TILES; i++)
+    tile_missing[i].zoom = 0xFF;
+  set_arena_pressure_cb(ARENA_TILES, shrink_tile_cache);
+  log_v("Tile cache: %d slots (%d bytes)", tile_cache_slots, tile_cache_slots * TILE_BYTES);
+}
+
+/**
+ * @brief Search tile in cache
+ *
+ * @param tile -> Map Tile structure
+ * @return CachedTile* -> cache entry or NULL if not cached
+ */
+CachedTile *find_cached_tile(const MapTile &tile)
+{
+  for (int i = 0; i < tile_cache_slots; i++)
+  {
+    if (tile_cache[i].valid && tile_cache[i].zoom == tile.zoom &&
+        tile_cache[i].tilex == tile.tilex && tile_cache[i].tiley == tile.tiley)
+      return &tile_cache[i];
+  }
+  return NULL;
+}
+
+/**
+ * @brief Check if tile was recently missing
+ *
+ * @param tile -> Map Tile structure
+ * @return true if tile is in missing tiles ring
+ */
+static bool is_missing_tile(const MapTile &tile)
+{
+  for (int i = 0; i < MISSING_TILES; i++)
+  {
+    if (tile_missing[i].zoom == tile.zoom && tile_missing[i].tilex == tile.tilex && tile_missing[i].tiley == tile.tiley)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Remember missing tile (oldest entry is overwritten)
+ *
+ * @param tile -> Map Tile structure
+ */
+static void add_missing_tile(const MapTile &tile)
+{
+  tile_missing[tile_missing_idx].zoom = tile.zoom;
+  tile_missing[tile_missing_idx].tilex = tile.tilex;
+  tile_missing[tile_missing_idx].tiley = tile.tiley;
+  tile_missing_idx = (tile_missing_idx + 1) % MISSING_TILES;
+}
+
+/**
+ * @brief Get a free cache slot or the least recently used one
+ *
+ * @return CachedTile* -> cache entry to overwrite
+ */
+CachedTile *get_lru_tile()
+{
+  CachedTile *lru = &tile_cache[0];
+  for (int i = 0; i < tile_cache_slots; i++)
+  {
+    if (!tile_cache[i].valid)
+      return &tile_cache[i];
+    if (tile_cache[i].last_used < lru->last_used)
+      lru = &tile_cache[i];
+  }
+  tile_cache_evictions++;
+  return lru;
+}
+
+/**
+ * @brief Get sprite buffer pointer at position (16 bits sprite)
+ *
+ * @param spr -> sprite
+ * @param x -> X position
+ * @param y -> Y position
+ * @return uint16_t* -> pixel pointer
+ */
+static inline uint16_t *get_sprite_ptr(TFT_eSprite &spr, int16_t x, int16_t y)
+{
+  return (uint16_t *)spr.getBuffer() + (y * spr.width()) + x;
+}
+
+/**
+ * @brief Read raw RGB565 tile (already in sprite memory layout) into sprite
+ *
+ * @param file -> opened file (at tile data position)
+ * @param spr -> destination sprite
+ * @param x -> X position in sprite
+ * @param y -> Y position in sprite
+ * @return true if tile is read
+ */
+bool read_raw_tile(File &file, TFT_eSprite &spr, int16_t x, int16_t y)
+{
+  uint16_t *dst = get_sprite_ptr(spr, x, y);
+  if (spr.width() == tileSize)
+    return file.read((uint8_t *)dst, TILE_BYTES) == TILE_BYTES;
+
+  for (int row = 0; row < tileSize; row++)
+  {
+    if (file.read((uint8_t *)(dst + (row * spr.width())), tileSize * sizeof(uint16_t)) != tileSize * sizeof(uint16_t))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Decode tile file (/MAP/zoom/x/y.ext) into sprite
+ *
+ * @param tile -> Map Tile structure
+ * @param spr -> destination sprite (each task must use its own)
+ * @param x -> X position in sprite
+ * @param y -> Y position in sprite
+ * @param decoder -> tile decoder (compressed data buffer of calling task)
+ * @return true if tile is decoded
+ */
+bool decode_tile_file(const MapTile &tile, TFT_eSprite &spr, int16_t x, int16_t y, uint8_t decoder = DECODER_UI)
+{
+  uint8_t format = get_tile_format(tile.file);
+  if (format == TILE_PNG)
+    return spr.drawPngFile(SD, tile.file, x, y);
+
+  File file = SD.open(tile.file, FILE_READ);
+  if (!file)
+    return false;
+
+  bool decoded = false;
+  if (format == TILE_RAW)
+    decoded = read_raw_tile(file, spr, x, y);
+  else
+  {
+    uint32_t size = file.size();
+    uint8_t *data = get_decode_buffer(decoder, size);
+    if (data != NULL)
+    {
+      decoded = (file.read(data, size) == size) && decode_ipt_tile(data, size, get_sprite_ptr(spr, x, y), spr.width());
+      release_decode_buffer(decoder, data, size);
+    }
+  }
+  file.close();
+  return decoded;
+}
+
+/**
+ * @brief Decode tile stored in a tile pack into sprite
+ *
+ * @param pack -> tile pack
+ * @param offset -> tile data offset
+ * @param size -> tile data size
+ * @param spr -> destination sprite (each task must use its own)
+ * @param x -> X position in sprite
+ * @param y -> Y position in sprite
+ * @param decoder -> tile decoder (compressed data buffer of calling task)
+ * @return true if tile is decoded
+ */
+bool decode_packed_tile(TilePack *pack, uint32_t offset, uint32_t size, TFT_eSprite &spr, int16_t x, int16_t y,
+                        uint8_t decoder = DECODER_UI)
+{
+  if (pack->format == TILE_RAW)
+  {
+    if (size != TILE_BYTES)
+      return false;
+    xSemaphoreTake(tile_pack_mutex, portMAX_DELAY);
+    bool read = pack->file.seek(offset) && read_raw_tile(pack->file, spr, x, y);
+    xSemaphoreGive(tile_pack_mutex);
+    return read;
+  }
+
+  uint8_t *data = get_decode_buffer(decoder, size);
+  if (data == NULL)
+    return false;
+  bool decoded = read_packed_tile(pack, offset, size, data);
+  if (decoded)
+  {
+    if (pack->format == TILE_IPT)
+      decoded = decode_ipt_tile(data, size, get_sprite_ptr(spr, x, y), spr.width());
+    else
+      decoded = spr.drawPng(data, size, x, y);
+  }
+  release_decode_buffer(decoder, data, size);
+  return decoded;
+}
+
+/**
+ * @brief Decode tile into sprite (from tile packs if loaded, else from tile files)
+ *
+ * @param tile -> Map Tile structure
+ * @param spr -> destination sprite (each task must use its own)
+ * @param x -> X position in sprite
+ * @param y -> Y position in sprite
+ * @param decoder -> tile decoder (compressed data buffer of calling task)
+ * @return true if tile is decoded
+ */
+bool decode_tile(const MapTile &tile, TFT_eSprite &spr, int16_t x = 0, int16_t y = 0, uint8_t decoder = DECODER_UI)
+{
+  uint32_t start = micros();
+  uint8_t format;
+  bool decoded;
+
+  if (tile_packs > 0)
+  {
+    uint32_t offset, size;
+    TilePack *pack = find_packed_tile(tile.zoom, tile.tilex, tile.tiley, offset, size);
+    if (pack == NULL)
+      return false;
+    format = pack->format;
+    decoded = decode_packed_tile(pack, offset, size, spr, x, y, decoder);
+  }
+  else
+  {
+    if (!is_tile_available(tile.zoom, tile.tilex, tile.tiley))
+      return false;
+    format = get_tile_format(tile.file);
+    decoded = decode_tile_file(tile, spr, x, y, decoder);
+  }
+
+  if (decoded)
+  {
+    tile_decode_us[format].fetch_add(micros() - start, std::memory_order_relaxed);
+    tile_decode_count[format].fetch_add(1, std::memory_order_relaxed);
+  }
+  return decoded;
+}
+
+/**
+ * @brief Upscale a square area of a tile to a full tile (integer nearest neighbour)
+ *
+ * @param src -> source tile (256x256)
+ * @param src_x -> area X position in source tile
+ * @param src_y -> area Y position in source tile
+ * @param shift -> scale factor (1 << shift)
+ * @param dst -> destination (top left pixel of tile)
+ * @param stride -> destination width in pixels
+ */
+void upscale_tile(const uint16_t *src, uint16_t src_x, uint16_t src_y, uint8_t shift, uint16_t *dst, uint16_t stride)
+{
+  const uint16_t area = tileSize >> shift;
+  const uint16_t scale = 1 << shift;
+
+  for (int row = 0; row < area; row++)
+  {
+    const uint16_t *s = src + ((src_y + row) * tileSize) + src_x;
+    uint16_t *d = dst + (row * scale * stride);
+    uint16_t *first = d;
+    for (int col = 0; col < area; col++)
+    {
+      for (int i = 0; i < scale; i++)
+        *d++ = s[col];
+    }
+    for (int i = 1; i < scale; i++)
+      memcpy(first + (i * stride), first, tileSize * sizeof(uint16_t));
+  }
+}
+
+/**
+ * @brief Synthesize a missing tile cropping and upscaling the nearest available ancestor tile
+ *        (zoom - 1, zoom - 2, ...)
+ *
+ * @param tile -> Map Tile structure (missing tile)
+ * @param dst -> destination (top left pixel of tile)
+ * @param stride -> destination width in pixels
+ * @return true if tile is synthesized
+ */
+bool synthesize_tile(const MapTile &tile, uint16_t *dst, uint16_t stride)
+{
+  for (uint8_t shift = 1; shift <= OVERZOOM_LEVELS && shift <= tile.zoom; shift++)
+  {
+    char path[40];
+    MapTile parent = {path, tile.tilex >> shift, tile.tiley >> shift, (uint8_t)(tile.zoom - shift)};
+    const uint16_t *src = NULL;
+
+    CachedTile *entry = find_cached_tile(parent);
+    if (entry != NULL)
+      src = entry->buffer;
+    else if (overzoom_buf != NULL)
+    {
+      if (overzoom_tile.zoom == parent.zoom && overzoom_tile.tilex == parent.tilex && overzoom_tile.tiley == parent.tiley)
+        src = overzoom_buf;
+      else
+      {
+        get_tile_path(path, parent.zoom, parent.tilex, parent.tiley);
+        overzoom_tile.zoom = 0xFF;
+        tile_spr.setBuffer(overzoom_buf, tileSize, tileSize);
+        if (decode_tile(parent, tile_spr))
+        {
+          overzoom_tile.zoom = parent.zoom;
+          overzoom_tile.tilex = parent.tilex;
+          overzoom_tile.tiley = parent.tiley;
+          src = overzoom_buf;
+        }
+      }
+    }
+
+    if (src != NULL)
+    {
+      uint32_t mask = (1 << shift) - 1;
+      uint16_t area = tileSize >> shift;
+      upscale_tile(src, (tile.tilex & mask) * area, (tile.tiley & mask) * area, shift, dst, stride);
+      tile_synthesized++;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Get decoded tile from cache, decoding it from SD if not cached. Tile is decoded into the staging
+ *        buffer, which is swapped with the LRU slot buffer on success
+ *
+ * @param tile -> Map Tile structure
+ * @return uint16_t* -> decoded tile buffer or NULL if tile not found
+ */
+uint16_t *get_cached_tile(const MapTile &tile)
+{
+  tile_cache_tick++;
+
+  CachedTile *entry = find_cached_tile(tile);
+  if (entry != NULL)
+  {
+    tile_cache_hits++;
+    if (entry->prefetched)
+    {
+      tile_prefetch_ready++;
+      entry->prefetched = false;
+    }
+    entry->last_used = tile_cache_tick;
+    return entry->buffer;
+  }
+
+  tile_cache_misses++;
+
+  if (tile_cache_slots == 0 || tile_stage_buf == NULL)
+    return NULL;
+  if (is_missing_tile(tile))
+  {
+    tile_missing_skipped++;
+    return NULL;
+  }
+
+  tile_spr.setBuffer(tile_stage_buf, tileSize, tileSize);
+  if (!decode_tile(tile, tile_spr) && !synthesize_tile(tile, tile_stage_buf, tileSize))
+  {
+    add_missing_tile(tile);
+    return NULL;
+  }
+
+  entry = get_lru_tile();
+  uint16_t *decoded = tile_stage_buf;
+  tile_stage_buf = entry->buffer;
+  entry->buffer = decoded;
+  entry->prefetched = false;
+  entry->zoom = tile.zoom;
+  entry->tilex = tile.tilex;
+  entry->tiley = tile.tiley;
+  entry->last_used = tile_cache_tick;
+  entry->valid = true;
+  return entry->buffer;
+}
+
+/**
+ * @brief Insert an already decoded tile into cache swapping buffers (no copy)
+ *
+ * @param zoom -> zoom level
+ * @param tilex -> Tile X
+ * @param tiley -> Tile Y
+ * @param buffer -> decoded tile buffer
+ * @return uint16_t* -> buffer released by the cache (to be reused by caller)
+ */
+uint16_t *insert_cached_tile(uint8_t zoom, uint32_t tilex, uint32_t tiley, uint16_t *buffer)
+{
+  MapTile tile = {NULL, tilex, tiley, zoom};
+  if (tile_cache_slots == 0 || find_cached_tile(tile) != NULL)
+    return buffer;
+
+  CachedTile *entry = get_lru_tile();
+  uint16_t *released = entry->buffer;
+  entry->buffer = buffer;
+  entry->zoom = zoom;
+  entry->tilex = tilex;
+  entry->tiley = tiley;
+  entry->prefetched = true;
+  entry->last_used = tile_cache_tick;
+  entry->valid = true;
+  return released;
+}
+
+/**
+ * @brief Clear all cached tiles
+ *
+ */
+void clear_tile_cache()
+{
+  for (int i = 0; i < tile_cache_slots; i++)
+    tile_cache[i].valid = false;
+  for (int i = 0; i < MISSING_TILES; i++)
+    tile_missing[i].zoom = 0xFF;
+  overzoom_tile.zoom = 0xFF;
+}
+
+/**
+ * @brief Log tile cache hit rate
+ *
+ */
+void log_tile_cache_stats()
+{
+  uint32_t total = tile_cache_hits + tile_cache_misses;
+  log_v("Tile cache: %d hits, %d misses, %d evictions (%d%% hit rate), %d synthesized, %d missing skipped", tile_cache_hits,
+        tile_cache_misses, tile_cache_evictions, total ? (tile_cache_hits * 100) / total : 0, tile_synthesized,
+        tile_missing_skipped);
+  if (tile_index_ready)
+    log_v("Tile index: %d missing tile lookups skipped", tile_index_skipped.load());
+  for (int i = 0; i < TILE_FORMATS; i++)
+  {
+    uint32_t count = tile_decode_count[i].load();
+    if (count > 0)
+      log_v("Tile decode %s: %d tiles, %d us/tile", tile_ext[i], count, tile_decode_us[i].load() / count);
+  }
+}
+
+#ifdef TILE_BENCHMARK
+/**
+ * @brief Compare per-tile open+read+decode latency of every tile format and tile packs for the same tiles
+ *
+ * @param zoom_level -> zoom level
+ * @param x -> first Tile X
+ * @param y -> first Tile Y
+ * @param count -> tiles to test (along X)
+ */
+void benchmark_tile_formats(uint8_t zoom_level, uint32_t x, uint32_t y, uint8_t count)
+{
+  uint16_t *buffer = (uint16_t *)ps_malloc(TILE_BYTES);
+  if (buffer == NULL)
+    return;
+  tile_spr.setBuffer(buffer, tileSize, tileSize);
+
+  for (int format = 0; format < TILE_FORMATS; format++)
+  {
+    uint32_t total_us = 0;
+    uint8_t loaded = 0;
+    for (int i = 0; i < count; i++)
+    {
+      char path[40];
+      sprintf(path, PSTR("/MAP/%d/%d/%d.%s"), zoom_level, x + i, y, tile_ext[format]);
+      MapTile tile = {path, x + i, y, zoom_level};
+      uint32_t start = micros();
+      if (decode_tile_file(tile, tile_spr, 0, 0))
+      {
+        total_us += micros() - start;
+        loaded++;
+      }
+    }
+    if (loaded > 0)
+      log_v("Benchmark %s files: %d tiles, %d us/tile", tile_ext[format], loaded, total_us / loaded);
+  }
+
+  uint32_t total_us = 0;
+  uint8_t loaded = 0;
+  for (int i = 0; i < count; i++)
+  {
+    uint32_t start = micros();
+    uint32_t offset, size;
+    TilePack *pack = find_packed_tile(zoom_level, x + i, y, offset, size);
+    if (pack != NULL && decode_packed_tile(pack, offset, size, tile_spr, 0, 0))
+    {
+      total_us += micros() - start;
+      loaded++;
+    }
+  }
+  if (loaded > 0)
+    log_v("Benchmark tile packs: %d tiles, %d us/tile", loaded, total_us / loaded);
+
+  free(buffer);
+}
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file tile_codec.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Palette + RLE map tile codec (.ipt) decoder
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+/**
+ * @brief IPT tile layout (built by tools/png2ipt.py)
+ *
+ *        uint8_t           -> palette colors - 1
+ *        uint16_t[colors]  -> palette, RGB565 byte-swapped (sprite memory layout)
+ *        tokens            -> palette indexes of 256x256 pixels, row by row
+ *
+ *        Tokens:
+ *        0nnnnnnn          -> literal, n + 1 indexes follow
+ *        1nnnnnnn          -> run of n + 2 pixels (n < 127), one index follows
+ *        11111111          -> long run, uint16_t count (little endian) and one index follow
+ *
+ */
+#define IPT_LONG_RUN 0xFF
+
+/**
+ * @brief Decode IPT tile into RGB565 buffer
+ *
+ * @param data -> IPT tile data
+ * @param size -> IPT tile data size
+ * @param dst -> destination (top left pixel of tile)
+ * @param stride -> destination width in pixels
+ * @return true if tile is decoded
+ */
+bool decode_ipt_tile(const uint8_t *data, uint32_t size, uint16_t *dst, uint16_t stride)
+{
+  const uint8_t *end = data + size;
+  if (size == 0)
+    return false;
+
+  uint16_t colors = data[0] + 1;
+  const uint8_t *p = data + 1 + (colors * 2);
+  if (p > end)
+    return false;
+  uint16_t palette[256] = {};
+  memcpy(palette, data + 1, colors * 2);
+
+  const uint32_t pixels = tileSize * tileSize;
+  uint32_t pixel = 0;
+  uint16_t x = 0;
+  uint16_t *row = dst;
+
+  while (pixel < pixels)
+  {
+    if (p >= end)
+      return false;
+    uint8_t token = *p++;
+    uint32_t count;
+
+    if (token & 0x80)
+    {
+      if (token == IPT_LONG_RUN)
+      {
+        if (p + 2 > end)
+          return false;
+        count = p[0] | (p[1] << 8);
+        p += 2;
+      }
+      else
+        count = (token & 0x7F) + 2;
+
+      if (p >= end || pixel + count > pixels)
+        return false;
+      uint16_t color = palette[*p++];
+      pixel += count;
+
+      while (count > 0)
+      {
+        uint16_t n = min(count, (uint32_t)(tileSize - x));
+        for (uint16_t i = 0; i < n; i++)
+          row[x + i] = color;
+        x += n;
+        count -= n;
+        if (x == tileSize)
+        {
+          x = 0;
+          row += stride;
+        }
+      }
+    }
+    else
+    {
+      count = token + 1;
+      if (p + count > end || pixel + count > pixels)
+        return false;
+      pixel += count;
+
+      while (count-- > 0)
+      {
+        row[x++] = palette[*p++];
+        if (x == tileSize)
+        {
+          x = 0;
+          row += stride;
+        }
+      }
+    }
+  }
+  return true;
+}
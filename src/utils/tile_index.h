@@ -0,0 +1,345 @@
+/**
+ * @file tile_index.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Map tile availability index (skip missing tiles without SD access)
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+#include <atomic>
+
+/**
+ * @brief Availability index: runs of consecutive tileY per tileX, sorted by zoom, tileX, tileY.
+ *        Loaded from /MAP/tiles.idx (built by tools/tileindex.py, or saved after scanning /MAP) if its
+ *        stamp matches the tile folders, else built by scanning /MAP and saved
+ *
+ *        Index file layout (little endian):
+ *        PackHeader             -> magic "ITIX", tile format, runs count
+ *        uint32_t               -> tile folders stamp (see get_tile_stamp)
+ *        PackZoom[PACK_ZOOMS]   -> first run and runs count per zoom level
+ *        TileRun[count]
+ *
+ *        The stamp only covers zoom/x folders (tiles are not listed), delete tiles.idx after replacing
+ *        tiles inside existing folders.
+ *
+ */
+#define TILE_INDEX_FILE "/MAP/tiles.idx"
+#define TILE_INDEX_VERSION 2
+#define TILE_INDEX_GROW 1024
+
+struct TileRun
+{
+  uint32_t tilex;
+  uint32_t first;
+  uint32_t last;
+};
+
+PackZoom tile_index_zooms[PACK_ZOOMS] = {};
+TileRun *tile_index = NULL;
+uint32_t tile_index_runs = 0;
+uint32_t tile_index_size = 0;
+bool tile_index_ready = false;
+
+/**
+ * @brief Missing tile lookups answered by index (SD access avoided, renderer and prefetch task)
+ *
+ */
+std::atomic<uint32_t> tile_index_skipped(0);
+
+/**
+ * @brief Add run to index (grows index in PSRAM)
+ *
+ * @param x -> Tile X
+ * @param first -> first Tile Y
+ * @param last -> last Tile Y
+ * @return true if run is added
+ */
+static bool add_tile_run(uint32_t x, uint32_t first, uint32_t last)
+{
+  if (tile_index_runs == tile_index_size)
+  {
+    TileRun *index = (TileRun *)ps_realloc(tile_index, (tile_index_size + TILE_INDEX_GROW) * sizeof(TileRun));
+    if (index == NULL)
+      return false;
+    tile_index = index;
+    tile_index_size += TILE_INDEX_GROW;
+  }
+  tile_index[tile_index_runs++] = {x, first, last};
+  return true;
+}
+
+/**
+ * @brief Compare functions for qsort
+ *
+ */
+static int compare_tile_y(const void *a, const void *b)
+{
+  uint32_t ya = *(const uint32_t *)a;
+  uint32_t yb = *(const uint32_t *)b;
+  return (ya > yb) - (ya < yb);
+}
+
+static int compare_tile_run(const void *a, const void *b)
+{
+  const TileRun *ra = (const TileRun *)a;
+  const TileRun *rb = (const TileRun *)b;
+  if (ra->tilex != rb->tilex)
+    return (ra->tilex > rb->tilex) - (ra->tilex < rb->tilex);
+  return (ra->first > rb->first) - (ra->first < rb->first);
+}
+
+/**
+ * @brief Stamp of tile folders: order independent hash of all /MAP/zoom/x folders (lists zoom folders only)
+ *
+ * @return uint32_t -> stamp
+ */
+static uint32_t get_tile_stamp()
+{
+  uint32_t stamp = 0;
+  char path[20];
+
+  for (uint8_t z = 0; z < PACK_ZOOMS; z++)
+  {
+    sprintf(path, PSTR("/MAP/%d"), z);
+    File zoom_dir = SD.open(path);
+    if (!zoom_dir || !zoom_dir.isDirectory())
+      continue;
+    File x_dir = zoom_dir.openNextFile();
+    while (x_dir)
+    {
+      if (x_dir.isDirectory() && isdigit(x_dir.name()[0]))
+      {
+        uint32_t h = (z * 0x9E3779B1) ^ (uint32_t)atol(x_dir.name());
+        h = (h ^ (h >> 16)) * 0x85EBCA6B;
+        h = (h ^ (h >> 13)) * 0xC2B2AE35;
+        stamp += h ^ (h >> 16);
+      }
+      x_dir = zoom_dir.openNextFile();
+    }
+  }
+  return stamp;
+}
+
+/**
+ * @brief Load availability index from SD
+ *
+ * @param stamp -> current tile folders stamp
+ * @return true if index is loaded
+ */
+static bool load_tile_index(uint32_t stamp)
+{
+  File file = SD.open(PSTR(TILE_INDEX_FILE), FILE_READ);
+  if (!file)
+    return false;
+
+  PackHeader header;
+  uint32_t index_stamp = 0;
+  if (file.read((uint8_t *)&header, sizeof(header)) != sizeof(header) || memcmp(header.magic, "ITIX", 4) != 0 ||
+      header.version != TILE_INDEX_VERSION || header.format != map_tile_format ||
+      file.read((uint8_t *)&index_stamp, sizeof(index_stamp)) != sizeof(index_stamp))
+  {
+    log_v("Invalid tile index %s", TILE_INDEX_FILE);
+    file.close();
+    return false;
+  }
+  if (index_stamp != stamp)
+  {
+    log_v("Tile index %s doesn't match tile folders", TILE_INDEX_FILE);
+    file.close();
+    return false;
+  }
+
+  tile_index = (TileRun *)ps_malloc(header.count * sizeof(TileRun));
+  bool loaded = tile_index != NULL &&
+                file.read((uint8_t *)tile_index_zooms, sizeof(tile_index_zooms)) == sizeof(tile_index_zooms) &&
+                file.read((uint8_t *)tile_index, header.count * sizeof(TileRun)) == header.count * sizeof(TileRun);
+  file.close();
+  if (!loaded)
+  {
+    free(tile_index);
+    tile_index = NULL;
+    return false;
+  }
+  tile_index_runs = header.count;
+  tile_index_size = header.count;
+  return true;
+}
+
+/**
+ * @brief Add tiles of a /MAP/zoom/x folder to index
+ *
+ * @param x_dir -> tile X folder
+ * @param x -> Tile X
+ * @param ys -> tile Y scratch buffer
+ * @param ys_size -> tile Y scratch buffer size
+ * @return uint32_t -> tiles found
+ */
+static uint32_t scan_tile_column(File &x_dir, uint32_t x, uint32_t *&ys, uint32_t &ys_size)
+{
+  uint32_t tiles = 0;
+  File tile = x_dir.openNextFile();
+  while (tile)
+  {
+    const char *name = tile.name();
+    if (!tile.isDirectory() && isdigit(name[0]) && get_tile_format(name) == map_tile_format)
+    {
+      if (tiles == ys_size)
+      {
+        uint32_t *grow = (uint32_t *)ps_realloc(ys, (ys_size + TILE_INDEX_GROW) * sizeof(uint32_t));
+        if (grow == NULL)
+          break;
+        ys = grow;
+        ys_size += TILE_INDEX_GROW;
+      }
+      ys[tiles++] = atol(name);
+    }
+    tile = x_dir.openNextFile();
+  }
+
+  qsort(ys, tiles, sizeof(uint32_t), compare_tile_y);
+  for (uint32_t i = 0; i < tiles;)
+  {
+    uint32_t j = i;
+    while (j + 1 < tiles && ys[j + 1] <= ys[j] + 1)
+      j++;
+    if (!add_tile_run(x, ys[i], ys[j]))
+      break;
+    i = j + 1;
+  }
+  return tiles;
+}
+
+/**
+ * @brief Build availability index scanning /MAP/zoom/x folders
+ *
+ * @return uint32_t -> tiles found
+ */
+static uint32_t scan_tile_index()
+{
+  uint32_t tiles = 0;
+  uint32_t *ys = NULL;
+  uint32_t ys_size = 0;
+  char path[20];
+
+  for (uint8_t z = 0; z < PACK_ZOOMS; z++)
+  {
+    tile_index_zooms[z].first = tile_index_runs;
+    sprintf(path, PSTR("/MAP/%d"), z);
+    File zoom_dir = SD.open(path);
+    if (zoom_dir && zoom_dir.isDirectory())
+    {
+      File x_dir = zoom_dir.openNextFile();
+      while (x_dir)
+      {
+        if (x_dir.isDirectory() && isdigit(x_dir.name()[0]))
+          tiles += scan_tile_column(x_dir, atol(x_dir.name()), ys, ys_size);
+        x_dir = zoom_dir.openNextFile();
+      }
+    }
+    tile_index_zooms[z].count = tile_index_runs - tile_index_zooms[z].first;
+    if (tile_index_zooms[z].count > 1)
+      qsort(tile_index + tile_index_zooms[z].first, tile_index_zooms[z].count, sizeof(TileRun), compare_tile_run);
+  }
+  free(ys);
+  return tiles;
+}
+
+/**
+ * @brief Save availability index to SD (later boots skip the scan)
+ *
+ * @param stamp -> tile folders stamp
+ * @return true if index is saved
+ */
+static bool save_tile_index(uint32_t stamp)
+{
+  File file = SD.open(PSTR(TILE_INDEX_FILE), FILE_WRITE);
+  if (!file)
+    return false;
+
+  PackHeader header = {{'I', 'T', 'I', 'X'}, TILE_INDEX_VERSION, map_tile_format, 0, tile_index_runs};
+  uint32_t runs_bytes = tile_index_runs * sizeof(TileRun);
+  bool saved = file.write((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+               file.write((uint8_t *)&stamp, sizeof(stamp)) == sizeof(stamp) &&
+               file.write((uint8_t *)tile_index_zooms, sizeof(tile_index_zooms)) == sizeof(tile_index_zooms) &&
+               file.write((uint8_t *)tile_index, runs_bytes) == runs_bytes;
+  file.close();
+  if (!saved)
+  {
+    log_e("Tile index %s not saved", TILE_INDEX_FILE);
+    SD.remove(PSTR(TILE_INDEX_FILE));
+  }
+  return saved;
+}
+
+/**
+ * @brief Build map tile availability index (not needed with tile packs, pack index is used)
+ *
+ */
+void init_tile_index()
+{
+  if (tile_packs > 0)
+    return;
+
+  uint32_t start = millis();
+  uint32_t stamp = get_tile_stamp();
+  bool loaded = load_tile_index(stamp);
+  if (!loaded && scan_tile_index() > 0)
+  {
+    // Release unused index space
+    TileRun *index = (TileRun *)ps_realloc(tile_index, tile_index_runs * sizeof(TileRun));
+    if (index != NULL)
+    {
+      tile_index = index;
+      tile_index_size = tile_index_runs;
+    }
+    save_tile_index(stamp);
+  }
+
+  uint32_t tiles = 0;
+  for (uint32_t i = 0; i < tile_index_runs; i++)
+    tiles += tile_index[i].last - tile_index[i].first + 1;
+
+  tile_index_ready = tiles > 0;
+  arena_heap_account(ARENA_INDEX, tile_index_size * sizeof(TileRun));
+  log_v("Tile index %s: %d tiles, %d runs, %d bytes, %d ms", loaded ? PSTR(TILE_INDEX_FILE) : PSTR("scan"), tiles,
+        tile_index_runs, (uint32_t)(tile_index_size * sizeof(TileRun) + sizeof(tile_index_zooms)), millis() - start);
+}
+
+/**
+ * @brief Check if map tile exists (true if index is not built)
+ *
+ * @param zoom_level -> zoom level
+ * @param x -> Tile X
+ * @param y -> Tile Y
+ * @return true if tile exists
+ */
+bool is_tile_available(uint8_t zoom_level, uint32_t x, uint32_t y)
+{
+  if (!tile_index_ready)
+    return true;
+
+  if (zoom_level < PACK_ZOOMS)
+  {
+    // Last run starting at or before (x, y)
+    int32_t low = tile_index_zooms[zoom_level].first;
+    int32_t high = low + tile_index_zooms[zoom_level].count - 1;
+    int32_t found = -1;
+    while (low <= high)
+    {
+      int32_t mid = (low + high) / 2;
+      const TileRun &run = tile_index[mid];
+      if (run.tilex < x || (run.tilex == x && run.first <= y))
+      {
+        found = mid;
+        low = mid + 1;
+      }
+      else
+        high = mid - 1;
+    }
+    if (found >= 0 && tile_index[found].tilex == x && y <= tile_index[found].last)
+      return true;
+  }
+
+  tile_index_skipped.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file tile_pack.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Indexed map tile pack (.pak files in /MAP) functions
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+/**
+ * @brief Tile pack file layout (little endian, built by tools/tilepack.py)
+ *
+ *        PackHeader
+ *        PackZoom[PACK_ZOOMS]   -> first index entry and entries count per zoom level
+ *        PackEntry[count]       -> sorted by zoom, tileX, tileY
+ *        tile data              -> stored in index order (size = next offset - offset)
+ *
+ */
+#define MAX_TILE_PACKS 4
+#define PACK_ZOOMS 24
+#define PACK_VERSION 1
+#define PACK_INDEX_OFFSET (sizeof(PackHeader) + PACK_ZOOMS * sizeof(PackZoom))
+
+struct PackHeader
+{
+  char magic[4];
+  uint8_t version;
+  uint8_t format;
+  uint16_t reserved;
+  uint32_t count;
+};
+
+struct PackZoom
+{
+  uint32_t first;
+  uint32_t count;
+};
+
+struct PackEntry
+{
+  uint32_t tilex;
+  uint32_t tiley;
+  uint32_t offset;
+};
+
+/**
+ * @brief Structure to store an open tile pack and its index (NULL if index doesn't fit in index budget,
+ *        entries are then read from SD on every lookup)
+ *
+ */
+struct TilePack
+{
+  File file;
+  uint8_t format;
+  uint32_t count;
+  uint32_t size;
+  PackZoom zooms[PACK_ZOOMS];
+  PackEntry *index;
+};
+
+TilePack tile_pack[MAX_TILE_PACKS];
+uint8_t tile_packs = 0;
+
+/**
+ * @brief Mutex for pack file access (renderer and prefetch task share file handles)
+ *
+ */
+SemaphoreHandle_t tile_pack_mutex = NULL;
+
+/**
+ * @brief Open tile pack and load its index into PSRAM
+ *
+ * @param path -> tile pack file path
+ * @return true if pack is loaded
+ */
+bool load_tile_pack(const char *path)
+{
+  if (tile_packs >= MAX_TILE_PACKS)
+    return false;
+
+  TilePack &pack = tile_pack[tile_packs];
+  pack.file = SD.open(path, FILE_READ);
+  if (!pack.file)
+    return false;
+
+  PackHeader header;
+  if (pack.file.read((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+      memcmp(header.magic, "IPAK", 4) != 0 || header.version != PACK_VERSION || header.format >= TILE_FORMATS)
+  {
+    log_v("Invalid tile pack %s", path);
+    pack.file.close();
+    return false;
+  }
+
+  uint32_t index_bytes = header.count * sizeof(PackEntry);
+  bool fits = arena[ARENA_INDEX].used + index_bytes <= arena[ARENA_INDEX].budget;
+  pack.index = fits ? (PackEntry *)ps_malloc(index_bytes) : NULL;
+  if ((fits && pack.index == NULL) ||
+      pack.file.read((uint8_t *)pack.zooms, sizeof(pack.zooms)) != sizeof(pack.zooms) ||
+      (pack.index != NULL && pack.file.read((uint8_t *)pack.index, index_bytes) != index_bytes))
+  {
+    log_v("Error loading tile pack index %s", path);
+    free(pack.index);
+    pack.file.close();
+    return false;
+  }
+
+  if (pack.index != NULL)
+    arena_heap_account(ARENA_INDEX, index_bytes);
+  pack.format = header.format;
+  pack.count = header.count;
+  pack.size = pack.file.size();
+  tile_packs++;
+  if (pack.index != NULL)
+    log_v("Tile pack %s: %d tiles (%s), index %d bytes", path, pack.count, tile_ext[pack.format], index_bytes);
+  else
+    log_e("Tile pack %s: %d tiles (%s), index %d bytes over index budget (%d of %d bytes used), read from SD", path,
+          pack.count, tile_ext[pack.format], index_bytes, arena[ARENA_INDEX].used, arena[ARENA_INDEX].budget);
+  return true;
+}
+
+/**
+ * @brief Load all tile packs found in /MAP
+ *
+ */
+void init_tile_packs()
+{
+  if (tile_pack_mutex == NULL)
+    tile_pack_mutex = xSemaphoreCreateMutex();
+
+  File map_dir = SD.open(PSTR("/MAP"));
+  if (!map_dir)
+    return;
+
+  File file = map_dir.openNextFile();
+  while (file)
+  {
+    const char *ext = strrchr(file.name(), '.');
+    if (!file.isDirectory() && ext != NULL && strcmp(ext, ".pak") == 0)
+    {
+      char path[64];
+      sprintf(path, PSTR("/MAP/%s"), file.name());
+      file.close();
+      load_tile_pack(path);
+    }
+    file = map_dir.openNextFile();
+  }
+}
+
+/**
+ * @brief Read consecutive index entries (from PSRAM index or from pack file)
+ *
+ * @param pack -> tile pack
+ * @param first -> first entry
+ * @param count -> entries to read
+ * @param entries -> destination
+ * @return true if entries are read
+ */
+static bool read_pack_entries(TilePack &pack, uint32_t first, uint32_t count, PackEntry *entries)
+{
+  if (pack.index != NULL)
+  {
+    memcpy(entries, pack.index + first, count * sizeof(PackEntry));
+    return true;
+  }
+  xSemaphoreTake(tile_pack_mutex, portMAX_DELAY);
+  bool read = pack.file.seek(PACK_INDEX_OFFSET + first * sizeof(PackEntry)) &&
+              pack.file.read((uint8_t *)entries, count * sizeof(PackEntry)) == count * sizeof(PackEntry);
+  xSemaphoreGive(tile_pack_mutex);
+  return read;
+}
+
+/**
+ * @brief Search tile in pack indexes (binary search by tileX, tileY in zoom range)
+ *
+ * @param zoom_level -> zoom level
+ * @param x -> Tile X
+ * @param y -> Tile Y
+ * @param offset -> tile data offset in pack file
+ * @param size -> tile data size
+ * @return TilePack* -> pack where tile is stored or NULL if not found
+ */
+TilePack *find_packed_tile(uint8_t zoom_level, uint32_t x, uint32_t y, uint32_t &offset, uint32_t &size)
+{
+  if (zoom_level >= PACK_ZOOMS)
+    return NULL;
+
+  for (int p = 0; p < tile_packs; p++)
+  {
+    TilePack &pack = tile_pack[p];
+    int32_t low = pack.zooms[zoom_level].first;
+    int32_t high = low + pack.zooms[zoom_level].count - 1;
+    while (low <= high)
+    {
+      int32_t mid = (low + high) / 2;
+      PackEntry entries[2];
+      bool last = (uint32_t)(mid + 1) >= pack.count;
+      if (!read_pack_entries(pack, mid, last ? 1 : 2, entries))
+        break;
+      const PackEntry &entry = entries[0];
+      if (entry.tilex == x && entry.tiley == y)
+      {
+        offset = entry.offset;
+        size = (last ? pack.size : entries[1].offset) - offset;
+        return &pack;
+      }
+      if (entry.tilex < x || (entry.tilex == x && entry.tiley < y))
+        low = mid + 1;
+      else
+        high = mid - 1;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Read tile data from pack file
+ *
+ * @param pack -> tile pack
+ * @param offset -> tile data offset
+ * @param size -> tile data size
+ * @param data -> destination buffer
+ * @return true if data is read
+ */
+bool read_packed_tile(TilePack *pack, uint32_t offset, uint32_t size, uint8_t *data)
+{
+  xSemaphoreTake(tile_pack_mutex, portMAX_DELAY);
+  bool read = pack->file.seek(offset) && pack->file.read(data, size) == size;
+  xSemaphoreGive(tile_pack_mutex);
+  return read;
+}
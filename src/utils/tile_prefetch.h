@@ -0,0 +1,291 @@
+/**
+ * @file tile_prefetch.h
+ * @author Jordi Gauchía (jgauchia@jgauchia.com)
+ * @brief  Heading-aware map tile prefetch (decoded in background task)
+ * @version 0.1.6
+ * @date 2023-06-14
+ */
+
+/**
+ * @brief Prefetch settings
+ *
+ */
+#ifndef PREFETCH_TILES
+#define PREFETCH_TILES 6        // Staging tile buffers
+#endif
+#define PREFETCH_DEPTH 3        // Max tiles ahead in direction of travel
+#define PREFETCH_LOOKAHEAD 20   // Seconds ahead to predict
+#define PREFETCH_MIN_SPEED 3    // Min speed (Km/h) to use GPS course
+#define PREFETCH_PERIOD 500     // Min time (ms) between prefetch hints
+#define PREFETCH_RECENT 32      // Recently prefetched tiles (not prefetched again)
+
+/**
+ * @brief Structure to send current position and movement to prefetch task
+ *
+ */
+struct PrefetchHint
+{
+  double lon;
+  double lat;
+  double course;
+  double speed;
+  uint8_t zoom;
+  bool zoom_in;
+  bool zoom_out;
+};
+
+/**
+ * @brief Structure to send decoded tiles to map renderer
+ *
+ */
+struct PrefetchTile
+{
+  uint16_t *buffer;
+  uint32_t tilex;
+  uint32_t tiley;
+  uint8_t zoom;
+};
+
+/**
+ * @brief Prefetch queues (hints to task, decoded tiles to renderer and free staging buffers)
+ *
+ */
+QueueHandle_t prefetch_hint_queue = NULL;
+QueueHandle_t prefetch_ready_queue = NULL;
+QueueHandle_t prefetch_free_queue = NULL;
+
+/**
+ * @brief Sprite used by prefetch task to decode tiles into staging buffers
+ *
+ */
+TFT_eSprite prefetch_spr = TFT_eSprite(&tft);
+
+/**
+ * @brief Recently prefetched tiles
+ *
+ */
+MapTile prefetch_recent[PREFETCH_RECENT] = {};
+uint8_t prefetch_recent_idx = 0;
+
+/**
+ * @brief Prefetch counters (written by prefetch task, read by renderer) and renderer hint time
+ *
+ */
+std::atomic<uint8_t> prefetch_depth(0);
+std::atomic<uint32_t> prefetch_decoded(0);
+uint32_t prefetch_hint_time = 0;
+
+/**
+ * @brief Init prefetch queues and staging buffers
+ *
+ * @return true if prefetch can run
+ */
+bool init_tile_prefetch()
+{
+  prefetch_hint_queue = xQueueCreate(1, sizeof(PrefetchHint));
+  prefetch_ready_queue = xQueueCreate(PREFETCH_TILES, sizeof(PrefetchTile));
+  prefetch_free_queue = xQueueCreate(PREFETCH_TILES, sizeof(uint16_t *));
+
+  uint8_t staging = 0;
+  for (int i = 0; i < PREFETCH_TILES; i++)
+  {
+    uint16_t *buffer = (uint16_t *)arena_heap_alloc(ARENA_TILES, TILE_BYTES);
+    if (buffer == NULL)
+      break;
+    xQueueSend(prefetch_free_queue, &buffer, 0);
+    staging++;
+  }
+  init_tile_decoder(DECODER_PREFETCH);
+  log_v("Tile prefetch: %d staging buffers", staging);
+  return staging > 0 && tile_cache_slots > 0;
+}
+
+/**
+ * @brief Send current position and movement to prefetch task (renderer side)
+ *
+ * @param lon -> Longitude
+ * @param lat -> Latitude
+ * @param course -> GPS course (degrees)
+ * @param speed -> GPS speed (Km/h)
+ * @param zoom_level -> zoom level
+ * @param zoom_in -> prefetch zoom + 1
+ * @param zoom_out -> prefetch zoom - 1
+ */
+void send_prefetch_hint(double lon, double lat, double course, double speed, uint8_t zoom_level, bool zoom_in, bool zoom_out)
+{
+  if (prefetch_hint_queue == NULL || millis() - prefetch_hint_time < PREFETCH_PERIOD)
+    return;
+  prefetch_hint_time = millis();
+
+  PrefetchHint hint = {lon, lat, course, speed, zoom_level, zoom_in, zoom_out};
+  xQueueOverwrite(prefetch_hint_queue, &hint);
+}
+
+/**
+ * @brief Move decoded tiles from prefetch task into tile cache (renderer side)
+ *
+ */
+void receive_prefetch_tiles()
+{
+  if (prefetch_ready_queue == NULL)
+    return;
+
+  PrefetchTile ready;
+  while (xQueueReceive(prefetch_ready_queue, &ready, 0) == pdTRUE)
+  {
+    uint16_t *released = insert_cached_tile(ready.zoom, ready.tilex, ready.tiley, ready.buffer);
+    xQueueSend(prefetch_free_queue, &released, 0);
+  }
+}
+
+/**
+ * @brief Check if tile was recently prefetched
+ *
+ * @param zoom_level -> zoom level
+ * @param x -> Tile X
+ * @param y -> Tile Y
+ * @return true if tile was prefetched before
+ */
+static bool is_recent_prefetch(uint8_t zoom_level, uint32_t x, uint32_t y)
+{
+  for (int i = 0; i < PREFETCH_RECENT; i++)
+  {
+    if (prefetch_recent[i].zoom == zoom_level && prefetch_recent[i].tilex == x && prefetch_recent[i].tiley == y)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Remember prefetched tile (sent to renderer)
+ *
+ * @param zoom_level -> zoom level
+ * @param x -> Tile X
+ * @param y -> Tile Y
+ */
+static void add_recent_prefetch(uint8_t zoom_level, uint32_t x, uint32_t y)
+{
+  prefetch_recent[prefetch_recent_idx].zoom = zoom_level;
+  prefetch_recent[prefetch_recent_idx].tilex = x;
+  prefetch_recent[prefetch_recent_idx].tiley = y;
+  prefetch_recent_idx = (prefetch_recent_idx + 1) % PREFETCH_RECENT;
+}
+
+/**
+ * @brief Decode tile into a staging buffer and send it to renderer (prefetch task side). Tile is remembered
+ *        as recent only once it is queued, so a missing staging buffer or failed decode lets it be retried
+ *
+ * @param zoom_level -> zoom level
+ * @param x -> Tile X
+ * @param y -> Tile Y
+ * @return false if prefetch pass must be aborted (no staging buffer or new hint)
+ */
+static bool prefetch_tile(uint8_t zoom_level, uint32_t x, uint32_t y)
+{
+  if (uxQueueMessagesWaiting(prefetch_hint_queue) > 0)
+    return false;
+
+  if (is_recent_prefetch(zoom_level, x, y))
+    return true;
+
+  PrefetchTile ready;
+  if (xQueueReceive(prefetch_free_queue, &ready.buffer, pdMS_TO_TICKS(PREFETCH_PERIOD)) != pdTRUE)
+    return false;
+
+  char path[40];
+  get_tile_path(path, zoom_level, x, y);
+  MapTile tile = {path, x, y, zoom_level};
+
+  prefetch_spr.setBuffer(ready.buffer, tileSize, tileSize);
+  ready.zoom = zoom_level;
+  ready.tilex = x;
+  ready.tiley = y;
+  if (decode_tile(tile, prefetch_spr, 0, 0, DECODER_PREFETCH) &&
+      xQueueSend(prefetch_ready_queue, &ready, portMAX_DELAY) == pdTRUE)
+  {
+    add_recent_prefetch(zoom_level, x, y);
+    prefetch_decoded.fetch_add(1, std::memory_order_relaxed);
+  }
+  else
+    xQueueSend(prefetch_free_queue, &ready.buffer, 0);
+
+  return true;
+}
+
+/**
+ * @brief Prefetch 3x3 tiles around a tile, except the ones already shown around current tile
+ *
+ * @param zoom_level -> zoom level
+ * @param x -> Tile X
+ * @param y -> Tile Y
+ * @param cur_x -> Current Tile X
+ * @param cur_y -> Current Tile Y
+ * @return false if prefetch pass must be aborted
+ */
+static bool prefetch_around(uint8_t zoom_level, uint32_t x, uint32_t y, uint32_t cur_x, uint32_t cur_y)
+{
+  for (int dy = -1; dy <= 1; dy++)
+  {
+    for (int dx = -1; dx <= 1; dx++)
+    {
+      uint32_t tx = x + dx;
+      uint32_t ty = y + dy;
+      if (abs((int32_t)(tx - cur_x)) <= 1 && abs((int32_t)(ty - cur_y)) <= 1)
+        continue;
+      if (!prefetch_tile(zoom_level, tx, ty))
+        return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Predict and prefetch next tiles in direction of travel and zoom +/- 1 (prefetch task side)
+ *
+ * @param hint -> current position and movement
+ */
+void prefetch_tiles(const PrefetchHint &hint)
+{
+  double world_x = lon2worldx(hint.lon, hint.zoom);
+  double world_y = lat2worldy(hint.lat, hint.zoom);
+  uint32_t cur_x = (uint32_t)(world_x / tileSize);
+  uint32_t cur_y = (uint32_t)(world_y / tileSize);
+
+  // Tiles ahead in direction of travel
+  prefetch_depth = 0;
+  if (hint.speed >= PREFETCH_MIN_SPEED)
+  {
+    double meters_px = METER_PER_PIXELS * cos(DEGtoRAD(hint.lat)) / pow(2.0, hint.zoom);
+    double ahead_px = (hint.speed / 3.6) * PREFETCH_LOOKAHEAD / meters_px;
+    prefetch_depth = (uint8_t)constrain(ceil(ahead_px / tileSize), 1, PREFETCH_DEPTH);
+
+    for (int i = 1; i <= prefetch_depth; i++)
+    {
+      double step = min(ahead_px, (double)(i * tileSize));
+      uint32_t x = (uint32_t)((world_x + step * sin(DEGtoRAD(hint.course))) / tileSize);
+      uint32_t y = (uint32_t)((world_y - step * cos(DEGtoRAD(hint.course))) / tileSize);
+      if (!prefetch_around(hint.zoom, x, y, cur_x, cur_y))
+        return;
+    }
+  }
+
+  // Zoom +/- 1 center tiles
+  if (hint.zoom_in && !prefetch_tile(hint.zoom + 1, lon2tilex(hint.lon, hint.zoom + 1), lat2tiley(hint.lat, hint.zoom + 1)))
+    return;
+  if (hint.zoom_out && !prefetch_tile(hint.zoom - 1, lon2tilex(hint.lon, hint.zoom - 1), lat2tiley(hint.lat, hint.zoom - 1)))
+    return;
+}
+
+/**
+ * @brief Log prefetch counters
+ *
+ */
+void log_prefetch_stats()
+{
+  if (prefetch_ready_queue == NULL)
+    return;
+  uint32_t needed = tile_prefetch_ready + tile_cache_misses;
+  log_v("Prefetch: depth %d, queue %d, decoded %d, ready before needed %d/%d (%d%%)", prefetch_depth.load(),
+        uxQueueMessagesWaiting(prefetch_ready_queue), prefetch_decoded.load(), tile_prefetch_ready, needed,
+        needed ? (tile_prefetch_ready * 100) / needed : 0);
+}
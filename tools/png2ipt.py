@@ -0,0 +1,143 @@
+# IceNav Project
+# Convert Maperitive PNG tiles (Tiles/zoom/x/y.png) to palette + RLE tiles (zoom/x/y.ipt)
+#
+# IPT layout (see src/utils/tile_codec.h):
+#   u8 palette colors - 1, palette (RGB565 byte-swapped), tokens over 256x256 palette indexes
+#   0nnnnnnn  literal, n + 1 indexes follow
+#   1nnnnnnn  run of n + 2 pixels (n < 127), one index follows
+#   11111111  long run, u16 count (little endian) and one index follow
+#
+# Tiles with more than 256 RGB565 colors are quantized to 256 colors.
+#
+# usage: python tools/png2ipt.py <Tiles dir> <output dir> [--keep-png] [--verify]
+
+import argparse
+import os
+import shutil
+import struct
+import sys
+
+TILE_SIZE = 256
+PIXELS = TILE_SIZE * TILE_SIZE
+MAX_LITERAL = 128
+MAX_RUN = 128
+LONG_RUN = 0xFF
+
+
+def rgb565(r, g, b):
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3)
+
+
+def encode(palette, indexes):
+    """Encode RGB565 palette and list of palette indexes into IPT bytes"""
+    out = bytearray([len(palette) - 1])
+    for c in palette:
+        out += struct.pack(">H", c)
+
+    literal = bytearray()
+
+    def flush_literal():
+        while literal:
+            chunk = literal[:MAX_LITERAL]
+            out.append(len(chunk) - 1)
+            out.extend(chunk)
+            del literal[:MAX_LITERAL]
+
+    i = 0
+    while i < PIXELS:
+        run = 1
+        while i + run < PIXELS and indexes[i + run] == indexes[i] and run < 0xFFFF:
+            run += 1
+        if run >= 2:
+            flush_literal()
+            if run > MAX_RUN:
+                out.append(LONG_RUN)
+                out += struct.pack("<H", run)
+            else:
+                out.append(0x80 | (run - 2))
+            out.append(indexes[i])
+        else:
+            literal.append(indexes[i])
+        i += run
+    flush_literal()
+    return bytes(out)
+
+
+def decode(data):
+    """Reference decoder, returns list of RGB565 pixels (not swapped)"""
+    colors = data[0] + 1
+    palette = [struct.unpack(">H", data[1 + i * 2:3 + i * 2])[0] for i in range(colors)]
+    p = 1 + colors * 2
+    pixels = []
+    while len(pixels) < PIXELS:
+        token = data[p]
+        p += 1
+        if token & 0x80:
+            if token == LONG_RUN:
+                count = struct.unpack("<H", data[p:p + 2])[0]
+                p += 2
+            else:
+                count = (token & 0x7F) + 2
+            pixels += [palette[data[p]]] * count
+            p += 1
+        else:
+            count = token + 1
+            pixels += [palette[idx] for idx in data[p:p + count]]
+            p += count
+    if len(pixels) != PIXELS:
+        raise ValueError("invalid tile")
+    return pixels
+
+
+def tile_to_ipt(png_path):
+    """Return (IPT bytes, RGB565 pixels) of a 256x256 PNG tile"""
+    from PIL import Image
+    img = Image.open(png_path).convert("RGB")
+    if img.size != (TILE_SIZE, TILE_SIZE):
+        img = img.resize((TILE_SIZE, TILE_SIZE))
+    pixels = [rgb565(*px) for px in img.getdata()]
+    if len(set(pixels)) > 256:
+        img = img.quantize(256).convert("RGB")
+        pixels = [rgb565(*px) for px in img.getdata()]
+    palette = sorted(set(pixels))
+    lookup = {c: i for i, c in enumerate(palette)}
+    return encode(palette, [lookup[c] for c in pixels]), pixels
+
+
+def convert(src_dir, dst_dir, keep_png=False, verify=False):
+    tiles = 0
+    png_bytes = 0
+    ipt_bytes = 0
+    for root, _, files in os.walk(src_dir):
+        rel = os.path.relpath(root, src_dir)
+        for name in files:
+            if not name.lower().endswith(".png"):
+                continue
+            src = os.path.join(root, name)
+            out_dir = os.path.join(dst_dir, rel)
+            os.makedirs(out_dir, exist_ok=True)
+            data, pixels = tile_to_ipt(src)
+            with open(os.path.join(out_dir, os.path.splitext(name)[0] + ".ipt"), "wb") as f:
+                f.write(data)
+            if keep_png:
+                shutil.copy(src, os.path.join(out_dir, name))
+            if verify and decode(data) != pixels:
+                sys.exit("verify failed: " + src)
+            tiles += 1
+            png_bytes += os.path.getsize(src)
+            ipt_bytes += len(data)
+
+    if tiles == 0:
+        sys.exit("no png tiles found in " + src_dir)
+    print("tiles: %d  png: %d bytes  ipt: %d bytes (%d%%)" % (tiles, png_bytes, ipt_bytes, ipt_bytes * 100 // png_bytes))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Convert Maperitive PNG tiles to IceNav palette + RLE tiles")
+    parser.add_argument("src", help="Maperitive Tiles directory")
+    parser.add_argument("dst", help="output directory (copy its contents to /MAP on SD)")
+    parser.add_argument("--keep-png", action="store_true",
+                        help="copy PNG tiles next to ipt tiles (to benchmark both formats, see native_codec)")
+    parser.add_argument("--verify", action="store_true", help="decode every tile back and compare pixels")
+    args = parser.parse_args()
+    convert(args.src, args.dst, args.keep_png, args.verify)
@@ -0,0 +1,73 @@
+# IceNav Project
+# Convert Maperitive PNG tiles (Tiles/zoom/x/y.png) to raw RGB565 tiles (zoom/x/y.rgb)
+#
+# Raw tiles are 256x256 RGB565 pixels, byte-swapped (high byte first) to match
+# LGFX_Sprite memory layout, so the device loads them with a single SD read.
+#
+# usage: python tools/png2rgb565.py <Tiles dir> <output dir> [--little-endian] [--keep-png]
+
+import argparse
+import os
+import shutil
+import sys
+
+try:
+    from PIL import Image
+except ImportError:
+    sys.exit("Pillow is required: pip install pillow")
+
+TILE_SIZE = 256
+
+
+def png_to_rgb565(png_path, swap=True):
+    """Return raw RGB565 bytes of a 256x256 tile"""
+    img = Image.open(png_path).convert("RGB")
+    if img.size != (TILE_SIZE, TILE_SIZE):
+        img = img.resize((TILE_SIZE, TILE_SIZE))
+    rgb = img.tobytes()
+    out = bytearray(TILE_SIZE * TILE_SIZE * 2)
+    for i in range(TILE_SIZE * TILE_SIZE):
+        r, g, b = rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2]
+        c = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3)
+        if swap:
+            out[i * 2] = c >> 8
+            out[i * 2 + 1] = c & 0xFF
+        else:
+            out[i * 2] = c & 0xFF
+            out[i * 2 + 1] = c >> 8
+    return bytes(out)
+
+
+def convert(src_dir, dst_dir, swap=True, keep_png=False):
+    tiles = 0
+    png_bytes = 0
+    rgb_bytes = 0
+    for root, _, files in os.walk(src_dir):
+        rel = os.path.relpath(root, src_dir)
+        for name in files:
+            if not name.lower().endswith(".png"):
+                continue
+            src = os.path.join(root, name)
+            out_dir = os.path.join(dst_dir, rel)
+            os.makedirs(out_dir, exist_ok=True)
+            dst = os.path.join(out_dir, os.path.splitext(name)[0] + ".rgb")
+            with open(dst, "wb") as f:
+                f.write(png_to_rgb565(src, swap))
+            if keep_png:
+                shutil.copy(src, os.path.join(out_dir, name))
+            tiles += 1
+            png_bytes += os.path.getsize(src)
+            rgb_bytes += os.path.getsize(dst)
+    print("tiles: %d  png: %d bytes  rgb565: %d bytes" % (tiles, png_bytes, rgb_bytes))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Convert Maperitive PNG tiles to raw RGB565 tiles")
+    parser.add_argument("src", help="Maperitive Tiles directory")
+    parser.add_argument("dst", help="output directory (copy its contents to /MAP on SD)")
+    parser.add_argument("--little-endian", action="store_true",
+                        help="do not byte-swap pixels (not LGFX_Sprite layout, for other viewers)")
+    parser.add_argument("--keep-png", action="store_true",
+                        help="copy PNG tiles next to raw tiles (to benchmark both formats)")
+    args = parser.parse_args()
+    convert(args.src, args.dst, not args.little_endian, args.keep_png)
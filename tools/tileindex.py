@@ -0,0 +1,88 @@
+# IceNav Project
+# Build map tile availability index (/MAP/tiles.idx) from a zoom/x/y tile directory tree,
+# so tiles folders are not scanned at boot
+#
+# Index layout (little endian):
+#   header   "ITIX", version (u8), format (u8: 0 png, 1 rgb, 2 ipt), reserved (u16), runs (u32)
+#   stamp    tile folders stamp (u32): sum of a hash of every zoom/x folder, checked on boot
+#   zooms    24 x (first run (u32), runs (u32))
+#   runs     runs x (tile x (u32), first tile y (u32), last tile y (u32)), sorted by zoom, x, y
+#
+# usage: python tools/tileindex.py <tiles dir> [--format png|rgb|ipt] [--output tiles.idx]
+
+import argparse
+import os
+import struct
+import sys
+
+from tilepack import FORMATS, HEADER, PACK_ZOOMS, ZOOM, find_tiles
+
+INDEX_VERSION = 2
+RUN = struct.Struct("<III")
+STAMP = struct.Struct("<I")
+MASK = 0xFFFFFFFF
+
+
+def folder_hash(z, x):
+    """Hash of a zoom/x folder (same as get_tile_stamp in src/utils/tile_index.h)"""
+    h = ((z * 0x9E3779B1) & MASK) ^ x
+    h = ((h ^ (h >> 16)) * 0x85EBCA6B) & MASK
+    h = ((h ^ (h >> 13)) * 0xC2B2AE35) & MASK
+    return h ^ (h >> 16)
+
+
+def tile_stamp(src):
+    """Order independent stamp of all zoom/x folders"""
+    stamp = 0
+    for z in range(PACK_ZOOMS):
+        zoom_dir = os.path.join(src, str(z))
+        if not os.path.isdir(zoom_dir):
+            continue
+        for name in os.listdir(zoom_dir):
+            if name[0].isdigit() and os.path.isdir(os.path.join(zoom_dir, name)):
+                digits = len(name) - len(name.lstrip("0123456789"))
+                stamp = (stamp + folder_hash(z, int(name[:digits]))) & MASK
+    return stamp
+
+
+def build_runs(tiles):
+    """Return list of (zoom, x, first y, last y) runs of consecutive tiles"""
+    runs = []
+    for z, x, y, _ in tiles:
+        if runs and runs[-1][0] == z and runs[-1][1] == x and runs[-1][3] + 1 == y:
+            runs[-1][3] = y
+        else:
+            runs.append([z, x, y, y])
+    return runs
+
+
+def build_index(runs, fmt, stamp, out_path):
+    zooms = [[0, 0] for _ in range(PACK_ZOOMS)]
+    for i, (z, _, _, _) in enumerate(runs):
+        if zooms[z][1] == 0:
+            zooms[z][0] = i
+        zooms[z][1] += 1
+
+    with open(out_path, "wb") as f:
+        f.write(HEADER.pack(b"ITIX", INDEX_VERSION, FORMATS.index(fmt), 0, len(runs)))
+        f.write(STAMP.pack(stamp))
+        for first, count in zooms:
+            f.write(ZOOM.pack(first, count))
+        for _, x, first, last in runs:
+            f.write(RUN.pack(x, first, last))
+    return os.path.getsize(out_path)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Build IceNav map tile availability index")
+    parser.add_argument("src", help="tiles directory (zoom/x/y.png, .rgb or .ipt), as copied to /MAP")
+    parser.add_argument("--format", choices=FORMATS, default="png", help="tile format on SD")
+    parser.add_argument("--output", help="output index file (default: <tiles dir>/tiles.idx)")
+    args = parser.parse_args()
+
+    tiles = find_tiles(args.src, args.format, 0, PACK_ZOOMS - 1)
+    if not tiles:
+        sys.exit("no %s tiles found in %s" % (args.format, args.src))
+    runs = build_runs(tiles)
+    size = build_index(runs, args.format, tile_stamp(args.src), args.output or os.path.join(args.src, "tiles.idx"))
+    print("tiles: %d  runs: %d  index: %d bytes" % (len(tiles), len(runs), size))
@@ -0,0 +1,81 @@
+# IceNav Project
+# Build an indexed tile pack (/MAP/<region>.pak) from a zoom/x/y tile directory tree
+#
+# Pack layout (little endian):
+#   header   "IPAK", version (u8), format (u8: 0 png, 1 rgb, 2 ipt), reserved (u16), count (u32)
+#   zooms    24 x (first index entry (u32), entries (u32))
+#   index    count x (tile x (u32), tile y (u32), data offset (u32)), sorted by zoom, x, y
+#   data     tiles in index order (size = next offset - offset)
+#
+# usage: python tools/tilepack.py <tiles dir> <output.pak> [--format png|rgb|ipt] [--minzoom N] [--maxzoom N]
+
+import argparse
+import os
+import struct
+import sys
+
+PACK_VERSION = 1
+PACK_ZOOMS = 24
+FORMATS = ["png", "rgb", "ipt"]
+HEADER = struct.Struct("<4sBBHI")
+ZOOM = struct.Struct("<II")
+ENTRY = struct.Struct("<III")
+
+
+def find_tiles(src_dir, ext, minzoom, maxzoom):
+    """Return sorted list of (zoom, x, y, path)"""
+    tiles = []
+    for z in os.listdir(src_dir):
+        if not z.isdigit() or not minzoom <= int(z) <= maxzoom:
+            continue
+        zoom_dir = os.path.join(src_dir, z)
+        for x in os.listdir(zoom_dir):
+            x_dir = os.path.join(zoom_dir, x)
+            if not x.isdigit() or not os.path.isdir(x_dir):
+                continue
+            for name in os.listdir(x_dir):
+                y, file_ext = os.path.splitext(name)
+                if y.isdigit() and file_ext.lower() == "." + ext:
+                    tiles.append((int(z), int(x), int(y), os.path.join(x_dir, name)))
+    tiles.sort()
+    return tiles
+
+
+def build_pack(tiles, fmt, out_path):
+    zooms = [[0, 0] for _ in range(PACK_ZOOMS)]
+    for i, (z, _, _, _) in enumerate(tiles):
+        if zooms[z][1] == 0:
+            zooms[z][0] = i
+        zooms[z][1] += 1
+
+    offset = HEADER.size + ZOOM.size * PACK_ZOOMS + ENTRY.size * len(tiles)
+    index = []
+    for z, x, y, path in tiles:
+        index.append(ENTRY.pack(x, y, offset))
+        offset += os.path.getsize(path)
+
+    with open(out_path, "wb") as f:
+        f.write(HEADER.pack(b"IPAK", PACK_VERSION, FORMATS.index(fmt), 0, len(tiles)))
+        for first, count in zooms:
+            f.write(ZOOM.pack(first, count))
+        f.write(b"".join(index))
+        for _, _, _, path in tiles:
+            with open(path, "rb") as tile:
+                f.write(tile.read())
+    return offset
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Build IceNav indexed tile pack")
+    parser.add_argument("src", help="tiles directory (zoom/x/y.png, .rgb or .ipt)")
+    parser.add_argument("dst", help="output pack file (copy it to /MAP on SD)")
+    parser.add_argument("--format", choices=FORMATS, default="png", help="tile format to pack")
+    parser.add_argument("--minzoom", type=int, default=0)
+    parser.add_argument("--maxzoom", type=int, default=PACK_ZOOMS - 1)
+    args = parser.parse_args()
+
+    tiles = find_tiles(args.src, args.format, args.minzoom, min(args.maxzoom, PACK_ZOOMS - 1))
+    if not tiles:
+        sys.exit("no %s tiles found in %s" % (args.format, args.src))
+    size = build_pack(tiles, args.format, args.dst)
+    print("tiles: %d  index: %d bytes  pack: %d bytes" % (len(tiles), ENTRY.size * len(tiles), size))